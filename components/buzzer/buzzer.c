@@ -109,9 +109,9 @@ void fingerprint_send_buzzer_message(void *pvParameters)
                 }
             }
 
-            vTaskDelay(pdMS_TO_TICKS(600));         // Delay 600ms then turn off fingerprint module
+            vTaskDelay(pdMS_TO_TICKS(600));         // Delay 600ms then release fingerprint module
             gpio_set_level(FINGERPRINT_LED_PIN, 1); // Turn off fingerprint LED
-            prepare_turn_off_fingerprint();         // Power down fingerprint module
+            fingerprint_verification_done();        // Keep fingerprint module warm or power it down
         }
     }
 }
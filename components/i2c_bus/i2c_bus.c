@@ -0,0 +1,334 @@
+#include "i2c_bus.h"
+
+static const char *TAG = "i2c_bus";
+
+// A device added to the bus
+struct i2c_bus_device_entry
+{
+    i2c_master_dev_handle_t handle; // Device handle, NULL = not added
+    uint8_t priority;               // I2C_BUS_PRIORITY_* of its transactions
+    struct i2c_bus_stats stats;     // Bus usage
+};
+
+static i2c_master_bus_handle_t bus_handle = NULL; // The bus, owned by i2c_bus_task
+static TaskHandle_t i2c_bus_task_handle = NULL;
+static struct i2c_bus_device_entry devices[I2C_BUS_DEVICE_COUNT] = {0};
+static struct i2c_bus_transaction *queue_head[I2C_BUS_PRIORITY_COUNT] = {0}; // Oldest queued transaction per priority
+static struct i2c_bus_transaction *queue_tail[I2C_BUS_PRIORITY_COUNT] = {0}; // Newest queued transaction per priority
+static portMUX_TYPE bus_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Take the next transaction: the oldest one of the highest priority
+ * @return Transaction, NULL = queue empty
+ */
+static struct i2c_bus_transaction *i2c_bus_next()
+{
+    struct i2c_bus_transaction *transaction = NULL;
+    taskENTER_CRITICAL(&bus_lock);
+    for (uint8_t priority = 0; priority < I2C_BUS_PRIORITY_COUNT && transaction == NULL; priority++)
+    {
+        transaction = queue_head[priority];
+        if (transaction == NULL)
+        {
+            continue;
+        }
+        queue_head[priority] = transaction->next;
+        if (queue_head[priority] == NULL)
+        {
+            queue_tail[priority] = NULL;
+        }
+        for (uint8_t lower = priority + 1; lower < I2C_BUS_PRIORITY_COUNT; lower++)
+        {
+            if (queue_head[lower] != NULL)
+            {
+                devices[queue_head[lower]->device].stats.preempted++;
+            }
+        }
+    }
+    taskEXIT_CRITICAL(&bus_lock);
+    return transaction;
+}
+
+/**
+ * @brief Bus task: runs queued transactions one at a time, so a display transfer never holds up NFC traffic for
+ *        longer than the transaction already on the bus
+ */
+static void i2c_bus_task(void *arg)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        struct i2c_bus_transaction *transaction;
+        while ((transaction = i2c_bus_next()) != NULL)
+        {
+            struct i2c_bus_device_entry *device = &devices[transaction->device];
+            int64_t start = esp_timer_get_time();
+            size_t bytes = transaction->readLen;
+            if (transaction->writeBuffers != NULL)
+            {
+                bytes = 0;
+                for (uint8_t i = 0; i < transaction->writeCount; i++)
+                {
+                    bytes += transaction->writeBuffers[i].buffer_size;
+                }
+                transaction->result = i2c_master_multi_buffer_transmit(device->handle, transaction->writeBuffers,
+                                                                       transaction->writeCount, transaction->timeoutMs);
+            }
+            else
+            {
+                transaction->result = i2c_master_receive(device->handle, transaction->readBuffer, transaction->readLen,
+                                                         transaction->timeoutMs);
+            }
+            int64_t end = esp_timer_get_time();
+            uint32_t wait_us = start - transaction->queueTime;
+            taskENTER_CRITICAL(&bus_lock);
+            device->stats.transactions++;
+            device->stats.errors += transaction->result != ESP_OK;
+            device->stats.bytes += bytes;
+            device->stats.busyUs += end - start;
+            device->stats.lastWaitUs = wait_us;
+            device->stats.totalWaitUs += wait_us;
+            if (wait_us > device->stats.maxWaitUs)
+            {
+                device->stats.maxWaitUs = wait_us;
+            }
+            taskEXIT_CRITICAL(&bus_lock);
+            xTaskNotifyGiveIndexed(transaction->owner, I2C_BUS_NOTIFY_INDEX); // The transaction belongs to its owner again
+        }
+    }
+}
+
+/**
+ * @brief Create the shared I2C bus and the task that schedules it, called by every driver on the bus
+ * @return esp_err_t ESP_OK = bus ready (or already created), others = creation failed
+ */
+esp_err_t i2c_bus_init()
+{
+    if (bus_handle != NULL)
+    {
+        return ESP_OK;
+    }
+    i2c_master_bus_config_t i2c_cfg = {
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .i2c_port = I2C_MASTER_NUM,
+        .scl_io_num = I2C_MASTER_SCL_IO,
+        .sda_io_num = I2C_MASTER_SDA_IO,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    esp_err_t err = i2c_new_master_bus(&i2c_cfg, &bus_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "I2C bus creation failed (%s)", esp_err_to_name(err));
+        bus_handle = NULL;
+        return err;
+    }
+    if (xTaskCreate(i2c_bus_task, "i2c_bus_task", I2C_BUS_TASK_STACK_SIZE, NULL, I2C_BUS_TASK_PRIORITY,
+                    &i2c_bus_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "I2C bus task creation failed");
+        i2c_del_master_bus(bus_handle);
+        bus_handle = NULL;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "I2C bus initialized");
+    return ESP_OK;
+}
+
+/**
+ * @brief Add a device with its own clock speed and transaction priority
+ * @param device I2C_BUS_DEVICE_*
+ * @param address 7-bit address
+ * @param speed_hz SCL frequency used for this device
+ * @param priority I2C_BUS_PRIORITY_* of its transactions
+ * @return esp_err_t ESP_OK = added, ESP_ERR_INVALID_ARG = unknown device or priority, ESP_ERR_INVALID_STATE = bus
+ *         not created or device already added, others = driver error
+ */
+esp_err_t i2c_bus_add_device(uint8_t device, uint16_t address, uint32_t speed_hz, uint8_t priority)
+{
+    if (device >= I2C_BUS_DEVICE_COUNT || priority >= I2C_BUS_PRIORITY_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (bus_handle == NULL || devices[device].handle != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = speed_hz,
+    };
+    esp_err_t err = i2c_master_bus_add_device(bus_handle, &dev_cfg, &devices[device].handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Adding device %02X failed (%s)", address, esp_err_to_name(err));
+        devices[device].handle = NULL;
+        return err;
+    }
+    devices[device].priority = priority;
+    devices[device].stats.speedHz = speed_hz;
+    ESP_LOGI(TAG, "Device %02X added at %lu Hz", address, speed_hz);
+    return ESP_OK;
+}
+
+/**
+ * @brief Queue a transaction and wait until the bus task has run it
+ * @note A transaction still queued after timeoutMs is withdrawn, one already on the bus is bounded by the I2C timeout
+ * @note Completion is signalled on notification slot I2C_BUS_NOTIFY_INDEX, the caller's own notifications on slot 0
+ *       (e.g. oled_task refresh requests) neither wake this early nor get consumed by it
+ * @param transaction Transaction, device and buffers filled in; owned by the bus until this returns
+ * @return esp_err_t ESP_OK = transferred, ESP_ERR_TIMEOUT = bus busy for longer than timeoutMs (or I2C timeout),
+ *         ESP_ERR_NOT_FINISHED = cancelled by another task, ESP_ERR_INVALID_STATE = device not added,
+ *         others = I2C error
+ */
+esp_err_t i2c_bus_transfer(struct i2c_bus_transaction *transaction)
+{
+    if (transaction->device >= I2C_BUS_DEVICE_COUNT || devices[transaction->device].handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t priority = devices[transaction->device].priority;
+    transaction->owner = xTaskGetCurrentTaskHandle();
+    transaction->queueTime = esp_timer_get_time();
+    transaction->result = ESP_FAIL;
+    transaction->next = NULL;
+    taskENTER_CRITICAL(&bus_lock);
+    if (queue_tail[priority] != NULL)
+    {
+        queue_tail[priority]->next = transaction;
+    }
+    else
+    {
+        queue_head[priority] = transaction;
+    }
+    queue_tail[priority] = transaction;
+    taskEXIT_CRITICAL(&bus_lock);
+    xTaskNotifyGive(i2c_bus_task_handle);
+
+    TickType_t wait = transaction->timeoutMs < 0 ? portMAX_DELAY : pdMS_TO_TICKS(transaction->timeoutMs) + 1;
+    if (ulTaskNotifyTakeIndexed(I2C_BUS_NOTIFY_INDEX, pdTRUE, wait) == 0)
+    {
+        bool withdrawn = i2c_bus_cancel(transaction);
+        ulTaskNotifyTakeIndexed(I2C_BUS_NOTIFY_INDEX, pdTRUE, portMAX_DELAY); // Given by the cancellation, or by the bus task once it is done
+        if (withdrawn)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    return transaction->result;
+}
+
+/**
+ * @brief Withdraw a transaction that has not started yet, its owner returns ESP_ERR_NOT_FINISHED
+ * @param transaction Queued transaction
+ * @return true = withdrawn, false = already on the bus or done
+ */
+bool i2c_bus_cancel(struct i2c_bus_transaction *transaction)
+{
+    bool found = false;
+    uint8_t priority = devices[transaction->device].priority;
+    taskENTER_CRITICAL(&bus_lock);
+    struct i2c_bus_transaction *previous = NULL;
+    for (struct i2c_bus_transaction *queued = queue_head[priority]; queued != NULL; queued = queued->next)
+    {
+        if (queued != transaction)
+        {
+            previous = queued;
+            continue;
+        }
+        if (previous != NULL)
+        {
+            previous->next = queued->next;
+        }
+        else
+        {
+            queue_head[priority] = queued->next;
+        }
+        if (queue_tail[priority] == queued)
+        {
+            queue_tail[priority] = previous;
+        }
+        devices[transaction->device].stats.cancelled++;
+        transaction->result = ESP_ERR_NOT_FINISHED;
+        found = true;
+        break;
+    }
+    taskEXIT_CRITICAL(&bus_lock);
+    if (found)
+    {
+        xTaskNotifyGiveIndexed(transaction->owner, I2C_BUS_NOTIFY_INDEX);
+    }
+    return found;
+}
+
+/**
+ * @brief Write a buffer to a device through the scheduler
+ * @param device I2C_BUS_DEVICE_*
+ * @param data Data
+ * @param len Data length
+ * @param timeout_ms Longest queueing delay and I2C timeout (ms), -1 = forever
+ * @return esp_err_t see i2c_bus_transfer
+ */
+esp_err_t i2c_bus_transmit(uint8_t device, const uint8_t *data, size_t len, int timeout_ms)
+{
+    i2c_master_transmit_multi_buffer_info_t buffer = {.write_buffer = (uint8_t *)data, .buffer_size = len};
+    return i2c_bus_multi_buffer_transmit(device, &buffer, 1, timeout_ms);
+}
+
+/**
+ * @brief Write several buffers to a device in one transaction through the scheduler
+ * @param device I2C_BUS_DEVICE_*
+ * @param buffers Buffers, written back to back
+ * @param count Number of buffers
+ * @param timeout_ms Longest queueing delay and I2C timeout (ms), -1 = forever
+ * @return esp_err_t see i2c_bus_transfer
+ */
+esp_err_t i2c_bus_multi_buffer_transmit(uint8_t device, i2c_master_transmit_multi_buffer_info_t *buffers,
+                                        uint8_t count, int timeout_ms)
+{
+    struct i2c_bus_transaction transaction = {
+        .device = device,
+        .writeBuffers = buffers,
+        .writeCount = count,
+        .timeoutMs = timeout_ms,
+    };
+    return i2c_bus_transfer(&transaction);
+}
+
+/**
+ * @brief Read from a device through the scheduler
+ * @param device I2C_BUS_DEVICE_*
+ * @param buf Output
+ * @param len Bytes to read
+ * @param timeout_ms Longest queueing delay and I2C timeout (ms), -1 = forever
+ * @return esp_err_t see i2c_bus_transfer
+ */
+esp_err_t i2c_bus_receive(uint8_t device, uint8_t *buf, size_t len, int timeout_ms)
+{
+    struct i2c_bus_transaction transaction = {
+        .device = device,
+        .readBuffer = buf,
+        .readLen = len,
+        .timeoutMs = timeout_ms,
+    };
+    return i2c_bus_transfer(&transaction);
+}
+
+/**
+ * @brief Get the bus usage of a device
+ * @param device I2C_BUS_DEVICE_*
+ * @param out Output, copy of the measurements
+ * @return void
+ */
+void i2c_bus_get_stats(uint8_t device, struct i2c_bus_stats *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (device >= I2C_BUS_DEVICE_COUNT)
+    {
+        return;
+    }
+    taskENTER_CRITICAL(&bus_lock);
+    *out = devices[device].stats;
+    taskEXIT_CRITICAL(&bus_lock);
+}
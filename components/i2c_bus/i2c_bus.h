@@ -0,0 +1,74 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <driver/i2c_master.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#include "app_config.h"
+
+#define I2C_BUS_TASK_PRIORITY 11  // Above pn7160_task, a queued transaction starts as soon as the bus is free
+#define I2C_BUS_TASK_STACK_SIZE 3072
+#define I2C_BUS_NOTIFY_INDEX 1    // Task notification slot reserved for transaction completion, slot 0 stays free for the caller
+
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= I2C_BUS_NOTIFY_INDEX
+#error "i2c_bus needs CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES >= 2"
+#endif
+
+// Devices on the shared bus
+enum i2c_bus_device
+{
+    I2C_BUS_DEVICE_PN7160, // NFC controller, latency sensitive
+    I2C_BUS_DEVICE_OLED,   // SSD1306 display, bulk transfers
+    I2C_BUS_DEVICE_COUNT,
+};
+
+// Transaction priorities, at every transaction boundary the oldest transaction of the highest priority goes next
+enum i2c_bus_priority
+{
+    I2C_BUS_PRIORITY_HIGH,
+    I2C_BUS_PRIORITY_LOW,
+    I2C_BUS_PRIORITY_COUNT,
+};
+
+// One transfer to or from a device, run by the bus task
+struct i2c_bus_transaction
+{
+    uint8_t device;                                        // I2C_BUS_DEVICE_*
+    i2c_master_transmit_multi_buffer_info_t *writeBuffers; // Buffers written back to back, NULL for a read
+    uint8_t writeCount;                                    // Number of write buffers
+    uint8_t *readBuffer;                                   // Read destination, used when writeBuffers is NULL
+    size_t readLen;                                        // Bytes to read
+    int timeoutMs;                                         // Longest queueing delay and I2C timeout (ms), -1 = forever
+    TaskHandle_t owner;                                    // Task waiting for the transaction, notified when done
+    int64_t queueTime;                                     // Time the transaction was queued (us)
+    esp_err_t result;                                      // Result of the transfer
+    struct i2c_bus_transaction *next;                      // Next queued transaction of the same priority
+};
+
+// Per-device bus usage
+struct i2c_bus_stats
+{
+    uint32_t speedHz;      // SCL frequency of the device
+    uint32_t transactions; // Transactions run, including failed ones
+    uint32_t errors;       // Transactions that failed on the bus
+    uint32_t cancelled;    // Transactions withdrawn before they started
+    uint32_t preempted;    // Higher priority transactions that went ahead of a queued transaction of this device
+    uint64_t bytes;        // Bytes written and read
+    uint64_t busyUs;       // Bus occupancy (us)
+    uint32_t lastWaitUs;   // Queueing delay of the last transaction (us)
+    uint32_t maxWaitUs;    // Longest queueing delay (us)
+    uint64_t totalWaitUs;  // Sum of queueing delays, divide by transactions for the average (us)
+};
+
+esp_err_t i2c_bus_init();
+esp_err_t i2c_bus_add_device(uint8_t device, uint16_t address, uint32_t speed_hz, uint8_t priority);
+esp_err_t i2c_bus_transfer(struct i2c_bus_transaction *transaction);
+bool i2c_bus_cancel(struct i2c_bus_transaction *transaction);
+esp_err_t i2c_bus_transmit(uint8_t device, const uint8_t *data, size_t len, int timeout_ms);
+esp_err_t i2c_bus_multi_buffer_transmit(uint8_t device, i2c_master_transmit_multi_buffer_info_t *buffers,
+                                        uint8_t count, int timeout_ms);
+esp_err_t i2c_bus_receive(uint8_t device, uint8_t *buf, size_t len, int timeout_ms);
+void i2c_bus_get_stats(uint8_t device, struct i2c_bus_stats *out);
+
+#endif
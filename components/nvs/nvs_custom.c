@@ -27,6 +27,31 @@ esp_err_t nvs_custom_init(void)
     return ret;
 }
 
+esp_err_t nvs_custom_init_partition(const char *part_name)
+{
+    esp_err_t ret = nvs_flash_init_partition(part_name);
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_LOGW(TAG, "NVS partition %s need erase, try to erase...", part_name);
+        ret = nvs_flash_erase_partition(part_name);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Erase NVS partition %s failed: 0x%x", part_name, ret);
+            return ret;
+        }
+        ret = nvs_flash_init_partition(part_name);
+    }
+    if (ret == ESP_OK)
+    {
+        ESP_LOGI(TAG, "NVS init success (partition: %s)", part_name);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "NVS init failed (partition: %s): 0x%x", part_name, ret);
+    }
+    return ret;
+}
+
 esp_err_t nvs_custom_deinit(void)
 {
     esp_err_t ret = nvs_flash_deinit();
@@ -11,6 +11,14 @@
  */
 esp_err_t nvs_custom_init(void);
 
+/**
+ * @brief 初始化指定的NVS分区（如存放卡片的独立分区）
+ * @note 与nvs_custom_init相同，若分区损坏会自动尝试擦除后重新初始化
+ * @param part_name NVS分区名
+ * @return esp_err_t 错误码：ESP_OK成功，其他为失败
+ */
+esp_err_t nvs_custom_init_partition(const char *part_name);
+
 /**
  * @brief 反初始化默认NVS分区
  * @note 仅在需要释放NVS资源时调用
@@ -1,13 +1,33 @@
 #include "oled.h"
 #include <string.h>
 #include <math.h>
+#include <esp_timer.h>
 
 #define TAG "oled"
 
-/* 显存缓存（128x64 -> 128x8页） */
-static uint8_t oled_buffer[OLED_WIDTH][8];
-
-i2c_master_dev_handle_t oled_handle;
+/* 显存缓存（128x64 -> 8页x128列），与 SSD1306 显存同为页优先排列。
+ * oled_buffer 为后台缓冲，各任务在锁内绘制；oled_front 为前台缓冲，只由显示任务读写，
+ * 翻页时把脏区从后台拷到前台，再直接交给 I2C 发送，传输期间绘制不受阻塞 */
+static uint8_t oled_buffer[OLED_PAGES][OLED_WIDTH];
+static uint8_t oled_front[OLED_PAGES][OLED_WIDTH];
+
+/* 脏区：每页被改动的列范围 [dirty_x0, dirty_x1]，dirty_x0 > dirty_x1 表示该页无改动 */
+static uint8_t dirty_x0[OLED_PAGES];
+static uint8_t dirty_x1[OLED_PAGES];
+static struct oled_refresh_stats refresh_stats = {0};
+
+// 后台缓冲、脏区与统计的锁（递归锁，绘图函数之间可以嵌套调用）
+static SemaphoreHandle_t oled_mutex = NULL;
+static TaskHandle_t oled_task_handle = NULL;
+#define OLED_LOCK() xSemaphoreTakeRecursive(oled_mutex, portMAX_DELAY)
+#define OLED_UNLOCK() xSemaphoreGiveRecursive(oled_mutex)
+
+// I2C 访问经由总线调度器（低优先级，NFC 传输可在事务边界插队）；NFC 模拟器运行时总线上没有真实屏幕，写入直接丢弃
+#if NFC_SIMULATOR
+#define oled_i2c_transmit(buffers, count) ((void)(buffers), ESP_OK)
+#else
+#define oled_i2c_transmit(buffers, count) i2c_bus_multi_buffer_transmit(I2C_BUS_DEVICE_OLED, (buffers), (count), -1)
+#endif
 
 // I2C 底层通信
 static esp_err_t _oled_write_cmd(uint8_t *cmd, size_t len)
@@ -19,7 +39,7 @@ static esp_err_t _oled_write_cmd(uint8_t *cmd, size_t len)
         {.write_buffer = cmd, .buffer_size = len},
     };
 
-    esp_err_t err = i2c_master_multi_buffer_transmit(oled_handle, buffers, 2, portMAX_DELAY);
+    esp_err_t err = oled_i2c_transmit(buffers, 2);
 
     if (err != ESP_OK)
     {
@@ -28,49 +48,39 @@ static esp_err_t _oled_write_cmd(uint8_t *cmd, size_t len)
     return err;
 }
 
-static esp_err_t _oled_write_page(uint8_t *data128)
+// 脏区记录
+static inline void _oled_mark_dirty(uint8_t page, uint8_t x0, uint8_t x1)
 {
-    uint8_t ctrl = OLED_CTRL_DAT;
-
-    i2c_master_transmit_multi_buffer_info_t buffers[2] = {
-        {.write_buffer = &ctrl, .buffer_size = 1},
-        {.write_buffer = data128, .buffer_size = 128},
-    };
-
-    esp_err_t err = i2c_master_multi_buffer_transmit(oled_handle, buffers, 2, portMAX_DELAY);
+    if (x0 < dirty_x0[page])
+        dirty_x0[page] = x0;
+    if (x1 > dirty_x1[page])
+        dirty_x1[page] = x1;
+}
 
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Write page failed: %s", esp_err_to_name(err));
-    }
-    return err;
+static inline void _oled_mark_clean(uint8_t page)
+{
+    dirty_x0[page] = OLED_WIDTH; // x0 > x1
+    dirty_x1[page] = 0;
 }
 
 // 基础功能
 esp_err_t oled_initialization(void)
 {
-    if (g_i2c_service_installed == false)
+    ESP_ERROR_CHECK(i2c_bus_init());
+    ESP_ERROR_CHECK(i2c_bus_add_device(I2C_BUS_DEVICE_OLED, OLED_I2C_ADDRESS, OLED_I2C_FREQ_HZ, I2C_BUS_PRIORITY_LOW));
+    ESP_LOGI(TAG, "oled device created");
+
+    oled_mutex = xSemaphoreCreateRecursiveMutex();
+    if (oled_mutex == NULL)
     {
-        // 初始化I2C
-        i2c_master_bus_config_t i2c_mst_config = {
-            .clk_source = I2C_CLK_SRC_DEFAULT,
-            .i2c_port = I2C_MASTER_NUM,
-            .scl_io_num = I2C_MASTER_SCL_IO,
-            .sda_io_num = I2C_MASTER_SDA_IO,
-            .glitch_ignore_cnt = 7,
-            .flags.enable_internal_pullup = true,
-        };
-        ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, &bus_handle));
-        g_i2c_service_installed = true;
+        ESP_LOGE(TAG, "Failed to create oled mutex");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(oled_task, "oled_task", OLED_TASK_STACK_SIZE, NULL, OLED_TASK_PRIORITY, &oled_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create oled task");
+        return ESP_ERR_NO_MEM;
     }
-
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = OLED_I2C_ADDRESS,
-        .scl_speed_hz = I2C_MASTER_FREQ_HZ,
-    };
-    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg, &oled_handle));
-    ESP_LOGI(TAG, "oled device created");
     return oled_init();
 }
 
@@ -78,7 +88,7 @@ esp_err_t oled_init(void)
 {
     uint8_t init_cmds[] = {
         0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00,
-        0x40, 0x8D, 0x14, 0x20, 0x02, 0xA1, 0xC8,
+        0x40, 0x8D, 0x14, 0x20, 0x00, 0xA1, 0xC8,
         0xDA, 0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB,
         0x40, 0xA4, 0xA6, 0xAF};
 
@@ -89,7 +99,17 @@ esp_err_t oled_init(void)
         return ret;
     }
 
+    // 上电后屏幕显存内容未知，首帧整屏发送
+    OLED_LOCK();
+    for (uint8_t page = 0; page < OLED_PAGES; page++)
+        _oled_mark_dirty(page, 0, OLED_WIDTH - 1);
+    OLED_UNLOCK();
+
     oled_clear(0);
+#if OLED_BENCHMARK_RUNS > 0
+    oled_benchmark();
+    oled_clear(0);
+#endif
 
     oled_draw_bitmap(0, 2, &c_chSingal816[0], 16, 8, 0);
     oled_draw_bitmap(24, 2, &c_chBluetooth88[0], 8, 8, 0);
@@ -101,31 +121,154 @@ esp_err_t oled_init(void)
     return oled_refresh();
 }
 
+// 请求刷新：只通知显示任务，立即返回；显示任务按帧间隔把期间的多次请求合并成一帧
 esp_err_t oled_refresh(void)
 {
-    esp_err_t ret;
-    uint8_t page_buf[128];
+    if (oled_task_handle == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    OLED_LOCK();
+    refresh_stats.refreshes++;
+    OLED_UNLOCK();
+    xTaskNotifyGive(oled_task_handle);
+    return ESP_OK;
+}
+
+// 翻页：在锁内把所有脏页的外接矩形（页 p0..p1，列 x0..x1）拷到前台缓冲并清除脏区，返回 false 表示画面无改动
+static bool _oled_flip(uint8_t *p0, uint8_t *p1, uint8_t *x0, uint8_t *x1)
+{
+    *p0 = OLED_PAGES;
+    *p1 = 0;
+    *x0 = OLED_WIDTH - 1;
+    *x1 = 0;
+    for (uint8_t page = 0; page < OLED_PAGES; page++)
+    {
+        if (dirty_x0[page] > dirty_x1[page])
+            continue;
+        if (*p0 == OLED_PAGES)
+            *p0 = page;
+        *p1 = page;
+        if (dirty_x0[page] < *x0)
+            *x0 = dirty_x0[page];
+        if (dirty_x1[page] > *x1)
+            *x1 = dirty_x1[page];
+    }
+    if (*p0 == OLED_PAGES)
+        return false;
 
-    for (uint8_t page = 0; page < 8; page++)
+    for (uint8_t page = *p0; page <= *p1; page++)
     {
-        uint8_t cmd[3] = {0xB0 | page, 0x00, 0x10};
-        ret = _oled_write_cmd(cmd, 3);
-        if (ret != ESP_OK)
-            return ret;
+        memcpy(&oled_front[page][*x0], &oled_buffer[page][*x0], *x1 - *x0 + 1);
+        _oled_mark_clean(page);
+    }
+    return true;
+}
+
+// 发送前台缓冲中页 p0..p1、列 x0..x1 的窗口
+static esp_err_t _oled_send_window(uint8_t p0, uint8_t p1, uint8_t x0, uint8_t x1, uint32_t *bytes)
+{
+    // 水平寻址模式：设定列/页窗口后数据逐页连续写入窗口；窗口命令与数据在同一个事务中发送，
+    // 数据直接取自前台缓冲，不做拷贝
+    uint8_t header[] = {
+        OLED_CTRL_CMD_SINGLE, 0x21, OLED_CTRL_CMD_SINGLE, x0, OLED_CTRL_CMD_SINGLE, x1,
+        OLED_CTRL_CMD_SINGLE, 0x22, OLED_CTRL_CMD_SINGLE, p0, OLED_CTRL_CMD_SINGLE, p1,
+        OLED_CTRL_DAT};
+    i2c_master_transmit_multi_buffer_info_t buffers[1 + OLED_PAGES];
+    uint8_t count = 0;
+    uint8_t width = x1 - x0 + 1;
+    buffers[count++] = (i2c_master_transmit_multi_buffer_info_t){.write_buffer = header, .buffer_size = sizeof(header)};
+    if (width == OLED_WIDTH)
+    {
+        // 整行宽度时各页在显存中首尾相连，一个缓冲区即可
+        buffers[count++] = (i2c_master_transmit_multi_buffer_info_t){.write_buffer = oled_front[p0], .buffer_size = (p1 - p0 + 1) * OLED_WIDTH};
+    }
+    else
+    {
+        for (uint8_t page = p0; page <= p1; page++)
+            buffers[count++] = (i2c_master_transmit_multi_buffer_info_t){.write_buffer = &oled_front[page][x0], .buffer_size = width};
+    }
+
+    *bytes = sizeof(header) + (p1 - p0 + 1) * width;
+    return oled_i2c_transmit(buffers, count);
+}
+
+// 显示任务：唯一访问屏幕显存的任务，两帧之间至少间隔 OLED_FRAME_INTERVAL_MS
+void oled_task(void *pvParameters)
+{
+    int64_t last_frame = 0;
+
+    while (1)
+    {
+        // 刷新请求只用通知槽 0，I2C 传输完成走 i2c_bus 保留的 I2C_BUS_NOTIFY_INDEX 槽，两者互不干扰
+        uint32_t requests = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        int64_t wait_us = last_frame + (int64_t)OLED_FRAME_INTERVAL_MS * 1000 - esp_timer_get_time();
+        if (wait_us > 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS((wait_us + 999) / 1000));
+            requests += ulTaskNotifyTake(pdTRUE, 0); // 等待期间到达的请求并入本帧
+        }
 
-        for (uint8_t col = 0; col < 128; col++)
-            page_buf[col] = oled_buffer[col][page];
+        uint8_t p0, p1, x0, x1;
+        OLED_LOCK();
+        refresh_stats.coalesced += requests - 1;
+        bool dirty = _oled_flip(&p0, &p1, &x0, &x1);
+        if (!dirty)
+        {
+            refresh_stats.lastBytes = 0;
+            refresh_stats.cleanRefreshes++;
+        }
+        OLED_UNLOCK();
+        if (!dirty)
+            continue;
 
-        ret = _oled_write_page(page_buf);
+        uint32_t bytes = 0;
+        esp_err_t ret = _oled_send_window(p0, p1, x0, x1, &bytes);
+        last_frame = esp_timer_get_time();
+
+        OLED_LOCK();
+        if (ret != ESP_OK)
+        {
+            // 窗口重新记为脏区，下次刷新重发
+            for (uint8_t page = p0; page <= p1; page++)
+                _oled_mark_dirty(page, x0, x1);
+            refresh_stats.lastBytes = 0;
+        }
+        else
+        {
+            refresh_stats.frames++;
+            refresh_stats.lastBytes = bytes;
+            refresh_stats.totalBytes += bytes;
+        }
+        OLED_UNLOCK();
         if (ret != ESP_OK)
-            return ret;
+            ESP_LOGE(TAG, "Refresh failed: %s", esp_err_to_name(ret));
     }
-    return ESP_OK;
 }
 
 void oled_clear(uint8_t color)
 {
-    memset(oled_buffer, color ? 0xFF : 0x00, sizeof(oled_buffer));
+    uint8_t fill = color ? 0xFF : 0x00;
+    OLED_LOCK();
+    for (uint8_t page = 0; page < OLED_PAGES; page++)
+    {
+        for (uint8_t x = 0; x < OLED_WIDTH; x++)
+        {
+            if (oled_buffer[page][x] != fill)
+            {
+                oled_buffer[page][x] = fill;
+                _oled_mark_dirty(page, x, x);
+            }
+        }
+    }
+    OLED_UNLOCK();
+}
+
+void oled_get_refresh_stats(struct oled_refresh_stats *out)
+{
+    OLED_LOCK();
+    *out = refresh_stats;
+    OLED_UNLOCK();
 }
 
 esp_err_t oled_set_contrast(uint8_t contrast)
@@ -140,17 +283,121 @@ esp_err_t oled_invert(bool invert)
     return _oled_write_cmd(&cmd, 1);
 }
 
-// 绘图操作
-void oled_draw_point(uint8_t x, uint8_t y, uint8_t color)
+// 绘图操作，调用方持有锁
+static void _oled_draw_point(uint8_t x, uint8_t y, uint8_t color)
 {
     if (x >= OLED_WIDTH || y >= OLED_HEIGHT)
         return;
     uint8_t page = y >> 3;
     uint8_t bit = y & 0x07;
-    if (color)
-        oled_buffer[x][page] |= (1 << bit);
+    uint8_t old = oled_buffer[page][x];
+    uint8_t val = color ? (old | (1 << bit)) : (old & ~(1 << bit));
+    if (val == old)
+        return; // 重画相同内容不产生脏区
+    oled_buffer[page][x] = val;
+    _oled_mark_dirty(page, x, x);
+}
+
+void oled_draw_point(uint8_t x, uint8_t y, uint8_t color)
+{
+    OLED_LOCK();
+    _oled_draw_point(x, y, color);
+    OLED_UNLOCK();
+}
+
+// 位图块传输：源数据按页优先排列（每块 8 行，块内每列一个字节，低位在上），块间距为 stride 字节。
+// 裁剪在入口一次完成；目标 y 按页对齐时整字节写入，不对齐时每列拆成上下两页各一次移位写（先清掩码位再或入）
+static void _oled_write_span(uint8_t page, uint8_t x, const uint8_t *src, uint8_t cols, uint8_t lsh, uint8_t rsh, uint8_t invert)
+{
+    uint8_t *dst = &oled_buffer[page][x];
+    uint8_t mask = (uint8_t)(0xFF << lsh) >> rsh;
+    uint8_t first = cols, last = 0;
+
+    if (mask == 0xFF)
+    {
+        for (uint8_t i = 0; i < cols; i++)
+        {
+            uint8_t val = src[i] ^ invert;
+            if (dst[i] == val)
+                continue;
+            dst[i] = val;
+            if (first == cols)
+                first = i;
+            last = i;
+        }
+    }
     else
-        oled_buffer[x][page] &= ~(1 << bit);
+    {
+        for (uint8_t i = 0; i < cols; i++)
+        {
+            uint8_t bits = (uint8_t)((src[i] ^ invert) << lsh) >> rsh;
+            uint8_t val = (dst[i] & ~mask) | bits;
+            if (dst[i] == val)
+                continue;
+            dst[i] = val;
+            if (first == cols)
+                first = i;
+            last = i;
+        }
+    }
+
+    // 只把实际变化的列记为脏区
+    if (first < cols)
+        _oled_mark_dirty(page, x + first, x + last);
+}
+
+static void _oled_blit(uint8_t x, uint8_t y, const uint8_t *src, uint8_t w, uint8_t blocks, uint16_t stride, uint8_t color)
+{
+    if (x >= OLED_WIDTH || y >= OLED_HEIGHT)
+        return;
+    uint8_t cols = (w < OLED_WIDTH - x) ? w : OLED_WIDTH - x;
+    uint8_t shift = y & 0x07;
+    uint8_t invert = color ? 0xFF : 0x00;
+
+    for (uint8_t block = 0; block < blocks; block++)
+    {
+        uint8_t page = (y >> 3) + block;
+        if (page >= OLED_PAGES)
+            break;
+        const uint8_t *row = src + block * stride;
+        _oled_write_span(page, x, row, cols, shift, 0, invert);
+        if (shift && page + 1 < OLED_PAGES)
+            _oled_write_span(page + 1, x, row, cols, 0, 8 - shift, invert);
+    }
+}
+
+// ASCII 字模，按页优先排列，每页 width 字节
+static bool _oled_font_glyph(char chr, uint8_t size, const uint8_t **font, uint8_t *width, uint8_t *height)
+{
+    if (chr < ' ' || chr > '~')
+        return false;
+
+    switch (size)
+    {
+    case 12:
+        *font = c_chFont1206[chr - ' '];
+        *width = 6;
+        *height = 12;
+        break;
+    case 16:
+        *font = c_chFont1608[chr - ' '];
+        *width = 8;
+        *height = 16;
+        break;
+    case 24:
+        *font = c_chFont1612[chr - ' '];
+        *width = 12;
+        *height = 16;
+        break;
+    case 32:
+        *font = c_chFont3216[chr - ' '];
+        *width = 16;
+        *height = 32;
+        break;
+    default:
+        return false;
+    }
+    return true;
 }
 
 void oled_draw_line(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t color)
@@ -161,9 +408,10 @@ void oled_draw_line(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t colo
     int16_t sy = (y1 < y2) ? 1 : -1;
     int16_t err = dx - dy;
 
+    OLED_LOCK();
     while (1)
     {
-        oled_draw_point(x1, y1, color);
+        _oled_draw_point(x1, y1, color);
         if (x1 == x2 && y1 == y2)
             break;
         int16_t e2 = err << 1;
@@ -180,78 +428,39 @@ void oled_draw_line(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t colo
         if (x1 >= OLED_WIDTH || y1 >= OLED_HEIGHT || x1 < 0 || y1 < 0)
             break;
     }
+    OLED_UNLOCK();
 }
 
 void oled_draw_rect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
 {
+    OLED_LOCK();
     oled_draw_line(x1, y1, x2, y1, color);
     oled_draw_line(x1, y2, x2, y2, color);
     oled_draw_line(x1, y1, x1, y2, color);
     oled_draw_line(x2, y1, x2, y2, color);
+    OLED_UNLOCK();
 }
 
 void oled_fill_rect(uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2, uint8_t color)
 {
+    OLED_LOCK();
     for (uint8_t y = y1; y <= y2; y++)
         for (uint8_t x = x1; x <= x2; x++)
-            oled_draw_point(x, y, color);
+            _oled_draw_point(x, y, color);
+    OLED_UNLOCK();
 }
 
 // 字符显示
 void oled_show_char(uint8_t x, uint8_t y, char chr, uint8_t size, uint8_t color)
 {
-    if (x >= OLED_WIDTH || y >= OLED_HEIGHT)
-        return;
-    if (chr < ' ' || chr > '~')
-        return;
-
     const uint8_t *font = NULL;
     uint8_t width = 0, height = 0;
-
-    switch (size)
-    {
-    case 12:
-        font = c_chFont1206[chr - ' '];
-        width = 6;
-        height = 12;
-        break;
-    case 16:
-        font = c_chFont1608[chr - ' '];
-        width = 8;
-        height = 16;
-        break;
-    case 24:
-        font = c_chFont1612[chr - ' '];
-        width = 12;
-        height = 16;
-        break;
-    case 32:
-        font = c_chFont3216[chr - ' '];
-        width = 16;
-        height = 32;
-        break;
-    default:
+    if (!_oled_font_glyph(chr, size, &font, &width, &height))
         return;
-    }
 
-    uint8_t pages = (height + 7) / 8;
-    for (uint8_t i = 0; i < width; i++)
-    {
-        for (uint8_t p = 0; p < pages; p++)
-        {
-            uint8_t data = font[p * width + i];
-            for (uint8_t bit = 0; bit < 8; bit++)
-            {
-                uint8_t py = y + p * 8 + bit;
-                if (py >= OLED_HEIGHT)
-                    break;
-                uint8_t pixel = (data & (1 << bit)) ? 1 : 0;
-                if (color)
-                    pixel = !pixel;
-                oled_draw_point(x + i, py, pixel);
-            }
-        }
-    }
+    OLED_LOCK();
+    _oled_blit(x, y, font, width, (height + 7) / 8, width, color);
+    OLED_UNLOCK();
 }
 
 void oled_show_string(uint8_t x, uint8_t y, const char *str, uint8_t size, uint8_t color)
@@ -264,6 +473,7 @@ void oled_show_string(uint8_t x, uint8_t y, const char *str, uint8_t size, uint8
                                         : (size == 24)   ? 12
                                                          : 16;
 
+    OLED_LOCK(); // 整串在同一帧内出现
     while (*str)
     {
         if (cx + char_width > OLED_WIDTH)
@@ -276,6 +486,7 @@ void oled_show_string(uint8_t x, uint8_t y, const char *str, uint8_t size, uint8
         oled_show_char(cx, y, *str++, size, color);
         cx += char_width;
     }
+    OLED_UNLOCK();
 }
 
 // 数字与浮点数显示
@@ -335,13 +546,28 @@ void oled_draw_bitmap(uint8_t x, uint8_t y, const uint8_t *bmp, uint8_t w, uint8
 {
     if (!bmp)
         return;
-    uint8_t blockCnt = (h + 7) / 8;
-    for (uint8_t block = 0; block < blockCnt; block++)
+    OLED_LOCK();
+    _oled_blit(x, y, bmp, w, (h + 7) / 8, w, color);
+    OLED_UNLOCK();
+}
+
+void oled_show_chinese(uint8_t x, uint8_t y, uint8_t no, uint8_t color)
+{
+    // 每个汉字占 Hzk 的两行，上半块在前，每行只用前 16 字节
+    OLED_LOCK();
+    _oled_blit(x, y, Hzk[no * 2], 16, 2, sizeof(Hzk[0]), color);
+    OLED_UNLOCK();
+}
+
+#if OLED_BENCHMARK_RUNS > 0
+// 基准对照：逐像素调用 oled_draw_point 的原实现
+static void _oled_blit_pixels(uint8_t x, uint8_t y, const uint8_t *src, uint8_t w, uint8_t blocks, uint16_t stride, uint8_t color)
+{
+    for (uint8_t block = 0; block < blocks; block++)
     {
         for (uint8_t col = 0; col < w; col++)
         {
-            uint16_t idx = block * w + col;
-            uint8_t data = bmp[idx];
+            uint8_t data = src[block * stride + col];
             for (uint8_t bit = 0; bit < 8; bit++)
             {
                 uint8_t py = y + block * 8 + bit;
@@ -356,27 +582,70 @@ void oled_draw_bitmap(uint8_t x, uint8_t y, const uint8_t *bmp, uint8_t w, uint8
     }
 }
 
-void oled_show_chinese(uint8_t x, uint8_t y, uint8_t no, uint8_t color)
+typedef void (*oled_blit_fn)(uint8_t x, uint8_t y, const uint8_t *src, uint8_t w, uint8_t blocks, uint16_t stride, uint8_t color);
+
+// 每个字形画 OLED_BENCHMARK_RUNS 遍（正反色交替，保证每次都有像素变化），返回每字形平均耗时（ns）
+static uint32_t _oled_bench_glyphs(oled_blit_fn blit, uint8_t size, uint8_t y)
 {
-    if (x >= OLED_WIDTH || y >= OLED_HEIGHT)
-        return;
-    const uint8_t *hz_up = Hzk[no * 2];
-    const uint8_t *hz_down = Hzk[no * 2 + 1];
+    const uint8_t *font = NULL;
+    uint8_t width = 0, height = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t run = 0; run < OLED_BENCHMARK_RUNS; run++)
+    {
+        for (char chr = ' '; chr <= '~'; chr++)
+        {
+            _oled_font_glyph(chr, size, &font, &width, &height);
+            blit(0, y, font, width, (height + 7) / 8, width, run & 1);
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    return (uint32_t)(elapsed * 1000 / (OLED_BENCHMARK_RUNS * ('~' - ' ' + 1)));
+}
 
-    for (uint8_t block = 0; block < 2; block++)
+// 整屏文字：逐行铺满字符，y 为首行位置，返回每屏平均耗时（us）
+static uint32_t _oled_bench_screen(oled_blit_fn blit, uint8_t size, uint8_t y)
+{
+    const uint8_t *font = NULL;
+    uint8_t width = 0, height = 0;
+    _oled_font_glyph(' ', size, &font, &width, &height);
+    int64_t start = esp_timer_get_time();
+    for (uint32_t run = 0; run < OLED_BENCHMARK_RUNS; run++)
     {
-        const uint8_t *dataPtr = (block == 0) ? hz_up : hz_down;
-        for (uint8_t col = 0; col < 16; col++)
+        char chr = ' ' + (run % 64);
+        for (uint8_t py = y; py + height <= OLED_HEIGHT; py += height)
         {
-            uint8_t data = dataPtr[col];
-            for (uint8_t bit = 0; bit < 8; bit++)
+            for (uint8_t px = 0; px + width <= OLED_WIDTH; px += width)
             {
-                uint8_t py = y + block * 8 + bit;
-                uint8_t pixel = (data & (1 << bit)) ? 1 : 0;
-                if (color)
-                    pixel = !pixel;
-                oled_draw_point(x + col, py, pixel);
+                _oled_font_glyph(chr, size, &font, &width, &height);
+                blit(px, py, font, width, (height + 7) / 8, width, run & 1);
+                chr = (chr == '~') ? ' ' : chr + 1;
             }
         }
     }
-}
\ No newline at end of file
+    int64_t elapsed = esp_timer_get_time() - start;
+    return (uint32_t)(elapsed / OLED_BENCHMARK_RUNS);
+}
+
+void oled_benchmark(void)
+{
+    static const uint8_t sizes[] = {12, 16, 24, 32};
+    for (uint8_t i = 0; i < sizeof(sizes); i++)
+    {
+        for (uint8_t y = 0; y < 8; y += 3) // y=0、3、6：对齐与两种不对齐
+        {
+            uint32_t pixel_ns = _oled_bench_glyphs(_oled_blit_pixels, sizes[i], y);
+            uint32_t blit_ns = _oled_bench_glyphs(_oled_blit, sizes[i], y);
+            ESP_LOGI(TAG, "Benchmark glyph size %u y=%u: per-pixel %lu ns, blit %lu ns",
+                     sizes[i], y, (unsigned long)pixel_ns, (unsigned long)blit_ns);
+        }
+    }
+
+    // 16 号字 4 行 x 16 列（页对齐），12 号字 5 行 x 21 列（行起点多数不对齐）
+    uint32_t pixel_us = _oled_bench_screen(_oled_blit_pixels, 16, 0);
+    uint32_t blit_us = _oled_bench_screen(_oled_blit, 16, 0);
+    ESP_LOGI(TAG, "Benchmark full screen size 16: per-pixel %lu us, blit %lu us", (unsigned long)pixel_us, (unsigned long)blit_us);
+    pixel_us = _oled_bench_screen(_oled_blit_pixels, 12, 0);
+    blit_us = _oled_bench_screen(_oled_blit, 12, 0);
+    ESP_LOGI(TAG, "Benchmark full screen size 12: per-pixel %lu us, blit %lu us", (unsigned long)pixel_us, (unsigned long)blit_us);
+}
+#endif
@@ -8,25 +8,40 @@
 #include <freertos/semphr.h>
 #include <freertos/task.h>
 #include "app_config.h"
+#include "i2c_bus.h"
 
 // OLED 控制字节
 #define OLED_CTRL_CMD 0x00
 #define OLED_CTRL_DAT 0x40
+#define OLED_CTRL_CMD_SINGLE 0x80 // Co=1：后面只跟一个命令字节，可与数据在同一事务中混发
 
 // OLED 分辨率
 #define OLED_WIDTH 128
 #define OLED_HEIGHT 64
-
-extern i2c_master_dev_handle_t oled_handle;
-extern bool g_i2c_service_installed; // 是否安装了I2C服务
-extern i2c_master_bus_handle_t bus_handle;
+#define OLED_PAGES (OLED_HEIGHT / 8)
+
+#define OLED_TASK_PRIORITY 5 // 低于 NFC、指纹与蜂鸣器任务，显示刷新不抢占开锁流程
+#define OLED_TASK_STACK_SIZE 3072
+
+// 刷新统计，只有改动过的列范围才会发送
+struct oled_refresh_stats
+{
+    uint32_t refreshes;      // oled_refresh 调用次数
+    uint32_t frames;         // 显示任务实际发送的帧数
+    uint32_t coalesced;      // 与其他请求合并进同一帧的刷新请求数
+    uint32_t cleanRefreshes; // 画面无改动、没有总线传输的刷新次数
+    uint32_t lastBytes;      // 上次刷新发送的字节数（含控制字节与地址命令）
+    uint64_t totalBytes;     // 累计发送的字节数
+};
 
 esp_err_t oled_initialization(void);
 esp_err_t oled_init(void);
 esp_err_t oled_refresh(void);
+void oled_task(void *pvParameters);
 void oled_clear(uint8_t color);
 esp_err_t oled_set_contrast(uint8_t contrast);
 esp_err_t oled_invert(bool invert);
+void oled_get_refresh_stats(struct oled_refresh_stats *out);
 
 void oled_draw_point(uint8_t x, uint8_t y, uint8_t color);
 void oled_draw_line(int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint8_t color);
@@ -39,5 +54,8 @@ void oled_show_num(uint8_t x, uint8_t y, int32_t num, uint8_t len, uint8_t size,
 void oled_show_float(uint8_t x, uint8_t y, float num, uint8_t int_len, uint8_t dec_len, uint8_t size, uint8_t color);
 void oled_draw_bitmap(uint8_t x, uint8_t y, const uint8_t *bmp, uint8_t w, uint8_t h, uint8_t color);
 void oled_show_chinese(uint8_t x, uint8_t y, uint8_t no, uint8_t color);
+#if OLED_BENCHMARK_RUNS > 0
+void oled_benchmark(void);
+#endif
 
 #endif /* OLED_H_ */
\ No newline at end of file
@@ -0,0 +1,863 @@
+#include "card_store.h"
+
+static const char *TAG = "card_store";
+
+/*
+ * Flash: the cards live in their own NVS partition. The snapshot is split into chunks of CARD_STORE_CHUNK_SLOTS
+ * slots, each chunk one blob ("c<n>") of struct card_uid, a free slot has length 0. Adding or removing a card only
+ * appends a small journal record ("j<n>"); once CARD_JOURNAL_MAX records are written the changed chunks are rewritten
+ * and the records erased (compaction). Boot loads the snapshot and replays the records left in the journal.
+ * Every write is a single NVS entry, so a power loss leaves either the old or the new content of the record or chunk;
+ * replaying a record is idempotent, and records are erased oldest first so a cut compaction leaves a replayable tail.
+ * RAM: one sorted index per UID length, its UIDs packed back to back, so a 4-byte card costs 4 bytes and a tap is a
+ * binary search over the cards of its own length. A bitmap tracks the slots in use.
+ */
+struct card_index
+{
+    uint8_t *uids;     // UIDs of this length, ascending, packed
+    uint16_t *slots;   // Flash slot of each UID, same order as uids
+    uint32_t count;    // Number of UIDs
+    uint32_t capacity; // UIDs allocated in uids/slots
+};
+
+// Journal record as written to flash
+struct card_journal_record
+{
+    uint8_t op;          // CARD_JOURNAL_ADD or CARD_JOURNAL_REMOVE
+    struct card_uid uid; // Card UID
+};
+
+// Change not yet in the snapshot, applied to its chunk by the next compaction
+struct card_journal_entry
+{
+    uint8_t op;          // CARD_JOURNAL_ADD or CARD_JOURNAL_REMOVE
+    uint16_t slot;       // Slot the card was stored in or removed from
+    struct card_uid uid; // Card UID
+};
+
+static struct card_index card_indexes[CARD_UID_MAX_LEN + 1] = {0}; // Indexes by UID length, [0] unused
+static uint32_t card_count = 0;                                   // Number of stored cards, all lengths
+static uint32_t slot_used[(CARD_STORE_CHUNKS * CARD_STORE_CHUNK_SLOTS + 31) / 32] = {0}; // Bitmap of used slots
+static uint16_t chunk_count = 0;                                  // Chunks written to flash so far, "c0" to "c<chunk_count - 1>"
+static struct card_journal_entry journal[CARD_JOURNAL_MAX];       // Changes since the last compaction
+static uint8_t journal_count = 0;                                 // Entries in journal
+static uint8_t journal_first = 0;                                 // Oldest record key in flash, "j<journal_first>"
+static uint8_t journal_next = 0;                                  // Key of the next record, "j<journal_next>"
+static SemaphoreHandle_t card_lock = NULL;                        // Taps, web server commands and the loader share the index
+static uint8_t sort_len = 0;                                      // UID length of the index being sorted by card_store_init
+
+/**
+ * @brief Order of UIDs: by length, then bytewise
+ * @return int <0 = a first, 0 = same UID, >0 = b first
+ */
+int card_uid_compare(const struct card_uid *a, const struct card_uid *b)
+{
+    if (a->len != b->len)
+    {
+        return a->len - b->len;
+    }
+    return memcmp(a->bytes, b->bytes, a->len);
+}
+
+/**
+ * @brief Format a UID as an uppercase hex string, first byte first
+ * @param uid UID
+ * @param hex Output, at least CARD_UID_HEX_LEN bytes
+ * @return void
+ */
+void card_uid_to_hex(const struct card_uid *uid, char *hex)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    uint8_t len = uid->len > CARD_UID_MAX_LEN ? CARD_UID_MAX_LEN : uid->len;
+    for (uint8_t i = 0; i < len; i++)
+    {
+        hex[i * 2] = digits[uid->bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[uid->bytes[i] & 0x0F];
+    }
+    hex[len * 2] = '\0';
+}
+
+static int card_hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Parse a UID written as a hex string (as produced by card_uid_to_hex)
+ * @param hex String, parsing stops at the first non-hex character
+ * @param uid Output, UID
+ * @param end Output, first character after the UID, may be NULL
+ * @return true = valid UID (even number of digits, 1 to CARD_UID_MAX_LEN bytes), false = invalid
+ */
+bool card_uid_from_hex(const char *hex, struct card_uid *uid, char **end)
+{
+    memset(uid, 0, sizeof(*uid));
+    size_t digits = 0;
+    bool valid = true;
+    for (; card_hex_digit(hex[digits]) >= 0; digits++)
+    {
+        if (digits >= CARD_UID_MAX_LEN * 2)
+        {
+            valid = false;
+            continue;
+        }
+        uid->bytes[digits / 2] = (uid->bytes[digits / 2] << 4) | card_hex_digit(hex[digits]);
+    }
+    if (end != NULL)
+    {
+        *end = (char *)hex + digits;
+    }
+    uid->len = digits / 2;
+    return valid && digits > 0 && digits % 2 == 0;
+}
+
+/**
+ * @brief Convert a card ID stored before UIDs had a length (4-byte NFCID1, first byte most significant)
+ * @param value Card ID
+ * @param uid Output, UID
+ * @return void
+ */
+void card_uid_from_u64(uint64_t value, struct card_uid *uid)
+{
+    memset(uid, 0, sizeof(*uid));
+    uid->len = 4;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        uid->bytes[i] = value >> (24 - 8 * i);
+    }
+}
+
+static bool card_uid_valid(const struct card_uid *uid)
+{
+    return uid->len > 0 && uid->len <= CARD_UID_MAX_LEN;
+}
+
+/**
+ * @brief Binary search in the index of the UID's length
+ * @param index Index of uid->len
+ * @param uid UID
+ * @return Position of the UID, or of the first larger UID (where it would be inserted)
+ */
+static uint32_t card_store_lower_bound(const struct card_index *index, const struct card_uid *uid)
+{
+    uint32_t low = 0;
+    uint32_t high = index->count;
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (memcmp(index->uids + mid * uid->len, uid->bytes, uid->len) < 0)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static bool card_store_match(const struct card_index *index, uint32_t position, const struct card_uid *uid)
+{
+    return position < index->count && memcmp(index->uids + position * uid->len, uid->bytes, uid->len) == 0;
+}
+
+/**
+ * @brief Grow an index so it holds at least count UIDs
+ * @param index Index
+ * @param len UID length of the index
+ * @param count UIDs needed
+ * @return esp_err_t ESP_OK = enough room, ESP_ERR_NO_MEM = allocation failed
+ */
+static esp_err_t card_store_reserve(struct card_index *index, uint8_t len, uint32_t count)
+{
+    if (count <= index->capacity)
+    {
+        return ESP_OK;
+    }
+    uint32_t capacity = index->capacity == 0 ? CARD_STORE_INITIAL_CAPACITY : index->capacity;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    if (capacity > CARD_STORE_MAX)
+    {
+        capacity = CARD_STORE_MAX;
+    }
+    uint8_t *uids = realloc(index->uids, capacity * len);
+    if (uids == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    index->uids = uids;
+    uint16_t *slots = realloc(index->slots, capacity * sizeof(uint16_t));
+    if (slots == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    index->slots = slots;
+    index->capacity = capacity;
+    return ESP_OK;
+}
+
+static void card_store_mark_slot(uint16_t slot, bool used)
+{
+    if (used)
+    {
+        slot_used[slot / 32] |= 1UL << (slot % 32);
+    }
+    else
+    {
+        slot_used[slot / 32] &= ~(1UL << (slot % 32));
+    }
+}
+
+/**
+ * @brief Find the first free slot
+ * @param slot Output, free slot number
+ * @return esp_err_t ESP_OK = found, ESP_ERR_NOT_ALLOWED = store full
+ */
+static esp_err_t card_store_free_slot(uint16_t *slot)
+{
+    for (uint16_t word = 0; word < sizeof(slot_used) / sizeof(slot_used[0]); word++)
+    {
+        if (slot_used[word] == UINT32_MAX)
+        {
+            continue;
+        }
+        for (uint8_t bit = 0; bit < 32; bit++)
+        {
+            uint32_t candidate = word * 32 + bit;
+            if (!(slot_used[word] & (1UL << bit)) && candidate < CARD_STORE_MAX)
+            {
+                *slot = candidate;
+                return ESP_OK;
+            }
+        }
+    }
+    return ESP_ERR_NOT_ALLOWED;
+}
+
+/**
+ * @brief Read a chunk from flash, a chunk that was never written reads as all free
+ * @param chunk Chunk number
+ * @param slots Output, CARD_STORE_CHUNK_SLOTS UIDs
+ * @return esp_err_t ESP_OK = read, others = NVS read failed
+ */
+static esp_err_t card_store_read_chunk(uint16_t chunk, struct card_uid *slots)
+{
+    memset(slots, 0, CARD_STORE_CHUNK_SLOTS * sizeof(struct card_uid));
+    if (chunk >= chunk_count)
+    {
+        return ESP_OK;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "c%u", chunk);
+    size_t size = CARD_STORE_CHUNK_SLOTS * sizeof(struct card_uid);
+    esp_err_t ret = nvs_custom_get_blob(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key, slots, &size);
+    if (ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    for (uint16_t i = 0; i < CARD_STORE_CHUNK_SLOTS; i++)
+    {
+        if (slots[i].len > CARD_UID_MAX_LEN)
+        {
+            memset(&slots[i], 0, sizeof(struct card_uid)); // Corrupted slot, reuse it
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Rewrite one chunk of the snapshot: its flash content with the journal entries of its slots applied in order
+ * @param chunk Chunk number
+ * @return esp_err_t ESP_OK = written, others = NVS error
+ */
+static esp_err_t card_store_write_chunk(uint16_t chunk)
+{
+    struct card_uid slots[CARD_STORE_CHUNK_SLOTS];
+    esp_err_t ret = card_store_read_chunk(chunk, slots);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    for (uint8_t i = 0; i < journal_count; i++)
+    {
+        if (journal[i].slot / CARD_STORE_CHUNK_SLOTS != chunk)
+        {
+            continue;
+        }
+        struct card_uid *slot = &slots[journal[i].slot % CARD_STORE_CHUNK_SLOTS];
+        memset(slot, 0, sizeof(struct card_uid));
+        if (journal[i].op == CARD_JOURNAL_ADD)
+        {
+            slot->len = journal[i].uid.len;
+            memcpy(slot->bytes, journal[i].uid.bytes, journal[i].uid.len);
+        }
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "c%u", chunk);
+    return nvs_custom_set_blob(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key, slots, sizeof(slots));
+}
+
+/**
+ * @brief Fold the journal into the snapshot: rewrite the changed chunks, then erase the records oldest first
+ * @return esp_err_t ESP_OK = journal empty, others = NVS error (the journal is kept and replayed at boot)
+ */
+static esp_err_t card_store_compact()
+{
+    uint8_t dirty[(CARD_STORE_CHUNKS + 7) / 8] = {0};
+    uint16_t top = chunk_count;
+    for (uint8_t i = 0; i < journal_count; i++)
+    {
+        uint16_t chunk = journal[i].slot / CARD_STORE_CHUNK_SLOTS;
+        if (dirty[chunk / 8] & (1 << (chunk % 8)))
+        {
+            continue;
+        }
+        dirty[chunk / 8] |= 1 << (chunk % 8);
+        esp_err_t ret = card_store_write_chunk(chunk);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Compaction of chunk %u failed (%s)", chunk, esp_err_to_name(ret));
+            return ret;
+        }
+        top = chunk + 1 > top ? chunk + 1 : top;
+    }
+    if (top > chunk_count)
+    {
+        esp_err_t ret = nvs_custom_set_u16(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, "chunks", top);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        chunk_count = top;
+    }
+    for (; journal_first < journal_next; journal_first++)
+    {
+        char key[8];
+        snprintf(key, sizeof(key), "j%u", journal_first);
+        esp_err_t ret = nvs_custom_erase_key(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key);
+        if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND)
+        {
+            return ret; // Newer records must not be written below the remaining ones, retried by the next compaction
+        }
+    }
+    ESP_LOGI(TAG, "Compacted %u journal entries", journal_count);
+    journal_count = 0;
+    journal_first = 0;
+    journal_next = 0;
+    return ESP_OK;
+}
+
+/**
+ * @brief Remember a change for the next compaction, compacting first when the journal is full
+ * @note At boot the duplicates of a cut compaction and the replayed records can together exceed CARD_JOURNAL_MAX,
+ *       the compaction folds the changes noted so far into the snapshot before the flash records behind them go
+ * @return esp_err_t ESP_OK = noted, others = compaction failed (nothing noted)
+ */
+static esp_err_t card_store_note(uint8_t op, uint16_t slot, const struct card_uid *uid)
+{
+    if (journal_count >= CARD_JOURNAL_MAX)
+    {
+        esp_err_t ret = card_store_compact();
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    journal[journal_count].op = op;
+    journal[journal_count].slot = slot;
+    journal[journal_count].uid = *uid;
+    journal_count++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Append a change to the journal in flash, compacting first when the journal is full
+ * @param op CARD_JOURNAL_ADD or CARD_JOURNAL_REMOVE
+ * @param slot Slot the card is stored in or removed from
+ * @param uid Card UID
+ * @return esp_err_t ESP_OK = record written, others = NVS error
+ */
+static esp_err_t card_store_journal(uint8_t op, uint16_t slot, const struct card_uid *uid)
+{
+    esp_err_t ret = ESP_OK;
+    if (journal_next >= CARD_JOURNAL_MAX || journal_count >= CARD_JOURNAL_MAX)
+    {
+        ret = card_store_compact();
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    struct card_journal_record record = {.op = op};
+    record.uid.len = uid->len;
+    memcpy(record.uid.bytes, uid->bytes, uid->len);
+    char key[8];
+    snprintf(key, sizeof(key), "j%u", journal_next);
+    ret = nvs_custom_set_blob(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key, &record, sizeof(record));
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    journal_next++;
+    return card_store_note(op, slot, uid); // Room was made above, never compacts here
+}
+
+/**
+ * @brief Add a card to the index, journaled or (during replay) only noted for the next compaction
+ * @note card_lock must be held
+ * @param uid Card UID, valid length
+ * @param write true = append a journal record, false = replaying a record already in flash
+ * @return esp_err_t ESP_OK = added, ESP_ERR_INVALID_STATE = already stored, ESP_ERR_NOT_ALLOWED = store full,
+ *         ESP_ERR_NO_MEM = allocation failed, others = NVS write failed
+ */
+static esp_err_t card_store_insert(const struct card_uid *uid, bool write)
+{
+    struct card_index *index = &card_indexes[uid->len];
+    uint32_t position = card_store_lower_bound(index, uid);
+    uint16_t slot = 0;
+    if (card_store_match(index, position, uid))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (card_count >= CARD_STORE_MAX)
+    {
+        return ESP_ERR_NOT_ALLOWED;
+    }
+    esp_err_t ret = card_store_reserve(index, uid->len, index->count + 1);
+    if (ret == ESP_OK)
+    {
+        ret = card_store_free_slot(&slot);
+    }
+    if (ret == ESP_OK && write)
+    {
+        ret = card_store_journal(CARD_JOURNAL_ADD, slot, uid);
+    }
+    else if (ret == ESP_OK)
+    {
+        ret = card_store_note(CARD_JOURNAL_ADD, slot, uid);
+    }
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    uint8_t *at = index->uids + position * uid->len;
+    memmove(at + uid->len, at, (index->count - position) * uid->len);
+    memmove(index->slots + position + 1, index->slots + position, (index->count - position) * sizeof(uint16_t));
+    memcpy(at, uid->bytes, uid->len);
+    index->slots[position] = slot;
+    index->count++;
+    card_count++;
+    card_store_mark_slot(slot, true);
+    return ESP_OK;
+}
+
+/**
+ * @brief Remove a card from the index, journaled or (during replay) only noted for the next compaction
+ * @note card_lock must be held
+ * @param uid Card UID, valid length
+ * @param write true = append a journal record, false = replaying a record already in flash
+ * @return esp_err_t ESP_OK = removed, ESP_ERR_NOT_FOUND = not stored, others = NVS write failed
+ */
+static esp_err_t card_store_erase(const struct card_uid *uid, bool write)
+{
+    struct card_index *index = &card_indexes[uid->len];
+    uint32_t position = card_store_lower_bound(index, uid);
+    if (!card_store_match(index, position, uid))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint16_t slot = index->slots[position];
+    if (write)
+    {
+        esp_err_t ret = card_store_journal(CARD_JOURNAL_REMOVE, slot, uid);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    else
+    {
+        esp_err_t ret = card_store_note(CARD_JOURNAL_REMOVE, slot, uid);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+    uint8_t *at = index->uids + position * uid->len;
+    memmove(at, at + uid->len, (index->count - position - 1) * uid->len);
+    memmove(index->slots + position, index->slots + position + 1, (index->count - position - 1) * sizeof(uint16_t));
+    index->count--;
+    card_count--;
+    card_store_mark_slot(slot, false);
+    return ESP_OK;
+}
+
+/**
+ * @brief Replay the journal records left in flash over the loaded snapshot
+ * @note Records are erased oldest first, so after a cut compaction the remaining ones may start past "j0"
+ * @return esp_err_t ESP_OK = replayed, others = a compaction needed to make room failed (records stay in flash)
+ */
+static esp_err_t card_store_replay()
+{
+    journal_count = 0;
+    journal_first = CARD_JOURNAL_MAX;
+    journal_next = 0;
+    uint8_t replayed = 0;
+    for (uint8_t i = 0; i < CARD_JOURNAL_MAX; i++)
+    {
+        char key[8];
+        snprintf(key, sizeof(key), "j%u", i);
+        if (!nvs_custom_key_exists(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key))
+        {
+            continue;
+        }
+        journal_first = i < journal_first ? i : journal_first;
+        struct card_journal_record record;
+        size_t size = sizeof(record);
+        if (nvs_custom_get_blob(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, key, &record, &size) != ESP_OK ||
+            size != sizeof(record) || !card_uid_valid(&record.uid))
+        {
+            ESP_LOGW(TAG, "Journal record %u unreadable, skipped", i);
+            journal_next = i + 1;
+            continue;
+        }
+        esp_err_t ret = ESP_OK;
+        if (record.op == CARD_JOURNAL_ADD)
+        {
+            ret = card_store_insert(&record.uid, false); // ESP_ERR_INVALID_STATE: the snapshot already has it
+        }
+        else if (record.op == CARD_JOURNAL_REMOVE)
+        {
+            ret = card_store_erase(&record.uid, false); // ESP_ERR_NOT_FOUND: the snapshot already lacks it
+        }
+        // A full store drops the record for good, as adding it at run time would have failed; an allocation failure
+        // stops replay so the record stays in flash for the next boot
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE && ret != ESP_ERR_NOT_FOUND && ret != ESP_ERR_NOT_ALLOWED)
+        {
+            ESP_LOGE(TAG, "Replay stopped at journal record %u (%s)", i, esp_err_to_name(ret));
+            return ret;
+        }
+        journal_next = i + 1; // Only now may a compaction erase this record
+        replayed++;
+    }
+    if (journal_first > journal_next)
+    {
+        journal_first = 0;
+    }
+    if (replayed > 0)
+    {
+        ESP_LOGI(TAG, "Replayed %u journal records", replayed);
+    }
+    return ESP_OK;
+}
+
+static int card_store_compare_packed(const void *a, const void *b)
+{
+    return memcmp(a, b, sort_len);
+}
+
+/**
+ * @brief Move the cards of the former single-blob table ("card" namespace of the default partition) into the store
+ * @return void
+ */
+static void card_store_migrate_legacy()
+{
+    uint8_t count = 0;
+    if (!nvs_custom_key_exists(NULL, "card", "card_ids") || nvs_custom_get_u8(NULL, "card", "count", &count) != ESP_OK)
+    {
+        return;
+    }
+    uint64_t legacy[CARD_STORE_LEGACY_CARDS] = {0};
+    size_t size = sizeof(legacy);
+    if (count > CARD_STORE_LEGACY_CARDS || nvs_custom_get_blob(NULL, "card", "card_ids", legacy, &size) != ESP_OK)
+    {
+        count = 0;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        struct card_uid uid;
+        card_uid_from_u64(legacy[i], &uid);
+        esp_err_t ret = card_store_add(&uid);
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
+        {
+            ESP_LOGE(TAG, "Migration of card 0x%llX failed (%s), keeping the old table", legacy[i], esp_err_to_name(ret));
+            return;
+        }
+    }
+    nvs_custom_erase_key(NULL, "card", "card_ids");
+    nvs_custom_erase_key(NULL, "card", "count");
+    ESP_LOGI(TAG, "Migrated %u cards from the old card table", count);
+}
+
+/**
+ * @brief Open the card partition, build the indexes from the snapshot chunks and replay the journal
+ * @return esp_err_t ESP_OK = loaded (the store may be empty), others = partition or allocation failed
+ */
+esp_err_t card_store_init()
+{
+    if (card_lock == NULL)
+    {
+        card_lock = xSemaphoreCreateMutex();
+    }
+    esp_err_t ret = nvs_custom_init_partition(CARD_STORE_PARTITION);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    card_count = 0;
+    chunk_count = 0;
+    journal_count = 0;
+    memset(slot_used, 0, sizeof(slot_used));
+    uint32_t counts[CARD_UID_MAX_LEN + 1] = {0};
+    for (uint8_t len = 1; len <= CARD_UID_MAX_LEN; len++)
+    {
+        card_indexes[len].count = 0;
+    }
+    uint16_t chunks = 0;
+    if (nvs_custom_key_exists(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, "chunks"))
+    {
+        nvs_custom_get_u16(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE, "chunks", &chunks);
+    }
+    chunks = chunks > CARD_STORE_CHUNKS ? CARD_STORE_CHUNKS : chunks;
+
+    // Read the chunks in slot order, then sort each index and look up the slot of each card
+    uint32_t total = chunks * CARD_STORE_CHUNK_SLOTS;
+    struct card_uid *by_slot = total > 0 ? calloc(total, sizeof(struct card_uid)) : NULL;
+    if (total > 0 && by_slot == NULL)
+    {
+        xSemaphoreGive(card_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    chunk_count = chunks;
+    for (uint16_t chunk = 0; chunk < chunks; chunk++)
+    {
+        struct card_uid *slots = by_slot + chunk * CARD_STORE_CHUNK_SLOTS;
+        if (card_store_read_chunk(chunk, slots) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Chunk %u unreadable, its cards are skipped", chunk);
+            memset(slots, 0, CARD_STORE_CHUNK_SLOTS * sizeof(struct card_uid));
+            for (uint16_t i = 0; i < CARD_STORE_CHUNK_SLOTS; i++)
+            {
+                card_store_mark_slot(chunk * CARD_STORE_CHUNK_SLOTS + i, true); // Never overwrite it with a partly known content
+            }
+            continue;
+        }
+        for (uint16_t i = 0; i < CARD_STORE_CHUNK_SLOTS; i++)
+        {
+            if (slots[i].len != 0)
+            {
+                card_store_mark_slot(chunk * CARD_STORE_CHUNK_SLOTS + i, true);
+                counts[slots[i].len]++;
+            }
+        }
+    }
+    for (uint8_t len = 1; len <= CARD_UID_MAX_LEN && ret == ESP_OK; len++)
+    {
+        ret = card_store_reserve(&card_indexes[len], len, counts[len]);
+    }
+    if (ret == ESP_OK)
+    {
+        for (uint32_t slot = 0; slot < total; slot++)
+        {
+            struct card_index *index = &card_indexes[by_slot[slot].len];
+            if (by_slot[slot].len != 0)
+            {
+                memcpy(index->uids + index->count * by_slot[slot].len, by_slot[slot].bytes, by_slot[slot].len);
+                index->count++;
+            }
+        }
+        for (uint8_t len = 1; len <= CARD_UID_MAX_LEN; len++)
+        {
+            struct card_index *index = &card_indexes[len];
+            if (index->count > 0)
+            {
+                sort_len = len;
+                qsort(index->uids, index->count, len, card_store_compare_packed);
+            }
+            // A card moved to another chunk by a cut compaction can appear twice, keep one copy
+            uint32_t unique = 0;
+            for (uint32_t i = 0; i < index->count; i++)
+            {
+                if (unique == 0 || memcmp(index->uids + (unique - 1) * len, index->uids + i * len, len) != 0)
+                {
+                    memmove(index->uids + unique * len, index->uids + i * len, len);
+                    index->slots[unique++] = CARD_STORE_NO_SLOT;
+                }
+            }
+            index->count = unique;
+            card_count += unique;
+        }
+        for (uint32_t slot = 0; slot < total; slot++)
+        {
+            struct card_index *index = &card_indexes[by_slot[slot].len];
+            if (by_slot[slot].len == 0)
+            {
+                continue;
+            }
+            uint32_t position = card_store_lower_bound(index, &by_slot[slot]);
+            if (index->slots[position] == CARD_STORE_NO_SLOT)
+            {
+                index->slots[position] = slot;
+            }
+            else
+            {
+                card_store_mark_slot(slot, false); // Duplicate, cleared by the next compaction
+                ret = card_store_note(CARD_JOURNAL_REMOVE, slot, &by_slot[slot]);
+                if (ret != ESP_OK)
+                {
+                    break;
+                }
+            }
+        }
+        if (ret == ESP_OK)
+        {
+            ret = card_store_replay();
+        }
+    }
+    free(by_slot);
+    xSemaphoreGive(card_lock);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Card index not loaded (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Loaded %lu cards from %u chunks (4-byte: %lu, 7-byte: %lu, 10-byte: %lu)", card_count, chunks,
+             card_indexes[4].count, card_indexes[7].count, card_indexes[10].count);
+
+    card_store_migrate_legacy();
+    return ESP_OK;
+}
+
+/**
+ * @brief Check whether a card is stored
+ * @param uid Card UID
+ * @return true = stored, false = unknown card
+ */
+bool card_store_contains(const struct card_uid *uid)
+{
+    if (!card_uid_valid(uid))
+    {
+        return false;
+    }
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    const struct card_index *index = &card_indexes[uid->len];
+    bool found = card_store_match(index, card_store_lower_bound(index, uid), uid);
+    xSemaphoreGive(card_lock);
+    return found;
+}
+
+/**
+ * @brief Store a card, a single journal record is written to flash
+ * @param uid Card UID
+ * @return esp_err_t ESP_OK = added, ESP_ERR_INVALID_STATE = already stored, ESP_ERR_NOT_ALLOWED = store full,
+ *         ESP_ERR_NO_MEM = allocation failed, ESP_ERR_INVALID_ARG = bad UID length, others = NVS write failed
+ */
+esp_err_t card_store_add(const struct card_uid *uid)
+{
+    if (!card_uid_valid(uid))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    esp_err_t ret = card_store_insert(uid, true);
+    xSemaphoreGive(card_lock);
+    return ret;
+}
+
+/**
+ * @brief Remove a card, a single journal record is written to flash
+ * @param uid Card UID
+ * @return esp_err_t ESP_OK = removed, ESP_ERR_NOT_FOUND = not stored, others = NVS write failed
+ */
+esp_err_t card_store_remove(const struct card_uid *uid)
+{
+    if (!card_uid_valid(uid))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    esp_err_t ret = card_store_erase(uid, true);
+    xSemaphoreGive(card_lock);
+    return ret;
+}
+
+/**
+ * @brief Remove all cards
+ * @return esp_err_t ESP_OK = cleared, others = NVS erase failed
+ */
+esp_err_t card_store_clear()
+{
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    esp_err_t ret = nvs_custom_erase_all(CARD_STORE_PARTITION, CARD_STORE_NAMESPACE);
+    if (ret == ESP_OK)
+    {
+        for (uint8_t len = 1; len <= CARD_UID_MAX_LEN; len++)
+        {
+            card_indexes[len].count = 0;
+        }
+        card_count = 0;
+        chunk_count = 0;
+        journal_count = 0;
+        journal_first = 0;
+        journal_next = 0;
+        memset(slot_used, 0, sizeof(slot_used));
+    }
+    xSemaphoreGive(card_lock);
+    return ret;
+}
+/**
+ * @brief Get the number of stored cards
+ * @return uint32_t Number of cards
+ */
+uint32_t card_store_count()
+{
+    return card_count;
+}
+
+/**
+ * @brief Get a stored card by position, cards are ordered as by card_uid_compare
+ * @param index Position, 0 to card_store_count() - 1
+ * @param uid Output, card UID
+ * @return true = card returned, false = index out of range (a card was removed meanwhile)
+ */
+bool card_store_get(uint32_t index, struct card_uid *uid)
+{
+    xSemaphoreTake(card_lock, portMAX_DELAY);
+    bool valid = false;
+    for (uint8_t len = 1; len <= CARD_UID_MAX_LEN && !valid; len++)
+    {
+        if (index >= card_indexes[len].count)
+        {
+            index -= card_indexes[len].count;
+            continue;
+        }
+        memset(uid, 0, sizeof(*uid));
+        uid->len = len;
+        memcpy(uid->bytes, card_indexes[len].uids + index * len, len);
+        valid = true;
+    }
+    xSemaphoreGive(card_lock);
+    return valid;
+}
@@ -0,0 +1,42 @@
+#ifndef CARD_STORE_H
+#define CARD_STORE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "nvs_custom.h"
+#include "app_config.h"
+
+#define CARD_UID_MAX_LEN 10                     // Longest UID: triple size NFCID1
+#define CARD_UID_HEX_LEN (CARD_UID_MAX_LEN * 2 + 1) // Buffer size of a UID as a hex string
+#define CARD_STORE_NAMESPACE "cards"                                                          // NVS namespace in CARD_STORE_PARTITION
+#define CARD_STORE_CHUNK_SLOTS 32                                                             // Card slots per flash chunk (one NVS blob)
+#define CARD_STORE_CHUNKS ((CARD_STORE_MAX + CARD_STORE_CHUNK_SLOTS - 1) / CARD_STORE_CHUNK_SLOTS) // Chunks needed for CARD_STORE_MAX cards
+#define CARD_STORE_INITIAL_CAPACITY 64                                                        // Index entries allocated before the first growth
+#define CARD_STORE_LEGACY_CARDS 20                                                            // Size of the former single-blob card table
+#define CARD_STORE_NO_SLOT 0xFFFF                                                             // Slot of an index entry not mapped yet
+#define CARD_JOURNAL_MAX 32                                                                   // Journal records written before a compaction
+#define CARD_JOURNAL_ADD 1                                                                    // Journal record: card added
+#define CARD_JOURNAL_REMOVE 2                                                                 // Journal record: card removed
+
+// Card UID as read from the card: NFC-A NFCID1 (4, 7 or 10 bytes), NFC-B NFCID0 (4 bytes) or NFC-V UID (8 bytes)
+struct card_uid
+{
+    uint8_t len;                     // UID length, 0 = no UID (free flash slot)
+    uint8_t bytes[CARD_UID_MAX_LEN]; // UID, first byte as received; bytes past len are 0
+};
+
+int card_uid_compare(const struct card_uid *a, const struct card_uid *b);
+void card_uid_to_hex(const struct card_uid *uid, char *hex);
+bool card_uid_from_hex(const char *hex, struct card_uid *uid, char **end);
+void card_uid_from_u64(uint64_t value, struct card_uid *uid);
+esp_err_t card_store_init();
+bool card_store_contains(const struct card_uid *uid);
+esp_err_t card_store_add(const struct card_uid *uid);
+esp_err_t card_store_remove(const struct card_uid *uid);
+esp_err_t card_store_clear();
+uint32_t card_store_count();
+bool card_store_get(uint32_t index, struct card_uid *uid);
+
+#endif
@@ -3,17 +3,15 @@
 /* Semaphore used to notify card detection interrupt */
 SemaphoreHandle_t pn7160_semaphore = NULL;
 
-/* I2C handles */
-i2c_master_bus_handle_t bus_handle;    // I2C master bus handle
-i2c_master_dev_handle_t pn7160_handle; // PN7160 I2C device handle
-
 /* Service installation flags */
 bool g_gpio_isr_service_installed = false; // GPIO ISR service installation status
-bool g_i2c_service_installed = false;      // I2C service installation status
 
-/* Card storage */
-uint64_t g_card_id_value[MAX_CARDS] = {0}; // Stored card IDs (uint64 format)
-uint8_t g_card_count = 0;                  // Number of stored cards
+/* Card to fingerprint bindings */
+static struct card_binding card_bindings[CARD_BINDINGS_MAX] = {0}; // Bindings of cards with a two-factor policy or bound fingers
+static uint8_t card_binding_count = 0;                               // Number of bindings
+static SemaphoreHandle_t card_binding_lock = NULL;                   // Taps, web server and fingerprint callbacks share the table
+
+static void card_binding_load();
 
 // uint16_t BytesRead;           // records number of bytes read from PN7160
 // uint8_t pResponseBuffer[512]; // storage for response from PN7160
@@ -22,6 +20,44 @@ TaskHandle_t pn7160_task_handle = NULL;
 
 static const char *TAG = "pn7160";
 
+static struct nci_message nci_ntf; // Message being handled by pn7160_task
+static struct nci_message nci_rsp; // Response (or notification) awaited by the last command
+
+static const uint8_t RF_DISCOVER_PAYLOAD[7] = {0x03, 0x00, 0x01, 0x01, 0x01, 0x06, 0x01}; // RF discover: NFC-A, NFC-B, NFC-V passive poll
+
+/* Targets of the current tap */
+static uint8_t discovered_ids[PN7160_MAX_TARGETS];        // RF discovery IDs listed by RF_DISCOVER_NTF
+static uint8_t discovered_protocols[PN7160_MAX_TARGETS];  // RF protocols listed by RF_DISCOVER_NTF
+static uint8_t discovered_count = 0;                      // Number of listed targets, 0 = single target activated directly
+static uint8_t selected_index = 0;                        // Listed target currently being activated
+static struct card_uid tap_card_uids[PN7160_MAX_TARGETS]; // UIDs of the cards read during this tap
+static uint8_t tap_card_count = 0;                        // Number of cards read during this tap
+static struct recent_card recent_cards[PN7160_RECENT_CARDS]; // Cards seen within CARD_DEBOUNCE_WINDOW_MS and their verdicts
+
+/* RF state machine of pn7160_task */
+static enum pn7160_state nfc_state = PN7160_STATE_IDLE; // Current state
+static int64_t nfc_deadline = 0;                        // Deadline of the awaited response/notification (us), 0 = none
+static uint8_t deactivate_type = NCI_DEACTIVATE_IDLE;   // Type of the deactivation in progress
+static bool deactivate_wait_ntf = false;                // Deactivation completes with a notification (target was active)
+static uint8_t recovery_count = 0;                      // Recovery attempts since the last accepted command
+
+/* Poll modes: active polling while the MCU is awake, low-power card detection while it sleeps */
+static SemaphoreHandle_t pn7160_mode_semaphore = NULL;                     // Given once low-power card detection is running
+static volatile uint8_t poll_mode_requested = PN7160_MODE_ACTIVE;          // Mode wanted by the sleep logic
+static volatile bool low_power_waiting = false;                            // pn7160_enter_low_power() waits for the mode
+static uint8_t poll_mode_applied = PN7160_MODE_ACTIVE;                     // Mode configured in the NFCC
+static uint8_t poll_mode_pending = PN7160_MODE_ACTIVE;                     // Mode of the outstanding core set config
+static int64_t poll_mode_since = 0;                                        // Time the applied mode was entered (us)
+static volatile int64_t int_time = 0;                                      // Time of the last INT edge (us)
+static volatile int64_t resume_time = 0;                                   // Time of the last light sleep wake-up (us)
+static volatile bool resume_pending = false;                               // Wake-to-ready time not measured yet
+static int64_t tap_start_time = 0;                                         // INT edge of the first message of this tap (us)
+static struct pn7160_power_stats power_stats = {0};                        // Poll mode measurements
+static struct pn7160_tap_stats tap_stats = {0};                            // Per-tap processing measurements
+
+static void pn7160_recover();
+static void pn7160_on_deactivated(const struct nci_message *msg);
+
 /**
  * @brief GPIO interrupt service routine for PN7160 INT pin
  *
@@ -32,48 +68,227 @@ static void IRAM_ATTR gpio_isr_handler(void *arg)
     uint32_t gpio_num = (uint32_t)arg;
     if (gpio_num == PN7160_INT_PIN)
     {
+        int_time = esp_timer_get_time();
         xSemaphoreGiveFromISR(pn7160_semaphore, NULL);
     }
 }
 
+#if NFC_SIMULATOR
+/**
+ * @brief Rising edge of the emulated INT line, raised by the emulator task instead of the GPIO interrupt
+ * @return void
+ */
+void pn7160_sim_int_edge()
+{
+    int_time = esp_timer_get_time();
+    xSemaphoreGive(pn7160_semaphore);
+}
+#endif
+
+/* Bring-up sequence, run step by step by pn7160_bringup() */
+static const uint8_t CORE_RESET_RESET_CONFIG[1] = {0x01};                         // Core reset, reset configuration
+static const uint8_t CORE_RESET_KEEP_CONFIG[1] = {0x00};                          // Core reset, keep configuration
+static const uint8_t CORE_INIT_PAYLOAD[2] = {0x00, 0x00};                         // Core init
+static const uint8_t CORE_SET_POWER_MODE_PAYLOAD[1] = {0x01};                     // NCI proprietary power mode, standby enabled
+static const uint8_t CORE_SET_CONFIG_PAYLOAD[5] = {0x01, 0x00, 0x02, 0xFE, 0X01}; // Core set config to enable extended length
+static const uint8_t RF_DISCOVER_MAP_PAYLOAD[16] = {0x05, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x03, 0x01, 0x01, 0x04, 0x01, 0x02, 0x80, 0x01, 0x80}; // RF discover map
+
+// Core set config of each poll mode: discovery period and low-power card detection
+static const uint8_t RF_POLL_CONFIG_PAYLOAD[PN7160_MODE_COUNT][9] = {
+    {0x02, NCI_PARAM_TOTAL_DURATION, 0x02, PN7160_ACTIVE_POLL_PERIOD_MS & 0xFF, PN7160_ACTIVE_POLL_PERIOD_MS >> 8,
+     NCI_PARAM_NXP_EXT, NCI_PARAM_NXP_TAG_DETECTOR_CFG, 0x01, NCI_TAG_DETECTOR_DISABLE},
+    {0x02, NCI_PARAM_TOTAL_DURATION, 0x02, PN7160_LOW_POWER_POLL_PERIOD_MS & 0xFF, PN7160_LOW_POWER_POLL_PERIOD_MS >> 8,
+     NCI_PARAM_NXP_EXT, NCI_PARAM_NXP_TAG_DETECTOR_CFG, 0x01, NCI_TAG_DETECTOR_ENABLE},
+};
+
+// The NFCC stays powered and configured through light sleep, pn7160_task switches its poll mode instead
+static const struct pn7160_init_step pn7160_init_steps[] = {
+    // name, GID, OID, payload, length, notification, timeout (ms), retries, optional
+    {"core reset", NCI_GID_CORE, NCI_OID_CORE_RESET, CORE_RESET_RESET_CONFIG, sizeof(CORE_RESET_RESET_CONFIG), true, PN7160_RESET_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"core init", NCI_GID_CORE, NCI_OID_CORE_INIT, CORE_INIT_PAYLOAD, sizeof(CORE_INIT_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"core set power mode", NCI_GID_PROPRIETARY, NCI_OID_PROP_SET_POWER_MODE, CORE_SET_POWER_MODE_PAYLOAD, sizeof(CORE_SET_POWER_MODE_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"core set config", NCI_GID_CORE, NCI_OID_CORE_SET_CONFIG, CORE_SET_CONFIG_PAYLOAD, sizeof(CORE_SET_CONFIG_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"core reset", NCI_GID_CORE, NCI_OID_CORE_RESET, CORE_RESET_KEEP_CONFIG, sizeof(CORE_RESET_KEEP_CONFIG), true, PN7160_RESET_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"core init", NCI_GID_CORE, NCI_OID_CORE_INIT, CORE_INIT_PAYLOAD, sizeof(CORE_INIT_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"NCI proprietary activation", NCI_GID_PROPRIETARY, NCI_OID_PROP_ACT, NULL, 0, false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"RF discover map", NCI_GID_RF, NCI_OID_RF_DISCOVER_MAP, RF_DISCOVER_MAP_PAYLOAD, sizeof(RF_DISCOVER_MAP_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+    {"RF poll config", NCI_GID_CORE, NCI_OID_CORE_SET_CONFIG, RF_POLL_CONFIG_PAYLOAD[PN7160_MODE_ACTIVE], sizeof(RF_POLL_CONFIG_PAYLOAD[PN7160_MODE_ACTIVE]), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, true},
+    {"RF discover", NCI_GID_RF, NCI_OID_RF_DISCOVER, RF_DISCOVER_PAYLOAD, sizeof(RF_DISCOVER_PAYLOAD), false, PN7160_STEP_TIMEOUT_MS, PN7160_STEP_RETRIES, false},
+};
+
+static struct pn7160_bringup_timing bringup_timing = {0}; // Bring-up and wake-to-ready measurements
+
+/**
+ * @brief Run one bring-up step: send the command, wait for its response and optionally for its notification
+ * @param step Step to run, reissued up to step->retries times after a timeout or rejection
+ * @return esp_err_t ESP_OK = accepted (or rejected but optional), others = last error
+ */
+static esp_err_t pn7160_run_step(const struct pn7160_init_step *step)
+{
+    esp_err_t err = ESP_FAIL;
+    for (uint8_t attempt = 0; attempt <= step->retries; attempt++)
+    {
+        err = nci_transceive(step->gid, step->oid, step->payload, step->len, &nci_rsp, pdMS_TO_TICKS(step->timeoutMs));
+        if (err == ESP_OK && step->notification)
+        {
+            err = nci_wait(NCI_MT_NTF, step->gid, step->oid, &nci_rsp, pdMS_TO_TICKS(step->timeoutMs));
+        }
+        if (err == ESP_OK)
+        {
+            ESP_LOGI(TAG, "pn7160 %s %s: ", step->name, step->notification ? "notification" : "response");
+            ESP_LOG_BUFFER_HEX(TAG, nci_rsp.payload, nci_rsp.len);
+            return ESP_OK;
+        }
+        if (err == ESP_ERR_INVALID_RESPONSE && step->optional)
+        {
+            ESP_LOGI(TAG, "pn7160 %s not needed", step->name); // Rejected because the NFCC is already in the target state
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "pn7160 %s failed (%s), attempt %u of %u", step->name, esp_err_to_name(err), attempt + 1, step->retries + 1);
+    }
+    return err;
+}
+
+/**
+ * @brief Hardware reset the PN7160 and bring it to RF discovery in active poll mode
+ * @return esp_err_t ESP_OK = discovery running, others = a step failed
+ */
+esp_err_t pn7160_bringup()
+{
+    int64_t start = esp_timer_get_time();
+    /* Hardware reset PN7160 */
+    gpio_set_level(PN7160_RST_PIN, 0);
+    vTaskDelay(pdMS_TO_TICKS(10));
+    gpio_set_level(PN7160_RST_PIN, 1);
+    vTaskDelay(pdMS_TO_TICKS(30));
+    ESP_LOGI(TAG, "PN7160 reset completed");
+
+    for (uint8_t i = 0; i < sizeof(pn7160_init_steps) / sizeof(pn7160_init_steps[0]); i++)
+    {
+        esp_err_t err = pn7160_run_step(&pn7160_init_steps[i]);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "pn7160 bring-up failed at %s", pn7160_init_steps[i].name);
+            return err;
+        }
+    }
+
+    bringup_timing.lastBringupMs = (esp_timer_get_time() - start) / 1000;
+    bringup_timing.bringupCount++;
+    ESP_LOGI(TAG, "pn7160 bring-up done in %lu ms", bringup_timing.lastBringupMs);
+    return ESP_OK;
+}
+
+/**
+ * @brief Switch the NFCC to low-power card detection before the MCU enters light sleep
+ * @note pn7160_task switches as soon as no tap is in progress; the INT pin is then armed as a wake-up source, so a card
+ *       brought to the reader wakes the MCU directly. The edge interrupt is masked while asleep, the level wake-up
+ *       would otherwise keep firing it until the message is read.
+ * @return esp_err_t ESP_OK = low-power card detection running, ESP_ERR_TIMEOUT = still active polling (INT still
+ *         wakes the MCU), ESP_ERR_INVALID_STATE = pn7160_task not running
+ */
+esp_err_t pn7160_enter_low_power()
+{
+    if (pn7160_task_handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(pn7160_mode_semaphore, 0); // Drop a signal left over from an earlier timeout
+    poll_mode_requested = PN7160_MODE_LOW_POWER;
+    low_power_waiting = true;
+    xSemaphoreGive(pn7160_semaphore); // Let pn7160_task start the switch
+    esp_err_t ret = xSemaphoreTake(pn7160_mode_semaphore, pdMS_TO_TICKS(PN7160_MODE_SWITCH_TIMEOUT_MS)) == pdTRUE
+                        ? ESP_OK
+                        : ESP_ERR_TIMEOUT;
+    low_power_waiting = false;
+    gpio_intr_disable(PN7160_INT_PIN);
+    gpio_wakeup_enable(PN7160_INT_PIN, GPIO_INTR_HIGH_LEVEL);
+    return ret;
+}
+
+/**
+ * @brief Return to active polling after a light sleep wake-up
+ * @note The NFCC kept running through the sleep: the card that woke the MCU is still queued and is handled first,
+ *       pn7160_task then switches back to active polling and records the wake-to-ready time
+ * @param wake_time esp_timer time of the wake-up (us)
+ * @return esp_err_t ESP_OK = pn7160_task notified, ESP_ERR_INVALID_STATE = pn7160_task not running
+ */
+esp_err_t pn7160_resume(int64_t wake_time)
+{
+    gpio_wakeup_disable(PN7160_INT_PIN);
+    gpio_set_intr_type(PN7160_INT_PIN, GPIO_INTR_POSEDGE);
+    gpio_intr_enable(PN7160_INT_PIN);
+    if (pn7160_task_handle == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    resume_time = wake_time;
+    resume_pending = true;
+    bringup_timing.resumeCount++;
+    poll_mode_requested = PN7160_MODE_ACTIVE;
+    xSemaphoreGive(pn7160_semaphore); // INT may already be high, the task checks the level
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the bring-up measurements
+ * @param out Output, copy of the measurements
+ * @return void
+ */
+void pn7160_get_bringup_timing(struct pn7160_bringup_timing *out)
+{
+    *out = bringup_timing;
+}
+
+/**
+ * @brief Get the poll mode measurements, including the time spent so far in the current mode
+ * @param out Output, copy of the measurements
+ * @return void
+ */
+void pn7160_get_power_stats(struct pn7160_power_stats *out)
+{
+    *out = power_stats;
+    out->modes[out->mode].timeMs += (esp_timer_get_time() - poll_mode_since) / 1000;
+    uint64_t total_ms = 0;
+    uint64_t charge = 0;
+    for (uint8_t i = 0; i < PN7160_MODE_COUNT; i++)
+    {
+        total_ms += out->modes[i].timeMs;
+        charge += (uint64_t)out->modes[i].timeMs * out->modes[i].currentUa;
+    }
+    out->averageCurrentUa = total_ms ? charge / total_ms : out->modes[out->mode].currentUa;
+}
+
+/**
+ * @brief Get the per-tap processing measurements
+ * @param out Output, copy of the measurements
+ * @return void
+ */
+void pn7160_get_tap_stats(struct pn7160_tap_stats *out)
+{
+    *out = tap_stats;
+}
+
 /**
  * @brief Initialize PN7160 module (I2C + GPIO + NVS)
  * @return ESP_OK on success, ESP_FAIL on failure
  */
 esp_err_t pn7160_initialization(void)
 {
-    /* Create binary semaphore */
+    /* Create binary semaphores */
     pn7160_semaphore = xSemaphoreCreateBinary();
-    if (pn7160_semaphore == NULL)
+    pn7160_mode_semaphore = xSemaphoreCreateBinary();
+    if (pn7160_semaphore == NULL || pn7160_mode_semaphore == NULL)
     {
         ESP_LOGE(TAG, "Semaphore creation failed");
         return ESP_FAIL;
     }
+    power_stats.modes[PN7160_MODE_ACTIVE].currentUa = PN7160_ACTIVE_CURRENT_UA;
+    power_stats.modes[PN7160_MODE_LOW_POWER].currentUa = PN7160_LOW_POWER_CURRENT_UA;
 
-    /* Initialize I2C bus if not installed */
-    if (!g_i2c_service_installed)
-    {
-        i2c_master_bus_config_t i2c_cfg = {
-            .clk_source = I2C_CLK_SRC_DEFAULT,
-            .i2c_port = I2C_MASTER_NUM,
-            .scl_io_num = I2C_MASTER_SCL_IO,
-            .sda_io_num = I2C_MASTER_SDA_IO,
-            .glitch_ignore_cnt = 7,
-            .flags.enable_internal_pullup = true,
-        };
-
-        ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_cfg, &bus_handle));
-        g_i2c_service_installed = true;
-        ESP_LOGI(TAG, "I2C bus initialized");
-    }
-
-    /* Add PN7160 device */
-    i2c_device_config_t dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = PN7160_I2C_ADDRESS,
-        .scl_speed_hz = I2C_MASTER_FREQ_HZ,
-    };
-    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle, &dev_cfg, &pn7160_handle));
+    /* Join the shared I2C bus, NFC transactions go ahead of display transfers */
+    ESP_ERROR_CHECK(i2c_bus_init());
+    ESP_ERROR_CHECK(i2c_bus_add_device(I2C_BUS_DEVICE_PN7160, PN7160_I2C_ADDRESS, PN7160_I2C_FREQ_HZ, I2C_BUS_PRIORITY_HIGH));
     ESP_LOGI(TAG, "PN7160 device added");
 
     /* Configure reset pin */
@@ -108,276 +323,976 @@ esp_err_t pn7160_initialization(void)
     ESP_LOGI(TAG, "PN7160 INT pin ISR handler added");
 
     /* Load card data from NVS */
-    if (nvs_custom_get_u8(NULL, "card", "count", &g_card_count) == ESP_OK)
+    if (card_store_init() != ESP_OK)
     {
-        size_t size = sizeof(g_card_id_value);
-        nvs_custom_get_blob(NULL, "card", "card_ids", g_card_id_value, &size);
-        ESP_LOGI(TAG, "Loaded %d cards from NVS", g_card_count);
+        ESP_LOGE(TAG, "Card store unavailable, no card will be recognized");
     }
-    else
+    card_binding_load();
+
+#if NFC_SIMULATOR
+    if (pn7160_sim_start() != ESP_OK)
     {
-        ESP_LOGW(TAG, "No card data found in NVS");
-        g_card_count = 0;
+        ESP_LOGE(TAG, "PN7160 emulator start failed");
+        return ESP_FAIL;
     }
+#endif
 
-    /* Hardware reset PN7160 */
-    gpio_set_level(PN7160_RST_PIN, 0);
-    vTaskDelay(pdMS_TO_TICKS(10));
-    gpio_set_level(PN7160_RST_PIN, 1);
-    vTaskDelay(pdMS_TO_TICKS(30));
-
-    ESP_LOGI(TAG, "PN7160 reset completed");
-
-    /* pn7160 initialization sequence */
-    uint8_t CORE_RESET_CMD[4] = {0x20, 0x00, 0x01, 0x01}; // Core reset command, reset configuration
-    i2c_master_transmit(pn7160_handle, CORE_RESET_CMD, sizeof(CORE_RESET_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for reset to complete
-    uint8_t CORE_RESET_RSP[4] = {0};
-    i2c_master_receive(pn7160_handle, CORE_RESET_RSP, sizeof(CORE_RESET_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core reset response: %02x %02x %02x %02x", CORE_RESET_RSP[0], CORE_RESET_RSP[1], CORE_RESET_RSP[2], CORE_RESET_RSP[3]);
-    uint8_t CORE_RESET_NTF[12] = {0};
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for reset to complete
-    i2c_master_receive(pn7160_handle, CORE_RESET_NTF, sizeof(CORE_RESET_NTF), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core reset notification: ");
-    ESP_LOG_BUFFER_HEX(TAG, CORE_RESET_NTF, sizeof(CORE_RESET_NTF));
-    uint8_t CORE_INIT_CMD[5] = {0x20, 0x01, 0x02, 0x00, 0x00}; // Core init command
-    i2c_master_transmit(pn7160_handle, CORE_INIT_CMD, sizeof(CORE_INIT_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for init to complete
-    uint8_t CORE_INIT_RSP[33] = {0};
-    i2c_master_receive(pn7160_handle, CORE_INIT_RSP, sizeof(CORE_INIT_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core init response: ");
-    ESP_LOG_BUFFER_HEX(TAG, CORE_INIT_RSP, sizeof(CORE_INIT_RSP));
-    uint8_t CORE_SET_POWER_MODE_CMD[4] = {0x2F, 0x00, 0x01, 0x00}; // NCI proprietary activation command
-    i2c_master_transmit(pn7160_handle, CORE_SET_POWER_MODE_CMD, sizeof(CORE_SET_POWER_MODE_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for activation
-    uint8_t CORE_SET_POWER_MODE_RSP[4] = {0};
-    i2c_master_receive(pn7160_handle, CORE_SET_POWER_MODE_RSP, sizeof(CORE_SET_POWER_MODE_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core set power mode response: %02x %02x %02x %02x", CORE_SET_POWER_MODE_RSP[0], CORE_SET_POWER_MODE_RSP[1], CORE_SET_POWER_MODE_RSP[2], CORE_SET_POWER_MODE_RSP[3]);
-    uint8_t CORE_SET_CONFIG_CMD[8] = {0x20, 0x02, 0x05, 0x01, 0x00, 0x02, 0xFE, 0X01}; // Core set config command to enable extended length
-    i2c_master_transmit(pn7160_handle, CORE_SET_CONFIG_CMD, sizeof(CORE_SET_CONFIG_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for config
-    uint8_t CORE_SET_CONFIG_RSP[5] = {0};
-    i2c_master_receive(pn7160_handle, CORE_SET_CONFIG_RSP, sizeof(CORE_SET_CONFIG_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core set config response: %02x %02x %02x %02x", CORE_SET_CONFIG_RSP[0], CORE_SET_CONFIG_RSP[1], CORE_SET_CONFIG_RSP[2], CORE_SET_CONFIG_RSP[3]);
-    uint8_t CORE_RESET_CMD_KEEP[4] = {0x20, 0x00, 0x01, 0x00}; // Core reset command
-    i2c_master_transmit(pn7160_handle, CORE_RESET_CMD_KEEP, sizeof(CORE_RESET_CMD_KEEP), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for reset to complete
-    i2c_master_receive(pn7160_handle, CORE_RESET_RSP, sizeof(CORE_RESET_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core reset response: %02x %02x %02x %02x", CORE_RESET_RSP[0], CORE_RESET_RSP[1], CORE_RESET_RSP[2], CORE_RESET_RSP[3]);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for reset to complete
-    i2c_master_receive(pn7160_handle, CORE_RESET_NTF, sizeof(CORE_RESET_NTF), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core reset notification: ");
-    ESP_LOG_BUFFER_HEX(TAG, CORE_RESET_NTF, sizeof(CORE_RESET_NTF));
-    i2c_master_transmit(pn7160_handle, CORE_INIT_CMD, sizeof(CORE_INIT_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for init to complete
-    i2c_master_receive(pn7160_handle, CORE_INIT_RSP, sizeof(CORE_INIT_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 core init response: ");
-    ESP_LOG_BUFFER_HEX(TAG, CORE_INIT_RSP, sizeof(CORE_INIT_RSP));
-    uint8_t NCI_PROPRIETARY_ACT_CMD[3] = {0x2F, 0x02, 0x00}; // NCI proprietary activation command
-    i2c_master_transmit(pn7160_handle, NCI_PROPRIETARY_ACT_CMD, sizeof(NCI_PROPRIETARY_ACT_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY); // Wait for activation
-    uint8_t NCI_PROPRIETARY_ACT_RSP[8] = {0};
-    i2c_master_receive(pn7160_handle, NCI_PROPRIETARY_ACT_RSP, sizeof(NCI_PROPRIETARY_ACT_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 NCI proprietary activation response: ");
-    ESP_LOG_BUFFER_HEX(TAG, NCI_PROPRIETARY_ACT_RSP, sizeof(NCI_PROPRIETARY_ACT_RSP));
-    uint8_t RF_DISCOVER_MAP_CMD[19] = {0x21, 0x00, 0x10, 0x05, 0x01, 0x01, 0x01, 0x02, 0x01, 0x01, 0x03, 0x01, 0x01, 0x04, 0x01, 0x02, 0x80, 0x01, 0x80}; // RF discover map command
-    i2c_master_transmit(pn7160_handle, RF_DISCOVER_MAP_CMD, sizeof(RF_DISCOVER_MAP_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY);
-    uint8_t RF_DISCOVER_MAP_RSP[4] = {0};
-    i2c_master_receive(pn7160_handle, RF_DISCOVER_MAP_RSP, sizeof(RF_DISCOVER_MAP_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 RF discover map response: %02x %02x %02x %02x", RF_DISCOVER_MAP_RSP[0], RF_DISCOVER_MAP_RSP[1], RF_DISCOVER_MAP_RSP[2], RF_DISCOVER_MAP_RSP[3]);
-    uint8_t RF_DISCOVER_CMD[10] = {0x21, 0x03, 0x07, 0x03, 0x00, 0x01, 0x01, 0x01, 0x06, 0x01}; // RF discover command
-    i2c_master_transmit(pn7160_handle, RF_DISCOVER_CMD, sizeof(RF_DISCOVER_CMD), portMAX_DELAY);
-    xSemaphoreTake(pn7160_semaphore, portMAX_DELAY);
-    uint8_t RF_DISCOVER_RSP[4] = {0};
-    i2c_master_receive(pn7160_handle, RF_DISCOVER_RSP, sizeof(RF_DISCOVER_RSP), portMAX_DELAY);
-    ESP_LOGI(TAG, "pn7160 RF discover response: %02x %02x %02x %02x", RF_DISCOVER_RSP[0], RF_DISCOVER_RSP[1], RF_DISCOVER_RSP[2], RF_DISCOVER_RSP[3]);
+    if (pn7160_bringup() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "pn7160 initialization sequence failed");
+        return ESP_FAIL;
+    }
 
     /* Create pn7160 task */
     xTaskCreate(pn7160_task, "pn7160_task", 8192, NULL, 10, &pn7160_task_handle);
     ESP_LOGI(TAG, "pn7160 task started");
+#if NFC_SIMULATOR && NFC_SIMULATOR_BENCHMARK_RUNS > 0
+    xTaskCreate(pn7160_sim_benchmark_task, "pn7160_sim_bench", 4096, (void *)NFC_SIMULATOR_BENCHMARK_RUNS, 5, NULL);
+#endif
 
     return ESP_OK;
 }
 
 /**
- * @brief Find a card ID in the list and return its index
- * @param card_id Card ID to search
- * @return Index in list (1~20) if found, 0 if not found
+ * @brief Hand the fingerprints of two-factor cards to the fingerprint driver, so they are refused without their card
+ * @note card_binding_lock must be held
+ * @return void
+ */
+static void card_binding_apply()
+{
+    uint8_t required[FINGERPRINT_CARD_REQUIRED_BYTES] = {0};
+    for (uint8_t i = 0; i < card_binding_count; i++)
+    {
+        if (card_bindings[i].policy != CARD_POLICY_CARD_AND_FINGER)
+        {
+            continue;
+        }
+        for (uint8_t j = 0; j < card_bindings[i].fingerCount; j++)
+        {
+            uint16_t id = card_bindings[i].fingerIDs[j];
+            if (id < FINGERPRINT_MAX_CAPACITY)
+            {
+                required[id >> 3] |= 1 << (id & 0x07);
+            }
+        }
+    }
+    fingerprint_set_card_requirements(required);
+}
+
+/**
+ * @brief Save the binding table to NVS and apply it
+ * @note card_binding_lock must be held
+ * @return esp_err_t ESP_OK = saved, others = NVS write failed
+ */
+static esp_err_t card_binding_save()
+{
+    card_binding_apply();
+    if (card_binding_count == 0)
+    {
+        nvs_custom_erase_key(NULL, "card", "uid_bindings");
+        return ESP_OK;
+    }
+    return nvs_custom_set_blob(NULL, "card", "uid_bindings", card_bindings, card_binding_count * sizeof(struct card_binding));
+}
+
+/**
+ * @brief Load the binding table from NVS
+ * @return void
  */
-uint8_t find_card_id(uint64_t card_id)
+static void card_binding_load()
 {
-    // Check if any cards exist
-    if (g_card_count == 0)
+    if (card_binding_lock == NULL)
     {
-        return 0;
+        card_binding_lock = xSemaphoreCreateMutex();
     }
-    // Traverse card list to find match
-    for (uint8_t i = 0; i < g_card_count; i++)
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    size_t size = sizeof(card_bindings);
+    if (nvs_custom_get_blob(NULL, "card", "uid_bindings", card_bindings, &size) == ESP_OK)
     {
+        card_binding_count = size / sizeof(struct card_binding);
+        ESP_LOGI(TAG, "Loaded %u card bindings from NVS", card_binding_count);
+    }
+    else
+    {
+        card_binding_count = 0;
+    }
+    card_binding_apply();
+    xSemaphoreGive(card_binding_lock);
+}
 
-        if (g_card_id_value[i] == card_id)
+/**
+ * @brief Find the binding of a card
+ * @note card_binding_lock must be held
+ * @param uid Card UID
+ * @return Index in binding table, -1 if the card has no binding
+ */
+static int card_binding_find(const struct card_uid *uid)
+{
+    for (uint8_t i = 0; i < card_binding_count; i++)
+    {
+        if (card_uid_compare(&card_bindings[i].cardUID, uid) == 0)
         {
-            return i + 1; // Return 1-based index if found
+            return i;
         }
     }
-    return 0; // Not found
+    return -1;
 }
 
-void pn7160_task(void *arg)
+/**
+ * @brief Get the policy and bound fingerprints of a card
+ * @param uid Card UID
+ * @param policy Output, unlock policy (CARD_POLICY_CARD_ONLY when the card has no binding)
+ * @param finger_ids Output, bound fingerprint IDs (room for CARD_BOUND_FINGERS_MAX), may be NULL
+ * @param finger_count Output, number of bound fingerprint IDs, may be NULL
+ * @return true = card has a binding, false = no binding
+ */
+bool card_binding_get(const struct card_uid *uid, uint8_t *policy, uint16_t *finger_ids, uint8_t *finger_count)
 {
-    uint8_t RF_DISCOVER_NTF[24] = {0}; // Buffer for RF discover notification
-    uint64_t card_id_value[20] = {0};  // Array to store card IDs (max 20 cards)
-    uint8_t card_count = 0;
-    while (1)
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    int index = card_binding_find(uid);
+    *policy = index < 0 ? CARD_POLICY_CARD_ONLY : card_bindings[index].policy;
+    if (finger_count != NULL)
+    {
+        *finger_count = index < 0 ? 0 : card_bindings[index].fingerCount;
+    }
+    if (finger_ids != NULL && index >= 0)
+    {
+        memcpy(finger_ids, card_bindings[index].fingerIDs, card_bindings[index].fingerCount * sizeof(uint16_t));
+    }
+    xSemaphoreGive(card_binding_lock);
+    return index >= 0;
+}
+
+/**
+ * @brief Bind fingerprints to a card and set the unlock policy of its holder, then save to NVS
+ * @param uid Card UID (must be a stored card)
+ * @param policy CARD_POLICY_CARD_ONLY or CARD_POLICY_CARD_AND_FINGER
+ * @param finger_ids Fingerprint IDs to bind
+ * @param finger_count Number of IDs, at most CARD_BOUND_FINGERS_MAX
+ * @return esp_err_t ESP_OK = saved, ESP_ERR_INVALID_ARG = unknown card or bad parameters, others = NVS write failed
+ */
+esp_err_t card_binding_set(const struct card_uid *uid, uint8_t policy, const uint16_t *finger_ids, uint8_t finger_count)
+{
+    if (!card_store_contains(uid) || policy > CARD_POLICY_CARD_AND_FINGER || finger_count > CARD_BOUND_FINGERS_MAX ||
+        (policy == CARD_POLICY_CARD_AND_FINGER && finger_count == 0))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (policy == CARD_POLICY_CARD_ONLY && finger_count == 0)
+    {
+        return card_binding_remove(uid); // Default behaviour, nothing to store
+    }
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    int index = card_binding_find(uid);
+    if (index < 0)
+    {
+        if (card_binding_count >= CARD_BINDINGS_MAX)
+        {
+            xSemaphoreGive(card_binding_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        index = card_binding_count++;
+    }
+    card_bindings[index].cardUID = *uid;
+    card_bindings[index].policy = policy;
+    card_bindings[index].fingerCount = finger_count;
+    memcpy(card_bindings[index].fingerIDs, finger_ids, finger_count * sizeof(uint16_t));
+    esp_err_t ret = card_binding_save();
+    xSemaphoreGive(card_binding_lock);
+    char hex[CARD_UID_HEX_LEN];
+    card_uid_to_hex(uid, hex);
+    ESP_LOGI(TAG, "Card %s bound to %u fingerprint(s), policy %u", hex, finger_count, policy);
+    return ret;
+}
+
+/**
+ * @brief Remove the binding of a card (card deleted or reset to card-only)
+ * @param uid Card UID
+ * @return esp_err_t ESP_OK = removed or no binding, others = NVS write failed
+ */
+esp_err_t card_binding_remove(const struct card_uid *uid)
+{
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    esp_err_t ret = ESP_OK;
+    int index = card_binding_find(uid);
+    if (index >= 0)
+    {
+        card_bindings[index] = card_bindings[--card_binding_count];
+        ret = card_binding_save();
+    }
+    xSemaphoreGive(card_binding_lock);
+    return ret;
+}
+
+/**
+ * @brief Remove all bindings (all cards cleared)
+ * @return esp_err_t ESP_OK = cleared, others = NVS write failed
+ */
+esp_err_t card_binding_clear()
+{
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    card_binding_count = 0;
+    esp_err_t ret = card_binding_save();
+    xSemaphoreGive(card_binding_lock);
+    return ret;
+}
+
+/**
+ * @brief Drop a deleted fingerprint from every binding, so a template later enrolled at the same ID is not bound
+ * @param id Fingerprint ID, FINGERPRINT_ID_NONE = all fingerprints were cleared
+ * @return esp_err_t ESP_OK = saved or nothing changed, others = NVS write failed
+ */
+esp_err_t card_binding_forget_fingerprint(uint16_t id)
+{
+    bool changed = false;
+    xSemaphoreTake(card_binding_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < card_binding_count; i++)
     {
-        if (xSemaphoreTake(pn7160_semaphore, portMAX_DELAY) == pdTRUE)
+        for (uint8_t j = 0; j < card_bindings[i].fingerCount;)
         {
-            // failed frame:60 07 01 a1
-            // one card successful frame:61 05 15 01 01 02 00 ff 01 0a 04 00 04 98 8c b3 a2 01 08 00 00 00 00 00
-            // two cards successful frame:
-            // 61 03 0f 01 80 00 0a 04 00 04 78 ec 86 a2 01 08 00 02
-            // 61 03 0f 02 80 00 0a 04 00 04 98 8c b3 a2 01 08 00 01
-            if (i2c_master_receive(pn7160_handle, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF), pdMS_TO_TICKS(1000)) == ESP_OK)
+            if (id == FINGERPRINT_ID_NONE || card_bindings[i].fingerIDs[j] == id)
             {
-                notify_user_activity();
-                card_count = 1; // Reset card count to 1 by default, will set to 2 if we find two cards in notification
-                ESP_LOGI(TAG, "Card detected");
-                ESP_LOG_BUFFER_HEX(TAG, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF));
-                if (RF_DISCOVER_NTF[0] == 0x60 && RF_DISCOVER_NTF[1] == 0x07 && RF_DISCOVER_NTF[2] == 0x01 && RF_DISCOVER_NTF[3] == 0xa1)
-                {
-                    ESP_LOGW(TAG, "Card detection failed");
-                    continue;
-                }
-                if (RF_DISCOVER_NTF[0] == 0x61 && RF_DISCOVER_NTF[1] == 0x23 && RF_DISCOVER_NTF[2] == 0x00)
-                {
-                    ESP_LOGW(TAG, "Card detection failed");
-                    continue;
-                }
-                if (RF_DISCOVER_NTF[0] == 0x61 && RF_DISCOVER_NTF[1] == 0x03 && RF_DISCOVER_NTF[2] == 0x0f)
+                card_bindings[i].fingerIDs[j] = card_bindings[i].fingerIDs[--card_bindings[i].fingerCount];
+                changed = true;
+            }
+            else
+            {
+                j++;
+            }
+        }
+    }
+    esp_err_t ret = changed ? card_binding_save() : ESP_OK;
+    xSemaphoreGive(card_binding_lock);
+    return ret;
+}
+
+/**
+ * @brief Check a card read during a tap against the stored cards, then add it or arm its two-factor verification
+ * @note The lock logic is told once per tap by pn7160_finish_tap(), from the verdicts of all cards
+ * @param uid Card UID
+ * @return uint8_t CARD_VERDICT_*
+ */
+static uint8_t pn7160_process_card(const struct card_uid *uid)
+{
+    uint8_t verdict;
+    char hex[CARD_UID_HEX_LEN];
+    card_uid_to_hex(uid, hex);
+    if (g_ready_add_card == true) // Add card operation
+    {
+
+        esp_err_t ret = card_store_add(uid); // Writes a single journal record
+        verdict = CARD_VERDICT_ADDED;
+        if (ret == ESP_OK)
+        {
+            send_operation_result("card_added", true); // Send operation result
+            ESP_LOGI(TAG, "Add card UID: %s", hex);
+            send_card_list(); // Send updated card list
+        }
+        else if (ret == ESP_ERR_INVALID_STATE) // Card already exists
+        {
+            send_operation_result("card_added", false);
+            ESP_LOGI(TAG, "Card already exists: %s", hex);
+        }
+        else
+        {
+            send_operation_result("card_added", false);
+            ESP_LOGE(TAG, "Add card %s failed (%s)", hex, esp_err_to_name(ret));
+        }
+    }
+    else // Card recognition operation
+    {
+        if (!card_store_contains(uid)) // Unknown card
+        {
+            ESP_LOGW(TAG, "Unknown card UID: %s", hex);
+            verdict = CARD_VERDICT_UNKNOWN;
+        }
+        else // Recognized card
+        {
+            ESP_LOGI(TAG, "Recognized card: %s", hex);
+            uint8_t policy;
+            uint16_t finger_ids[CARD_BOUND_FINGERS_MAX];
+            uint8_t finger_count = 0;
+            card_binding_get(uid, &policy, finger_ids, &finger_count);
+            if (policy == CARD_POLICY_CARD_AND_FINGER)
+            {
+                // Two-factor: the card only arms a 1:1 verification of its bound fingerprints
+                uint8_t enrolled = 0;
+                for (uint8_t j = 0; j < finger_count; j++)
                 {
-                    card_count = 2; // Two cards detected
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    i2c_master_receive(pn7160_handle, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF discover notification:");
-                    ESP_LOG_BUFFER_HEX(TAG, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF));
-                    uint8_t RF_DISCOVER_SELECT_CMD_1[6] = {0x21, 0x04, 0x03, 0x01, 0x80, 0x01}; // RF discover select command for card type 1
-                    i2c_master_transmit(pn7160_handle, RF_DISCOVER_SELECT_CMD_1, sizeof(RF_DISCOVER_SELECT_CMD_1), pdMS_TO_TICKS(1000));
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    uint8_t RF_DISCOVER_SELECT_RSP[4] = {0};
-                    i2c_master_receive(pn7160_handle, RF_DISCOVER_SELECT_RSP, sizeof(RF_DISCOVER_SELECT_RSP), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF discover select response: %02x %02x %02x %02x", RF_DISCOVER_SELECT_RSP[0], RF_DISCOVER_SELECT_RSP[1], RF_DISCOVER_SELECT_RSP[2], RF_DISCOVER_SELECT_RSP[3]);
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    i2c_master_receive(pn7160_handle, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF discover notification:");
-                    ESP_LOG_BUFFER_HEX(TAG, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF));
-                    card_id_value[1] = 0;
-                    for (uint8_t i = 0; i < 4; i++)
+                    if (fingerprint_id_exists(finger_ids[j]))
                     {
-                        card_id_value[1] = (card_id_value[1] << 8) | RF_DISCOVER_NTF[13 + i];
+                        finger_ids[enrolled++] = finger_ids[j];
                     }
-                    uint8_t RF_DEACTIVATE_CMD_SLEEP[4] = {0x21, 0x06, 0x01, 0x01}; // RF deactivate command, sleep mode
-                    i2c_master_transmit(pn7160_handle, RF_DEACTIVATE_CMD_SLEEP, sizeof(RF_DEACTIVATE_CMD_SLEEP), pdMS_TO_TICKS(1000));
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    uint8_t RF_DEACTIVATE_RSP[4] = {0};
-                    i2c_master_receive(pn7160_handle, RF_DEACTIVATE_RSP, sizeof(RF_DEACTIVATE_RSP), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF deactivate response: %02x %02x %02x %02x", RF_DEACTIVATE_RSP[0], RF_DEACTIVATE_RSP[1], RF_DEACTIVATE_RSP[2], RF_DEACTIVATE_RSP[3]);
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    uint8_t RF_DEACTIVATE_NTF[5] = {0};
-                    i2c_master_receive(pn7160_handle, RF_DEACTIVATE_NTF, sizeof(RF_DEACTIVATE_NTF), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF deactivate notification:");
-                    ESP_LOG_BUFFER_HEX(TAG, RF_DEACTIVATE_NTF, sizeof(RF_DEACTIVATE_NTF));
-                    uint8_t RF_DISCOVER_SELECT_CMD_2[6] = {0x21, 0x04, 0x03, 0x02, 0x80, 0x01}; // RF discover select command for card type 2
-                    i2c_master_transmit(pn7160_handle, RF_DISCOVER_SELECT_CMD_2, sizeof(RF_DISCOVER_SELECT_CMD_2), pdMS_TO_TICKS(1000));
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    uint8_t RF_DISCOVER_SELECT_RSP_2[4] = {0};
-                    i2c_master_receive(pn7160_handle, RF_DISCOVER_SELECT_RSP_2, sizeof(RF_DISCOVER_SELECT_RSP_2), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF discover select response: %02x %02x %02x %02x", RF_DISCOVER_SELECT_RSP_2[0], RF_DISCOVER_SELECT_RSP_2[1], RF_DISCOVER_SELECT_RSP_2[2], RF_DISCOVER_SELECT_RSP_2[3]);
-                    xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-                    i2c_master_receive(pn7160_handle, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF), pdMS_TO_TICKS(1000));
-                    ESP_LOGI(TAG, "RF discover notification:");
-                    ESP_LOG_BUFFER_HEX(TAG, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF));
                 }
-
-                card_id_value[0] = 0;
-                for (uint8_t i = 0; i < 4; i++)
+                if (enrolled > 0)
                 {
-                    card_id_value[0] = (card_id_value[0] << 8) | RF_DISCOVER_NTF[13 + i];
+                    ESP_LOGI(TAG, "Two-factor card, waiting for a bound fingerprint");
+                    fingerprint_arm_verification(finger_ids, enrolled, CARD_FINGER_WINDOW_MS);
+                    verdict = CARD_VERDICT_ARMED;
                 }
-
-                for (uint8_t i = 0; i < card_count; i++)
+                else
                 {
-                    ESP_LOGI(TAG, "Card %d ID (uint64): 0x%llX", i + 1, card_id_value[i]);
-                }
-
-                for (uint8_t i = 0; i < card_count; i++)
-                {
-                    if (g_ready_add_card == true) // Add card operation
-                    {
-
-                        if (find_card_id(card_id_value[i]) == 0) // Card not found, can be added
-                        {
-                            g_card_id_value[g_card_count] = card_id_value[i];                                        // Store new card ID
-                            nvs_custom_set_blob(NULL, "card", "card_ids", g_card_id_value, sizeof(g_card_id_value)); // Save all card IDs
-                            g_card_count++;                                                                          // Increment card count
-                            send_operation_result("card_added", true);                                               // Send operation result
-                            nvs_custom_set_u8(NULL, "card", "count", g_card_count);
-                            ESP_LOGI(TAG, "Add card ID (uint64): 0x%llX", card_id_value[i]);
-                            send_card_list(); // Send updated card list
-                        }
-                        else // Card already exists
-                        {
-                            send_operation_result("card_added", false);
-                            ESP_LOGI(TAG, "Card already exists: 0x%llX", card_id_value[i]);
-                        }
-                    }
-                    else // Card recognition operation
-                    {
-                        if (find_card_id(card_id_value[i]) == 0) // Unknown card
-                        {
-                            ESP_LOGW(TAG, "Unknown Card ID (uint64): 0x%llX", card_id_value[i]);
-                            uint8_t message = 0x00;
-                            xQueueSend(card_queue, &message, pdMS_TO_TICKS(1000));
-                        }
-                        else // Recognized card
-                        {
-                            ESP_LOGI(TAG, "Recognized card: 0x%llX", card_id_value[i]);
-                            uint8_t message = 0x01;
-                            xQueueSend(card_queue, &message, pdMS_TO_TICKS(1000));
-                        }
-                    }
-                    g_ready_add_card = false; // Reset add card flag
+                    ESP_LOGW(TAG, "Two-factor card without enrolled fingerprints, refused");
+                    verdict = CARD_VERDICT_REFUSED;
                 }
             }
             else
             {
-                ESP_LOGE(TAG, "Failed to receive RF discover notification");
-                vTaskDelay(pdMS_TO_TICKS(500));
+                verdict = CARD_VERDICT_GRANTED;
             }
+        }
+    }
+    g_ready_add_card = false; // Reset add card flag
+    return verdict;
+}
 
-            ESP_LOGI(TAG, "Cleared pending notifications");
-            i2c_master_receive(pn7160_handle, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF), pdMS_TO_TICKS(100)); // Clear any pending notifications
-            ESP_LOG_BUFFER_HEX(TAG, RF_DISCOVER_NTF, sizeof(RF_DISCOVER_NTF));
-            uint8_t RF_DEACTIVATE_CMD[4] = {0x21, 0x06, 0x01, 0x00}; // RF deactivate command, idle mode
-            i2c_master_transmit(pn7160_handle, RF_DEACTIVATE_CMD, sizeof(RF_DEACTIVATE_CMD), pdMS_TO_TICKS(1000));
-            xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-            uint8_t RF_DEACTIVATE_RSP[4] = {0};
-            i2c_master_receive(pn7160_handle, RF_DEACTIVATE_RSP, sizeof(RF_DEACTIVATE_RSP), pdMS_TO_TICKS(1000));
-            ESP_LOGI(TAG, "RF deactivate response: %02x %02x %02x %02x", RF_DEACTIVATE_RSP[0], RF_DEACTIVATE_RSP[1], RF_DEACTIVATE_RSP[2], RF_DEACTIVATE_RSP[3]);
-            xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-            uint8_t RF_DEACTIVATE_NTF[5] = {0};
-            i2c_master_receive(pn7160_handle, RF_DEACTIVATE_NTF, sizeof(RF_DEACTIVATE_NTF), pdMS_TO_TICKS(1000));
-            ESP_LOGI(TAG, "RF deactivate notification:");
-            ESP_LOG_BUFFER_HEX(TAG, RF_DEACTIVATE_NTF, sizeof(RF_DEACTIVATE_NTF));
-            gpio_intr_disable(PN7160_INT_PIN);
-            vTaskDelay(pdMS_TO_TICKS(500)); // Delay before next discovery
-            gpio_intr_enable(PN7160_INT_PIN);
-            uint8_t RF_DISCOVER_CMD[10] = {0x21, 0x03, 0x07, 0x03, 0x00, 0x01, 0x01, 0x01, 0x06, 0x01}; // RF discover command
-            i2c_master_transmit(pn7160_handle, RF_DISCOVER_CMD, sizeof(RF_DISCOVER_CMD), pdMS_TO_TICKS(1000));
-            uint8_t RF_DISCOVER_RSP[4] = {0};
-            xSemaphoreTake(pn7160_semaphore, pdMS_TO_TICKS(1000));
-            i2c_master_receive(pn7160_handle, RF_DISCOVER_RSP, sizeof(RF_DISCOVER_RSP), pdMS_TO_TICKS(1000));
-            ESP_LOGI(TAG, "pn7160 RF discover response: %02x %02x %02x %02x", RF_DISCOVER_RSP[0], RF_DISCOVER_RSP[1], RF_DISCOVER_RSP[2], RF_DISCOVER_RSP[3]);
-        }
-    }
-}
\ No newline at end of file
+/**
+ * @brief Look a card up in the recent-card cache and refresh its entry, so a card held on the reader stays suppressed
+ * @param uid Card UID
+ * @param now esp_timer time of this sighting (us)
+ * @param verdict Output, verdict of the earlier sighting when suppressed
+ * @return true = seen within CARD_DEBOUNCE_WINDOW_MS, false = new presence
+ */
+static bool pn7160_recent_card_seen(const struct card_uid *uid, int64_t now, uint8_t *verdict)
+{
+    for (uint8_t i = 0; i < PN7160_RECENT_CARDS; i++)
+    {
+        if (recent_cards[i].seenTime != 0 && card_uid_compare(&recent_cards[i].uid, uid) == 0)
+        {
+            bool recent = now - recent_cards[i].seenTime < (int64_t)CARD_DEBOUNCE_WINDOW_MS * 1000;
+            recent_cards[i].seenTime = now;
+            *verdict = recent_cards[i].verdict;
+            return recent;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Store the verdict of a card in the recent-card cache, replacing its old entry or the least recently seen one
+ * @param uid Card UID
+ * @param verdict CARD_VERDICT_*
+ * @param now esp_timer time of this sighting (us)
+ */
+static void pn7160_recent_card_store(const struct card_uid *uid, uint8_t verdict, int64_t now)
+{
+    uint8_t slot = 0;
+    for (uint8_t i = 0; i < PN7160_RECENT_CARDS; i++)
+    {
+        if (recent_cards[i].seenTime != 0 && card_uid_compare(&recent_cards[i].uid, uid) == 0)
+        {
+            slot = i;
+            break;
+        }
+        if (recent_cards[i].seenTime < recent_cards[slot].seenTime)
+        {
+            slot = i;
+        }
+    }
+    recent_cards[slot].uid = *uid;
+    recent_cards[slot].verdict = verdict;
+    recent_cards[slot].seenTime = now;
+}
+
+/**
+ * PN7160 RF state machine
+ * pn7160_task never blocks on a response: commands are sent with nci_send() and their responses and notifications
+ * arrive as INT events that advance the state. A deadline is armed while a response or notification is outstanding,
+ * its expiry is the timer event that triggers recovery.
+ */
+
+/**
+ * @brief Enter a state, optionally arming the response deadline
+ * @param state New state
+ * @param timeoutMs Time allowed for the awaited response or notification (ms), 0 = no deadline
+ */
+static void pn7160_set_state(enum pn7160_state state, uint32_t timeoutMs)
+{
+    nfc_state = state;
+    nfc_deadline = timeoutMs ? esp_timer_get_time() + (int64_t)timeoutMs * 1000 : 0;
+}
+
+/**
+ * @brief Send an RF management command without waiting for its response
+ * @return bool true = sent, false = I2C error (recovery has been started)
+ */
+static bool pn7160_send_rf(uint8_t oid, const uint8_t *payload, uint16_t len)
+{
+    if (nci_send(NCI_MT_CMD, NCI_GID_RF, oid, payload, len) == ESP_OK)
+    {
+        return true;
+    }
+    pn7160_recover();
+    return false;
+}
+
+/**
+ * @brief Account the time spent in the previous poll mode and enter a new one
+ * @param mode Mode now configured in the NFCC
+ */
+static void pn7160_set_poll_mode(uint8_t mode)
+{
+    int64_t now = esp_timer_get_time();
+    power_stats.modes[poll_mode_applied].timeMs += (now - poll_mode_since) / 1000;
+    poll_mode_since = now;
+    poll_mode_applied = mode;
+    power_stats.mode = mode;
+    power_stats.modes[mode].entries++;
+    ESP_LOGD(TAG, "Poll mode %u", mode);
+}
+
+/**
+ * @brief Get the start of the current tap
+ * @note The INT edge of the first message of the tap, or the wake-up when the card woke the MCU (the edge interrupt
+ *       is masked while asleep)
+ * @return int64_t esp_timer time (us)
+ */
+static int64_t pn7160_tap_start()
+{
+    return tap_start_time > resume_time ? tap_start_time : resume_time;
+}
+
+/**
+ * @brief Record the detection latency of the first card of a tap in the current poll mode
+ */
+static void pn7160_record_detection()
+{
+    uint32_t latency_ms = (esp_timer_get_time() - pn7160_tap_start()) / 1000;
+    struct pn7160_mode_stats *stats = &power_stats.modes[poll_mode_applied];
+    stats->detections++;
+    stats->lastLatencyMs = latency_ms;
+    stats->totalLatencyMs += latency_ms;
+    if (latency_ms > stats->maxLatencyMs)
+    {
+        stats->maxLatencyMs = latency_ms;
+    }
+    ESP_LOGD(TAG, "Card detected in poll mode %u after %lu ms", poll_mode_applied, latency_ms);
+}
+
+/**
+ * @brief Start a new discovery round from RFST_IDLE, the response moves the state machine to DISCOVERING
+ * @note A pending poll mode switch is configured first, its response starts the discovery
+ */
+static void pn7160_start_discovery()
+{
+    discovered_count = 0;
+    selected_index = 0;
+    tap_card_count = 0;
+    if (poll_mode_requested != poll_mode_applied)
+    {
+        poll_mode_pending = poll_mode_requested;
+        pn7160_set_state(PN7160_STATE_CONFIGURING, PN7160_RESPONSE_TIMEOUT_MS);
+        if (nci_send(NCI_MT_CMD, NCI_GID_CORE, NCI_OID_CORE_SET_CONFIG, RF_POLL_CONFIG_PAYLOAD[poll_mode_pending],
+                     sizeof(RF_POLL_CONFIG_PAYLOAD[poll_mode_pending])) != ESP_OK)
+        {
+            pn7160_recover();
+        }
+        return;
+    }
+    pn7160_set_state(PN7160_STATE_IDLE, PN7160_RESPONSE_TIMEOUT_MS);
+    pn7160_send_rf(NCI_OID_RF_DISCOVER, RF_DISCOVER_PAYLOAD, sizeof(RF_DISCOVER_PAYLOAD));
+}
+
+/**
+ * @brief Deactivate the RF interface
+ * @param type NCI_DEACTIVATE_IDLE, NCI_DEACTIVATE_SLEEP or NCI_DEACTIVATE_DISCOVERY
+ * @param activated true = a target is active, its deactivation is confirmed by a notification after the response
+ */
+static void pn7160_deactivate(uint8_t type, bool activated)
+{
+    deactivate_type = type;
+    deactivate_wait_ntf = activated;
+    pn7160_set_state(PN7160_STATE_DEACTIVATING, PN7160_RESPONSE_TIMEOUT_MS);
+    pn7160_send_rf(NCI_OID_RF_DEACTIVATE, &deactivate_type, 1);
+}
+
+/**
+ * @brief Bring the RF state machine back to a known state after a timeout or a rejected command
+ * @note The first attempts deactivate to idle and restart discovery, after PN7160_RECOVERY_MAX failed attempts in a
+ *       row the chip gets a cold bring-up
+ */
+static void pn7160_recover()
+{
+    if (++recovery_count > PN7160_RECOVERY_MAX)
+    {
+        ESP_LOGE(TAG, "pn7160 not responding, cold bring-up");
+        recovery_count = 0;
+        discovered_count = 0;
+        tap_card_count = 0;
+        if (pn7160_bringup() == ESP_OK)
+        {
+            pn7160_set_poll_mode(PN7160_MODE_ACTIVE);
+            pn7160_set_state(PN7160_STATE_DISCOVERING, 0);
+        }
+        else
+        {
+            pn7160_set_state(PN7160_STATE_IDLE, PN7160_RESPONSE_TIMEOUT_MS); // Retried when the deadline expires
+        }
+        return;
+    }
+    ESP_LOGW(TAG, "pn7160 recovery in state %d", nfc_state);
+    pn7160_deactivate(NCI_DEACTIVATE_IDLE, false);
+}
+
+/**
+ * @brief Activate a target listed by RF_DISCOVER_NTF, RF_INTF_ACTIVATED_NTF follows on success
+ * @param index Index in the discovered target list
+ */
+static void pn7160_select_target(uint8_t index)
+{
+    uint8_t RF_DISCOVER_SELECT_PAYLOAD[3] = {discovered_ids[index], discovered_protocols[index], NCI_RF_INTERFACE_FRAME};
+    pn7160_set_state(PN7160_STATE_DISCOVERING, PN7160_RESPONSE_TIMEOUT_MS);
+    pn7160_send_rf(NCI_OID_RF_DISCOVER_SELECT, RF_DISCOVER_SELECT_PAYLOAD, sizeof(RF_DISCOVER_SELECT_PAYLOAD));
+}
+
+/**
+ * @brief Record the processing time and card count of the tap that just ended
+ * @param now esp_timer time the cards were handled (us)
+ */
+static void pn7160_record_tap(int64_t now)
+{
+    uint32_t tap_ms = (now - pn7160_tap_start()) / 1000;
+    tap_stats.taps++;
+    tap_stats.lastCardCount = tap_card_count;
+    tap_stats.lastTargetCount = discovered_count ? discovered_count : 1;
+    tap_stats.lastTapMs = tap_ms;
+    tap_stats.totalTapMs += tap_ms;
+    if (tap_ms > tap_stats.maxTapMs)
+    {
+        tap_stats.maxTapMs = tap_ms;
+    }
+    if (tap_card_count > tap_stats.maxCardCount)
+    {
+        tap_stats.maxCardCount = tap_card_count;
+    }
+    ESP_LOGI(TAG, "Tap: %u of %u target(s) read in %lu ms", tap_card_count, tap_stats.lastTargetCount, tap_ms);
+}
+
+/**
+ * @brief Handle the cards read during the tap and resume discovery
+ * @param activated true = the last target is active (RFST_POLL_ACTIVE), false = its activation failed and the NFCC
+ *                  waits for a selection (RFST_W4_HOST_SELECT, only an idle deactivation is allowed)
+ */
+static void pn7160_finish_tap(bool activated)
+{
+    int64_t now = esp_timer_get_time();
+    bool granted = false;
+    bool refused = false;
+    for (uint8_t i = 0; i < tap_card_count; i++)
+    {
+        // A card held on the reader is found again every discovery round, only its first presence is handled
+        uint8_t verdict;
+        if (!g_ready_add_card && pn7160_recent_card_seen(&tap_card_uids[i], now, &verdict))
+        {
+            tap_stats.suppressedCards++;
+            ESP_LOGD(TAG, "Card still in the field (verdict %u), suppressed", verdict);
+            continue;
+        }
+        verdict = pn7160_process_card(&tap_card_uids[i]);
+        pn7160_recent_card_store(&tap_card_uids[i], verdict, now);
+        granted |= verdict == CARD_VERDICT_GRANTED;
+        refused |= verdict == CARD_VERDICT_UNKNOWN || verdict == CARD_VERDICT_REFUSED;
+    }
+    if (granted || refused)
+    {
+        // One lock actuation (or refusal) per tap, however many cards the wallet holds
+        uint8_t message = granted ? 0x01 : 0x00;
+        xQueueSend(card_queue, &message, pdMS_TO_TICKS(1000));
+    }
+    pn7160_record_tap(esp_timer_get_time());
+    discovered_count = 0;
+    selected_index = 0;
+    tap_card_count = 0;
+    if (!activated || poll_mode_requested != poll_mode_applied)
+    {
+        pn7160_deactivate(NCI_DEACTIVATE_IDLE, activated); // Through RFST_IDLE, configures a requested poll mode
+        return;
+    }
+    pn7160_deactivate(NCI_DEACTIVATE_DISCOVERY, true); // Back to polling without an idle round trip
+}
+
+/**
+ * @brief Move on to the next listed target, or end the tap after the last one
+ * @param activated true = the current target is active and is put to sleep first, false = its activation failed
+ */
+static void pn7160_next_target(bool activated)
+{
+    if (discovered_count > 0 && ++selected_index < discovered_count)
+    {
+        if (activated)
+        {
+            pn7160_deactivate(NCI_DEACTIVATE_SLEEP, true); // Put this target to sleep, then select the next listed one
+        }
+        else
+        {
+            pn7160_select_target(selected_index);
+        }
+        return;
+    }
+    pn7160_finish_tap(activated);
+}
+
+/**
+ * @brief Start a requested poll mode switch while discovery runs without a tap in progress, and report the low-power
+ *        mode and the wake-to-ready time once reached
+ */
+static void pn7160_check_poll_mode()
+{
+    if (nfc_state != PN7160_STATE_DISCOVERING || nfc_deadline != 0 || discovered_count > 0)
+    {
+        return;
+    }
+    if (poll_mode_requested != poll_mode_applied)
+    {
+        pn7160_deactivate(NCI_DEACTIVATE_IDLE, false); // Poll parameters can only be changed in RFST_IDLE
+        return;
+    }
+    if (poll_mode_applied == PN7160_MODE_LOW_POWER && low_power_waiting)
+    {
+        low_power_waiting = false;
+        xSemaphoreGive(pn7160_mode_semaphore);
+    }
+    else if (poll_mode_applied == PN7160_MODE_ACTIVE && resume_pending)
+    {
+        resume_pending = false;
+        bringup_timing.wakeToReadyMs = (esp_timer_get_time() - resume_time) / 1000;
+        ESP_LOGI(TAG, "pn7160 wake to active polling: %lu ms", bringup_timing.wakeToReadyMs);
+    }
+}
+
+/**
+ * @brief CORE_SET_CONFIG_RSP handler of a poll mode switch, starts the discovery in the new mode
+ * @note A rejected parameter (e.g. low-power card detection unsupported by the firmware) leaves the others applied,
+ *       the mode counts as entered so the switch is not retried in a loop
+ */
+static void pn7160_on_set_config_rsp(const struct nci_message *msg)
+{
+    if (nfc_state != PN7160_STATE_CONFIGURING)
+    {
+        return;
+    }
+    if (msg->len == 0 || msg->payload[0] != NCI_STATUS_OK)
+    {
+        ESP_LOGW(TAG, "Poll mode %u configuration rejected, status %02X", poll_mode_pending, msg->len ? msg->payload[0] : 0xFF);
+    }
+    pn7160_set_poll_mode(poll_mode_pending);
+    pn7160_start_discovery();
+}
+
+/**
+ * @brief RF_DISCOVER_RSP handler, discovery is running once accepted
+ */
+static void pn7160_on_discover_rsp(const struct nci_message *msg)
+{
+    if (nfc_state != PN7160_STATE_IDLE)
+    {
+        return;
+    }
+    if (msg->len == 0 || msg->payload[0] != NCI_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "RF discover rejected");
+        pn7160_recover();
+        return;
+    }
+    recovery_count = 0;
+    pn7160_set_state(PN7160_STATE_DISCOVERING, 0);
+}
+
+/**
+ * @brief RF_DISCOVER_SELECT_RSP handler, the activation notification is awaited under the same deadline
+ */
+static void pn7160_on_select_rsp(const struct nci_message *msg)
+{
+    if (nfc_state != PN7160_STATE_DISCOVERING)
+    {
+        return;
+    }
+    if (msg->len == 0 || msg->payload[0] != NCI_STATUS_OK)
+    {
+        ESP_LOGW(TAG, "Failed to select target %u", discovered_ids[selected_index]);
+        pn7160_recover();
+    }
+}
+
+/**
+ * @brief RF_DEACTIVATE_RSP handler, completes the deactivation unless a notification is still due
+ */
+static void pn7160_on_deactivate_rsp(const struct nci_message *msg)
+{
+    if (nfc_state != PN7160_STATE_DEACTIVATING)
+    {
+        return;
+    }
+    if (msg->len == 0 || msg->payload[0] != NCI_STATUS_OK)
+    {
+        if (deactivate_type == NCI_DEACTIVATE_IDLE)
+        {
+            pn7160_start_discovery(); // Rejected because the NFCC is already idle
+            return;
+        }
+        ESP_LOGW(TAG, "RF deactivate rejected");
+        pn7160_recover();
+        return;
+    }
+    if (!deactivate_wait_ntf)
+    {
+        pn7160_on_deactivated(NULL);
+    }
+}
+
+/**
+ * @brief RF_DEACTIVATE_NTF handler (msg is NULL when the response completed the deactivation)
+ */
+static void pn7160_on_deactivated(const struct nci_message *msg)
+{
+    if (msg != NULL)
+    {
+        ESP_LOGD(TAG, "RF deactivate notification, type %u", msg->len > 0 ? msg->payload[0] : 0xFF);
+    }
+    if (nfc_state != PN7160_STATE_DEACTIVATING)
+    {
+        return; // Target left the field on its own, the NFCC resumes discovery
+    }
+    recovery_count = 0;
+    switch (deactivate_type)
+    {
+    case NCI_DEACTIVATE_SLEEP:
+        pn7160_select_target(selected_index);
+        break;
+    case NCI_DEACTIVATE_DISCOVERY:
+        pn7160_set_state(PN7160_STATE_DISCOVERING, 0);
+        break;
+    default:
+        pn7160_start_discovery();
+        break;
+    }
+}
+
+/**
+ * @brief CORE_GENERIC_ERROR_NTF handler
+ * @note After a failed activation of a single target the NFCC is back in discovery on its own. A listed target that
+ *       fails to activate leaves the NFCC waiting for another selection, so the remaining targets are still read.
+ */
+static void pn7160_on_generic_error(const struct nci_message *msg)
+{
+    uint8_t status = msg->len > 0 ? msg->payload[0] : 0xFF;
+    if (status == NCI_STATUS_ACTIVATION_FAILED)
+    {
+        ESP_LOGW(TAG, "Card detection failed");
+    }
+    else
+    {
+        ESP_LOGW(TAG, "NCI generic error %02X", status);
+    }
+    if (nfc_state != PN7160_STATE_DISCOVERING || discovered_count == 0)
+    {
+        return;
+    }
+    if (status == NCI_STATUS_ACTIVATION_FAILED)
+    {
+        tap_stats.skippedTargets++;
+        pn7160_next_target(false);
+        return;
+    }
+    pn7160_deactivate(NCI_DEACTIVATE_IDLE, false);
+}
+
+/**
+ * @brief RF_DISCOVER_NTF handler, collects the targets in the field and selects the first once the list is complete
+ * @note Payload: [RF discovery ID][RF protocol][technology and mode][parameter length n][parameters (n)][notification type]
+ */
+static void pn7160_on_discover(const struct nci_message *msg)
+{
+    if (msg->len < 4 || msg->len < 5 + msg->payload[3])
+    {
+        ESP_LOGW(TAG, "Malformed RF discover notification");
+        return;
+    }
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, msg->payload, msg->len, ESP_LOG_DEBUG);
+    if (discovered_count == 0)
+    {
+        tap_start_time = int_time;
+    }
+    bool listed = false;
+    for (uint8_t i = 0; i < discovered_count; i++)
+    {
+        listed |= discovered_ids[i] == msg->payload[0]; // Same target reported for another protocol
+    }
+    if (listed)
+    {
+        ESP_LOGD(TAG, "Target %u already listed, protocol %02X ignored", msg->payload[0], msg->payload[1]);
+    }
+    else if (discovered_count < PN7160_MAX_TARGETS)
+    {
+        discovered_ids[discovered_count] = msg->payload[0];
+        discovered_protocols[discovered_count] = msg->payload[1];
+        discovered_count++;
+    }
+    else
+    {
+        tap_stats.skippedTargets++;
+        ESP_LOGW(TAG, "More than %d targets in the field, ignoring target %u", PN7160_MAX_TARGETS, msg->payload[0]);
+    }
+    if (msg->payload[4 + msg->payload[3]] == NCI_DISCOVER_NTF_MORE)
+    {
+        return; // The list is complete with the last notification (NCI_DISCOVER_NTF_LAST or _LAST_LIMIT)
+    }
+    ESP_LOGD(TAG, "%u target(s) listed", discovered_count);
+    selected_index = 0;
+    tap_card_count = 0;
+    pn7160_select_target(0);
+}
+
+/**
+ * @brief Read the card UID from the RF technology specific parameters of RF_INTF_ACTIVATED_NTF
+ * @note NFC-A: [SENS_RES (2)][NFCID1 length][NFCID1 (4, 7 or 10)][SEL_RES length][SEL_RES]
+ *       NFC-B: [SENSB_RES length][SENSB_RES: 0x50, NFCID0 (4), ...]
+ *       NFC-V: [RES_FLAG][DSFID][UID (8)]
+ * @param msg RF_INTF_ACTIVATED_NTF
+ * @param uid Output, card UID
+ * @return true = UID read, false = unsupported technology or malformed parameters
+ */
+static bool pn7160_parse_uid(const struct nci_message *msg, struct card_uid *uid)
+{
+    memset(uid, 0, sizeof(*uid));
+    if (msg->len < 7 || 7 + msg->payload[6] > msg->len)
+    {
+        return false;
+    }
+    const uint8_t *params = msg->payload + 7;
+    uint8_t paramsLen = msg->payload[6];
+    const uint8_t *src = NULL;
+    uint8_t len = 0;
+    switch (msg->payload[3])
+    {
+    case NCI_NFC_A_PASSIVE_POLL:
+        if (paramsLen >= 3 && (params[2] == 4 || params[2] == 7 || params[2] == 10) && 3 + params[2] <= paramsLen)
+        {
+            len = params[2];
+            src = params + 3;
+        }
+        break;
+    case NCI_NFC_B_PASSIVE_POLL:
+        if (paramsLen >= 6 && params[0] >= 5)
+        {
+            len = 4;
+            src = params + 2;
+        }
+        break;
+    case NCI_NFC_V_PASSIVE_POLL:
+        if (paramsLen >= 10)
+        {
+            len = 8;
+            src = params + 2;
+        }
+        break;
+    default:
+        break;
+    }
+    if (src == NULL)
+    {
+        return false;
+    }
+    uid->len = len;
+    memcpy(uid->bytes, src, len);
+    return true;
+}
+
+/**
+ * @brief RF_INTF_ACTIVATED_NTF handler, reads the card UID and moves on to the next listed target or ends the tap
+ * @note Payload: [RF discovery ID][RF interface][RF protocol][technology and mode][max data packet payload]
+ *       [initial credits][parameter length n][parameters (n)]...
+ */
+static void pn7160_on_activated(const struct nci_message *msg)
+{
+    pn7160_set_state(PN7160_STATE_ACTIVATED, 0);
+    ESP_LOGD(TAG, "Card detected");
+    ESP_LOG_BUFFER_HEX_LEVEL(TAG, msg->payload, msg->len, ESP_LOG_DEBUG);
+    if (discovered_count == 0 && tap_card_count == 0)
+    {
+        tap_start_time = int_time; // Single target activated directly
+    }
+    if (tap_card_count < PN7160_MAX_TARGETS)
+    {
+        if (pn7160_parse_uid(msg, &tap_card_uids[tap_card_count]))
+        {
+            char hex[CARD_UID_HEX_LEN];
+            card_uid_to_hex(&tap_card_uids[tap_card_count], hex);
+            if (tap_card_count == 0)
+            {
+                pn7160_record_detection();
+            }
+            tap_card_count++;
+            ESP_LOGD(TAG, "Card %d UID: %s", tap_card_count, hex);
+        }
+        else
+        {
+            ESP_LOGW(TAG, "Activated target without a readable UID (technology %02X)", msg->len > 3 ? msg->payload[3] : 0xFF);
+        }
+    }
+
+    pn7160_next_target(true);
+}
+
+static const struct nci_handler_entry pn7160_handlers[] = {
+    {NCI_MT_RSP, NCI_GID_CORE, NCI_OID_CORE_SET_CONFIG, pn7160_on_set_config_rsp},
+    {NCI_MT_RSP, NCI_GID_RF, NCI_OID_RF_DISCOVER, pn7160_on_discover_rsp},
+    {NCI_MT_RSP, NCI_GID_RF, NCI_OID_RF_DISCOVER_SELECT, pn7160_on_select_rsp},
+    {NCI_MT_RSP, NCI_GID_RF, NCI_OID_RF_DEACTIVATE, pn7160_on_deactivate_rsp},
+    {NCI_MT_NTF, NCI_GID_CORE, NCI_OID_CORE_GENERIC_ERROR, pn7160_on_generic_error},
+    {NCI_MT_NTF, NCI_GID_RF, NCI_OID_RF_DISCOVER, pn7160_on_discover},
+    {NCI_MT_NTF, NCI_GID_RF, NCI_OID_RF_INTF_ACTIVATED, pn7160_on_activated},
+    {NCI_MT_NTF, NCI_GID_RF, NCI_OID_RF_DEACTIVATE, pn7160_on_deactivated},
+};
+
+void pn7160_task(void *arg)
+{
+    // Started right after a bring-up, which ends with discovery running in active poll mode
+    discovered_count = 0;
+    selected_index = 0;
+    tap_card_count = 0;
+    recovery_count = 0;
+    poll_mode_since = esp_timer_get_time();
+    pn7160_set_poll_mode(PN7160_MODE_ACTIVE);
+    pn7160_set_state(PN7160_STATE_DISCOVERING, 0);
+    while (1)
+    {
+        pn7160_check_poll_mode();
+        TickType_t wait = portMAX_DELAY;
+        if (nfc_deadline != 0)
+        {
+            int64_t remaining = nfc_deadline - esp_timer_get_time();
+            wait = remaining > 0 ? pdMS_TO_TICKS(remaining / 1000) + 1 : 0;
+        }
+        // INT stays high while messages are pending, so the level is checked before waiting for the next edge
+        if (pn7160_int_level() == 0 && xSemaphoreTake(pn7160_semaphore, wait) != pdTRUE)
+        {
+            if (nfc_deadline != 0 && esp_timer_get_time() >= nfc_deadline)
+            {
+                ESP_LOGW(TAG, "pn7160 response timeout in state %d", nfc_state);
+                nfc_deadline = 0;
+                pn7160_recover();
+            }
+            continue;
+        }
+        if (pn7160_int_level() == 0)
+        {
+            continue; // Edge of a message that has already been read
+        }
+        esp_err_t err = nci_read(&nci_ntf, pdMS_TO_TICKS(PN7160_SEGMENT_TIMEOUT_MS));
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to receive NCI message (%s)", esp_err_to_name(err));
+            continue;
+        }
+        if (nci_ntf.mt == NCI_MT_NTF)
+        {
+            notify_user_activity();
+        }
+        if (!nci_dispatch(pn7160_handlers, sizeof(pn7160_handlers) / sizeof(pn7160_handlers[0]), &nci_ntf))
+        {
+            ESP_LOGW(TAG, "Unhandled NCI message %02X %02X", nci_ntf.mt | nci_ntf.gid, nci_ntf.oid);
+            ESP_LOG_BUFFER_HEX(TAG, nci_ntf.payload, nci_ntf.len);
+        }
+    }
+}
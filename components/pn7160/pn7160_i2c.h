@@ -6,8 +6,12 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
+#include <esp_timer.h>
 #include "nvs_custom.h"
 #include "app_config.h"
+#include "zw111.h"
+#include "pn7160_nci.h"
+#include "card_store.h"
 
 #define DL_CMD 0x00		   // Download command
 #define DL_RESET 0xF0	   // Reset command
@@ -16,16 +20,141 @@
 #define MAX_FRAME_SIZE 1000				// Maximum frame size for PN7160
 #define CHUNK_SIZE (MAX_FRAME_SIZE - 4) // Chunk size for data transfer
 
-extern i2c_master_dev_handle_t pn7160_handle;
+#define PN7160_RESPONSE_TIMEOUT_MS 1000 // Longest wait for a response or notification while handling a tap (ms)
+#define PN7160_MAX_TARGETS 8            // Targets selected per tap when several cards are in the field
+#define PN7160_SEGMENT_TIMEOUT_MS 10    // Longest wait for the next segment of a message being read (ms)
+#define PN7160_RECOVERY_MAX 2           // Failed recoveries in a row before a cold bring-up
+#define PN7160_RECENT_CARDS 8           // Cards remembered for the tap debounce (CARD_DEBOUNCE_WINDOW_MS)
+
+#define PN7160_STEP_TIMEOUT_MS 500   // Response/notification timeout of a bring-up step (ms)
+#define PN7160_RESET_TIMEOUT_MS 1000 // Response/notification timeout of a core reset step (ms)
+#define PN7160_STEP_RETRIES 2        // Reissues of a bring-up step after a timeout or rejection
+
+#define PN7160_ACTIVE_CURRENT_UA 5000       // Nominal NFCC current with full polling every PN7160_ACTIVE_POLL_PERIOD_MS (uA, estimate)
+#define PN7160_LOW_POWER_CURRENT_UA 150     // Nominal NFCC current with low-power card detection (uA, estimate)
+#define PN7160_MODE_SWITCH_TIMEOUT_MS 500   // Longest wait for low-power card detection before the MCU sleeps (ms)
+
 extern bool g_ready_add_card;
 extern bool g_ready_delete_card;
-extern char g_delete_card_number;
+extern struct card_uid g_delete_card_number;
 extern QueueHandle_t card_queue; 
 extern void send_card_list();                                         // send updated card list to front end
 extern void send_operation_result(const char *message, bool success); // send operation result to front end
 
+// Fingerprint templates bound to a card and the unlock policy of its holder
+struct card_binding
+{
+	struct card_uid cardUID;                    // Card UID
+	uint8_t policy;                             // CARD_POLICY_CARD_ONLY or CARD_POLICY_CARD_AND_FINGER
+	uint8_t fingerCount;                        // Number of bound fingerprint IDs
+	uint16_t fingerIDs[CARD_BOUND_FINGERS_MAX]; // Bound fingerprint IDs
+};
+
+// Outcome of handling a card
+enum card_verdict
+{
+	CARD_VERDICT_UNKNOWN,  // Not a stored card
+	CARD_VERDICT_GRANTED,  // Stored card, unlocks alone
+	CARD_VERDICT_ARMED,    // Two-factor card, waiting for a bound fingerprint
+	CARD_VERDICT_REFUSED,  // Two-factor card without enrolled fingerprints
+	CARD_VERDICT_ADDED,    // Read in add mode (added or already stored)
+};
+
+// Card seen recently, a card held on the reader is suppressed until it has been away for CARD_DEBOUNCE_WINDOW_MS
+struct recent_card
+{
+	struct card_uid uid; // Card UID
+	uint8_t verdict;     // CARD_VERDICT_* of its first presence
+	int64_t seenTime;    // Last time it was seen (us), 0 = free entry
+};
+
+// States of the RF state machine run by pn7160_task
+enum pn7160_state
+{
+	PN7160_STATE_IDLE,         // RFST_IDLE, RF discover command outstanding
+	PN7160_STATE_DISCOVERING,  // Polling for targets, or selecting one of several listed targets
+	PN7160_STATE_ACTIVATED,    // A target is active and being read
+	PN7160_STATE_DEACTIVATING, // RF deactivate command outstanding
+	PN7160_STATE_CONFIGURING,  // RFST_IDLE, core set config of a poll mode switch outstanding
+};
+
+// RF polling modes, switched while no tap is in progress
+enum pn7160_poll_mode
+{
+	PN7160_MODE_ACTIVE,    // MCU awake: full polling every PN7160_ACTIVE_POLL_PERIOD_MS
+	PN7160_MODE_LOW_POWER, // MCU asleep: low-power card detection every PN7160_LOW_POWER_POLL_PERIOD_MS, INT wakes the MCU
+	PN7160_MODE_COUNT,
+};
+
+// One command of the bring-up sequence
+struct pn7160_init_step
+{
+	const char *name;       // Step name used in logs
+	uint8_t gid;            // Group ID
+	uint8_t oid;            // Opcode ID
+	const uint8_t *payload; // Command payload, NULL when len is 0
+	uint8_t len;            // Payload length
+	bool notification;      // Also wait for the notification with the same GID/OID
+	uint16_t timeoutMs;     // Timeout of the response and of the notification (ms)
+	uint8_t retries;        // Reissues after a timeout or rejection
+	bool optional;          // A rejection is not an error (the NFCC is already in the target state)
+};
+
+// Bring-up measurements, used to track post-wake latency
+struct pn7160_bringup_timing
+{
+	uint32_t lastBringupMs; // Duration of the last bring-up (ms)
+	uint32_t wakeToReadyMs; // Light sleep wake-up -> active polling running, last wake-up (ms)
+	uint32_t bringupCount;  // Number of bring-ups (hardware reset and full configuration)
+	uint32_t resumeCount;   // Number of light sleep wake-ups
+};
+
+// Time, current and detection latency of one poll mode
+struct pn7160_mode_stats
+{
+	uint32_t entries;        // Number of switches to this mode
+	uint32_t timeMs;         // Time spent in this mode (ms)
+	uint32_t currentUa;      // Nominal NFCC current in this mode (uA)
+	uint32_t detections;     // Taps detected in this mode
+	uint32_t lastLatencyMs;  // INT edge (MCU wake-up in low-power mode) -> first UID read, last tap (ms)
+	uint32_t maxLatencyMs;   // Longest detection latency (ms)
+	uint32_t totalLatencyMs; // Sum of detection latencies, divide by detections for the average (ms)
+};
+
+// Per-tap measurements, a tap lasts from the first message to the end of card handling
+struct pn7160_tap_stats
+{
+	uint32_t taps;            // Completed taps
+	uint8_t lastTargetCount;  // Targets in the field during the last tap
+	uint8_t lastCardCount;    // Cards read during the last tap
+	uint8_t maxCardCount;     // Most cards read during one tap
+	uint32_t lastTapMs;       // Processing time of the last tap (ms)
+	uint32_t maxTapMs;        // Longest tap (ms)
+	uint32_t totalTapMs;      // Sum of tap times, divide by taps for the average (ms)
+	uint32_t skippedTargets;  // Targets beyond PN7160_MAX_TARGETS or that failed to activate
+	uint32_t suppressedCards; // Cards still in the field within CARD_DEBOUNCE_WINDOW_MS, not handled again
+};
+
+// Poll mode measurements, used to compare idle current against first-tap latency
+struct pn7160_power_stats
+{
+	uint8_t mode;                                       // Poll mode currently applied
+	struct pn7160_mode_stats modes[PN7160_MODE_COUNT]; // Indexed by enum pn7160_poll_mode
+	uint32_t averageCurrentUa;                          // Time-weighted nominal NFCC current over all modes (uA)
+};
+
 esp_err_t pn7160_initialization();
-uint8_t find_card_id(uint64_t card_id);
+esp_err_t pn7160_bringup();
+esp_err_t pn7160_enter_low_power();
+esp_err_t pn7160_resume(int64_t wake_time);
+void pn7160_get_bringup_timing(struct pn7160_bringup_timing *out);
+void pn7160_get_power_stats(struct pn7160_power_stats *out);
+void pn7160_get_tap_stats(struct pn7160_tap_stats *out);
+bool card_binding_get(const struct card_uid *uid, uint8_t *policy, uint16_t *finger_ids, uint8_t *finger_count);
+esp_err_t card_binding_set(const struct card_uid *uid, uint8_t policy, const uint16_t *finger_ids, uint8_t finger_count);
+esp_err_t card_binding_remove(const struct card_uid *uid);
+esp_err_t card_binding_clear();
+esp_err_t card_binding_forget_fingerprint(uint16_t id);
 void pn7160_task(void *arg);
 extern void notify_user_activity(void);
 
@@ -0,0 +1,218 @@
+#include "pn7160_nci.h"
+
+static const char *TAG = "pn7160_nci";
+
+/**
+ * @brief Wait until the PN7160 has a packet ready (INT pin high)
+ * @note INT stays high while further packets are pending, so the level is checked before waiting for an edge;
+ *       a semaphore left over from an already consumed packet only causes another level check
+ * @param ticks Longest time to wait for each edge
+ * @return esp_err_t ESP_OK = packet ready, ESP_ERR_TIMEOUT = no packet
+ */
+static esp_err_t nci_wait_irq(TickType_t ticks)
+{
+    while (pn7160_int_level() == 0)
+    {
+        if (xSemaphoreTake(pn7160_semaphore, ticks) != pdTRUE)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Send a message, split into segments of at most NCI_MAX_PAYLOAD_LEN bytes
+ * @param mt Message type (NCI_MT_CMD or NCI_MT_DATA)
+ * @param gid Group ID (connection ID for data messages)
+ * @param oid Opcode ID (ignored for data messages)
+ * @param payload Payload, may be NULL when len is 0
+ * @param len Payload length
+ * @return esp_err_t ESP_OK = sent, others = I2C error
+ */
+esp_err_t nci_send(uint8_t mt, uint8_t gid, uint8_t oid, const uint8_t *payload, uint16_t len)
+{
+    uint8_t packet[NCI_HEADER_LEN + NCI_MAX_PAYLOAD_LEN];
+    uint16_t offset = 0;
+    do
+    {
+        uint16_t segment = len - offset > NCI_MAX_PAYLOAD_LEN ? NCI_MAX_PAYLOAD_LEN : len - offset;
+        bool more = offset + segment < len;
+        packet[0] = (mt & NCI_MT_MASK) | (more ? NCI_PBF : 0) | (gid & NCI_GID_MASK);
+        packet[1] = mt == NCI_MT_DATA ? 0 : (oid & NCI_OID_MASK);
+        packet[2] = segment;
+        if (segment > 0)
+        {
+            memcpy(packet + NCI_HEADER_LEN, payload + offset, segment);
+        }
+        esp_err_t err = pn7160_i2c_transmit(packet, NCI_HEADER_LEN + segment);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Send %02X %02X failed (%s)", packet[0], packet[1], esp_err_to_name(err));
+            return err;
+        }
+        offset += segment;
+    } while (offset < len);
+    return ESP_OK;
+}
+
+/**
+ * @brief Read one message: the 3-byte header first, then exactly the announced payload, for every segment
+ * @param msg Output, the reassembled message
+ * @param ticks Longest time to wait for each segment
+ * @return esp_err_t ESP_OK = message read, ESP_ERR_TIMEOUT = nothing received, ESP_ERR_INVALID_SIZE = message
+ *         larger than NCI_MAX_MESSAGE_LEN (consumed and dropped), ESP_ERR_INVALID_RESPONSE = inconsistent segments,
+ *         others = I2C error
+ */
+esp_err_t nci_read(struct nci_message *msg, TickType_t ticks)
+{
+    uint8_t header[NCI_HEADER_LEN];
+    uint8_t discard[NCI_MAX_PAYLOAD_LEN];
+    bool first = true;
+    bool overflow = false;
+    bool mismatch = false;
+    msg->len = 0;
+    while (1)
+    {
+        esp_err_t err = nci_wait_irq(ticks);
+        if (err != ESP_OK)
+        {
+            return first ? err : ESP_ERR_INVALID_RESPONSE;
+        }
+        err = pn7160_i2c_receive(header, sizeof(header));
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Header read failed (%s)", esp_err_to_name(err));
+            return err;
+        }
+        uint8_t mt = header[0] & NCI_MT_MASK;
+        uint8_t gid = header[0] & NCI_GID_MASK;
+        uint8_t oid = mt == NCI_MT_DATA ? 0 : header[1] & NCI_OID_MASK;
+        if (first)
+        {
+            msg->mt = mt;
+            msg->gid = gid;
+            msg->oid = oid;
+            first = false;
+        }
+        else if (mt != msg->mt || gid != msg->gid || oid != msg->oid)
+        {
+            mismatch = true;
+        }
+        uint8_t segment = header[2];
+        if (segment > 0)
+        {
+            bool fits = !overflow && !mismatch && msg->len + segment <= NCI_MAX_MESSAGE_LEN;
+            overflow |= !fits && !mismatch;
+            err = pn7160_i2c_receive(fits ? msg->payload + msg->len : discard, segment);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Payload read failed (%s)", esp_err_to_name(err));
+                return err;
+            }
+            if (fits)
+            {
+                msg->len += segment;
+            }
+        }
+        if (!(header[0] & NCI_PBF))
+        {
+            break;
+        }
+    }
+    if (mismatch)
+    {
+        ESP_LOGE(TAG, "Segments of %02X %02X do not belong together", msg->mt | msg->gid, msg->oid);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (overflow)
+    {
+        ESP_LOGE(TAG, "Message %02X %02X exceeds %d bytes, dropped", msg->mt | msg->gid, msg->oid, NCI_MAX_MESSAGE_LEN);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Read messages until one with the given type, GID and OID arrives; other messages are logged and dropped
+ * @param mt Message type (NCI_MT_RSP or NCI_MT_NTF)
+ * @param gid Group ID
+ * @param oid Opcode ID
+ * @param msg Output, the matching message
+ * @param ticks Longest time to wait for each message
+ * @return esp_err_t ESP_OK = received, others = see nci_read
+ */
+esp_err_t nci_wait(uint8_t mt, uint8_t gid, uint8_t oid, struct nci_message *msg, TickType_t ticks)
+{
+    while (1)
+    {
+        esp_err_t err = nci_read(msg, ticks);
+        if (err == ESP_ERR_INVALID_SIZE || err == ESP_ERR_INVALID_RESPONSE)
+        {
+            continue; // Already consumed, keep waiting
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (msg->mt == mt && msg->gid == gid && msg->oid == oid)
+        {
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Unexpected %02X %02X while waiting for %02X %02X", msg->mt | msg->gid, msg->oid, mt | gid, oid);
+        ESP_LOG_BUFFER_HEX(TAG, msg->payload, msg->len);
+    }
+}
+
+/**
+ * @brief Send a command and wait for its response
+ * @param gid Group ID
+ * @param oid Opcode ID
+ * @param payload Command payload, may be NULL when len is 0
+ * @param len Payload length
+ * @param rsp Output, the response (status in payload[0])
+ * @param ticks Longest time to wait for the response
+ * @return esp_err_t ESP_OK = response with NCI_STATUS_OK, ESP_ERR_INVALID_RESPONSE = command rejected,
+ *         others = send or receive failed
+ */
+esp_err_t nci_transceive(uint8_t gid, uint8_t oid, const uint8_t *payload, uint16_t len, struct nci_message *rsp,
+                         TickType_t ticks)
+{
+    esp_err_t err = nci_send(NCI_MT_CMD, gid, oid, payload, len);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nci_wait(NCI_MT_RSP, gid, oid, rsp, ticks);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "No response to %02X %02X (%s)", NCI_MT_CMD | gid, oid, esp_err_to_name(err));
+        return err;
+    }
+    if (rsp->len == 0 || rsp->payload[0] != NCI_STATUS_OK)
+    {
+        ESP_LOGE(TAG, "Command %02X %02X rejected, status %02X", NCI_MT_CMD | gid, oid, rsp->len ? rsp->payload[0] : 0xFF);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Pass a message to the handler registered for its type, GID and OID
+ * @param table Handler table
+ * @param count Number of entries in the table
+ * @param msg Received message
+ * @return true = handled, false = no handler registered
+ */
+bool nci_dispatch(const struct nci_handler_entry *table, size_t count, const struct nci_message *msg)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (table[i].mt == msg->mt && table[i].gid == msg->gid && table[i].oid == msg->oid)
+        {
+            table[i].handler(msg);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,107 @@
+#ifndef PN7160_NCI_H
+#define PN7160_NCI_H
+
+#include <driver/i2c_master.h>
+#include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "app_config.h"
+#include "i2c_bus.h"
+
+#define NCI_HEADER_LEN 3        // Control/data packet header: MT|PBF|GID, OID, payload length
+#define NCI_MAX_PAYLOAD_LEN 255 // Largest payload of a single packet (segment)
+#define NCI_MAX_MESSAGE_LEN 512 // Largest message reassembled from segments (bytes)
+#define NCI_I2C_TIMEOUT_MS 100  // Timeout of a single I2C transfer, and longest wait for the bus (ms)
+
+#define NCI_MT_MASK 0xE0  // Message type bits of the first header byte
+#define NCI_MT_DATA 0x00  // Data packet
+#define NCI_MT_CMD 0x20   // Command packet
+#define NCI_MT_RSP 0x40   // Response packet
+#define NCI_MT_NTF 0x60   // Notification packet
+#define NCI_PBF 0x10      // Packet boundary flag: more segments of this message follow
+#define NCI_GID_MASK 0x0F // Group ID (connection ID for data packets)
+#define NCI_OID_MASK 0x3F // Opcode ID
+
+#define NCI_GID_CORE 0x00        // Core group
+#define NCI_GID_RF 0x01          // RF management group
+#define NCI_GID_PROPRIETARY 0x0F // NXP proprietary group
+
+#define NCI_OID_CORE_RESET 0x00           // CORE_RESET_CMD/RSP/NTF
+#define NCI_OID_CORE_INIT 0x01            // CORE_INIT_CMD/RSP
+#define NCI_OID_CORE_SET_CONFIG 0x02      // CORE_SET_CONFIG_CMD/RSP
+#define NCI_OID_CORE_GENERIC_ERROR 0x07   // CORE_GENERIC_ERROR_NTF
+#define NCI_OID_CORE_INTERFACE_ERROR 0x08 // CORE_INTERFACE_ERROR_NTF
+#define NCI_OID_RF_DISCOVER_MAP 0x00      // RF_DISCOVER_MAP_CMD/RSP
+#define NCI_OID_RF_DISCOVER 0x03          // RF_DISCOVER_CMD/RSP/NTF
+#define NCI_OID_RF_DISCOVER_SELECT 0x04   // RF_DISCOVER_SELECT_CMD/RSP
+#define NCI_OID_RF_INTF_ACTIVATED 0x05    // RF_INTF_ACTIVATED_NTF
+#define NCI_OID_RF_DEACTIVATE 0x06        // RF_DEACTIVATE_CMD/RSP/NTF
+#define NCI_OID_PROP_SET_POWER_MODE 0x00  // NXP proprietary power mode command
+#define NCI_OID_PROP_ACT 0x02             // NXP proprietary activation command
+
+#define NCI_STATUS_OK 0x00                        // Command accepted
+#define NCI_STATUS_REJECTED 0x01                  // Command rejected
+#define NCI_STATUS_SEMANTIC_ERROR 0x06            // Command not allowed in the current RF state
+#define NCI_STATUS_ACTIVATION_FAILED 0xA1         // DISCOVERY_TARGET_ACTIVATION_FAILED
+#define NCI_DISCOVER_NTF_LAST 0x00                // RF_DISCOVER_NTF: last notification
+#define NCI_DISCOVER_NTF_LAST_LIMIT 0x01          // RF_DISCOVER_NTF: last notification, NFCC limit reached
+#define NCI_DISCOVER_NTF_MORE 0x02                // RF_DISCOVER_NTF: more notifications follow
+#define NCI_DEACTIVATE_IDLE 0x00                  // RF_DEACTIVATE_CMD: back to RFST_IDLE
+#define NCI_DEACTIVATE_SLEEP 0x01                 // RF_DEACTIVATE_CMD: put the target to sleep, stay in discovery
+#define NCI_DEACTIVATE_DISCOVERY 0x03             // RF_DEACTIVATE_CMD: release the target and resume polling
+#define NCI_RF_INTERFACE_FRAME 0x01               // Frame RF interface
+#define NCI_NFC_A_PASSIVE_POLL 0x00               // RF technology and mode: NFC-A passive poll
+#define NCI_NFC_B_PASSIVE_POLL 0x01               // RF technology and mode: NFC-B passive poll
+#define NCI_NFC_V_PASSIVE_POLL 0x06               // RF technology and mode: NFC-V passive poll
+#define NCI_PARAM_TOTAL_DURATION 0x00             // CORE_SET_CONFIG: RF discovery period (ms, 2 bytes little-endian)
+#define NCI_PARAM_NXP_EXT 0xA0                    // CORE_SET_CONFIG: first byte of an NXP extension parameter ID
+#define NCI_PARAM_NXP_TAG_DETECTOR_CFG 0x40       // CORE_SET_CONFIG: NXP low-power card detection (A0 40)
+#define NCI_TAG_DETECTOR_DISABLE 0x00             // Low-power card detection off, full polling every period
+#define NCI_TAG_DETECTOR_ENABLE 0x01              // Low-power card detection on, polling only after a field change
+
+// A complete NCI message, reassembled from all of its segments
+struct nci_message
+{
+    uint8_t mt;                            // Message type (NCI_MT_*)
+    uint8_t gid;                           // Group ID (connection ID for data messages)
+    uint8_t oid;                           // Opcode ID (0 for data messages)
+    uint16_t len;                          // Payload length
+    uint8_t payload[NCI_MAX_MESSAGE_LEN];  // Payload
+};
+
+// Handler of a received message, selected by message type, GID and OID
+typedef void (*nci_handler_t)(const struct nci_message *msg);
+
+struct nci_handler_entry
+{
+    uint8_t mt;            // Message type (NCI_MT_*)
+    uint8_t gid;           // Group ID
+    uint8_t oid;           // Opcode ID
+    nci_handler_t handler; // Called for matching messages
+};
+
+extern SemaphoreHandle_t pn7160_semaphore;
+
+// I2C and INT access goes through these so the in-process emulator can stand in for the NFCC
+#if NFC_SIMULATOR
+#define pn7160_i2c_transmit(data, len) pn7160_sim_transmit((data), (len))
+#define pn7160_i2c_receive(buf, len) pn7160_sim_receive((buf), (len))
+#define pn7160_int_level() pn7160_sim_int_level()
+#else
+#define pn7160_i2c_transmit(data, len) i2c_bus_transmit(I2C_BUS_DEVICE_PN7160, (data), (len), NCI_I2C_TIMEOUT_MS)
+#define pn7160_i2c_receive(buf, len) i2c_bus_receive(I2C_BUS_DEVICE_PN7160, (buf), (len), NCI_I2C_TIMEOUT_MS)
+#define pn7160_int_level() gpio_get_level(PN7160_INT_PIN)
+#endif
+
+esp_err_t nci_send(uint8_t mt, uint8_t gid, uint8_t oid, const uint8_t *payload, uint16_t len);
+esp_err_t nci_read(struct nci_message *msg, TickType_t ticks);
+esp_err_t nci_wait(uint8_t mt, uint8_t gid, uint8_t oid, struct nci_message *msg, TickType_t ticks);
+esp_err_t nci_transceive(uint8_t gid, uint8_t oid, const uint8_t *payload, uint16_t len, struct nci_message *rsp,
+                         TickType_t ticks);
+bool nci_dispatch(const struct nci_handler_entry *table, size_t count, const struct nci_message *msg);
+
+#if NFC_SIMULATOR
+#include "pn7160_sim.h"
+#endif
+
+#endif
@@ -0,0 +1,671 @@
+#include "pn7160_i2c.h"
+
+#if NFC_SIMULATOR
+
+static const char *TAG = "pn7160_sim";
+
+#define SIM_PROTOCOL_T2T 0x02         // RF protocol reported for NFC-A cards
+#define SIM_PROTOCOL_ISO_DEP 0x04     // RF protocol reported for NFC-B cards
+#define SIM_PROTOCOL_T5T 0x06         // RF protocol reported for NFC-V cards
+#define SIM_RESET_TRIGGER_CMD 0x02    // CORE_RESET_NTF: reset triggered by CORE_RESET_CMD
+#define SIM_DEACTIVATED_DH 0x00       // RF_DEACTIVATE_NTF reason: DH request
+#define SIM_MAX_PARAMS_LEN 16         // Longest technology specific parameters of an emulated card
+
+// RF states of the emulated NFCC (poll side of the NCI 2.0 RF communication state machine)
+enum sim_rf_state
+{
+    SIM_RFST_IDLE,           // Discovery stopped
+    SIM_RFST_DISCOVERY,      // Polling, cards in the field are reported after the poll period
+    SIM_RFST_W4_HOST_SELECT, // Several cards listed, waiting for RF_DISCOVER_SELECT_CMD
+    SIM_RFST_POLL_ACTIVE,    // A card is active
+};
+
+// A message waiting to be read by the host
+struct sim_packet
+{
+    int64_t readyTime; // INT rises for this message at this time (us)
+    bool signalled;    // INT edge already raised
+    uint16_t length;   // Header and payload length
+    uint8_t data[NCI_HEADER_LEN + NCI_MAX_PAYLOAD_LEN];
+};
+
+// CORE_INIT_RSP: status, features, logical connections, routing table size, control payload, HCI data payload,
+// credits, NFC-V frame size, RF interfaces (frame, ISO-DEP)
+static const uint8_t CORE_INIT_RSP[] = {NCI_STATUS_OK, 0x1A, 0x7E, 0x06, 0x00, 0x01, 0x9C, 0x00, 0xFF, 0xFF, 0x00,
+                                        0x01, 0x00, 0x01, 0x02, 0x01, 0x02};
+
+static struct pn7160_sim_config sim_config = {
+    .responseDelayUs = 500,
+    .activationDelayUs = 3000,
+    .dropCommandEvery = 0,
+};
+
+static struct sim_packet sim_queue[NFC_SIM_QUEUE_LEN]; // Messages for the host, oldest first
+static uint8_t queue_head = 0;                         // Index of the oldest message
+static uint8_t queue_count = 0;                        // Number of queued messages
+static uint16_t read_pos = 0;                          // Bytes of the oldest message already read by the host
+static uint32_t queue_overflows = 0;                   // Messages lost because the queue was full
+static struct pn7160_sim_card field[NFC_SIM_MAX_CARDS]; // Cards in the field
+static uint8_t field_count = 0;                        // Number of cards in the field
+static bool field_tap = false;                         // Cards leave the field once the host releases them
+static enum sim_rf_state rf_state = SIM_RFST_IDLE;
+static uint32_t poll_period_us = PN7160_ACTIVE_POLL_PERIOD_MS * 1000; // From CORE_SET_CONFIG TOTAL_DURATION
+static uint32_t command_count = 0;
+static int64_t release_time = 0;                       // Time the host released the last tapped cards (us)
+static SemaphoreHandle_t release_semaphore = NULL;     // Given when the host releases tapped cards
+static esp_timer_handle_t int_timer = NULL;            // Raises INT when the next message becomes ready
+static SemaphoreHandle_t schedule_mutex = NULL;        // Serialises sim_schedule(), the scan and the timer re-arm belong together
+static portMUX_TYPE sim_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Queue a message for the host, never ready before the message queued ahead of it
+ * @note Called with sim_lock held
+ * @param delayUs Delay before INT rises for it (us)
+ * @param mt Message type (NCI_MT_RSP or NCI_MT_NTF)
+ * @param gid Group ID
+ * @param oid Opcode ID
+ * @param payload Payload
+ * @param len Payload length
+ * @return void
+ */
+static void sim_push(uint32_t delayUs, uint8_t mt, uint8_t gid, uint8_t oid, const uint8_t *payload, uint8_t len)
+{
+    if (queue_count == NFC_SIM_QUEUE_LEN)
+    {
+        queue_overflows++;
+        return;
+    }
+    struct sim_packet *packet = &sim_queue[(queue_head + queue_count) % NFC_SIM_QUEUE_LEN];
+    packet->readyTime = esp_timer_get_time() + delayUs;
+    if (queue_count > 0)
+    {
+        int64_t previous = sim_queue[(queue_head + queue_count - 1) % NFC_SIM_QUEUE_LEN].readyTime;
+        packet->readyTime = packet->readyTime > previous ? packet->readyTime : previous;
+    }
+    packet->signalled = false;
+    packet->data[0] = mt | gid;
+    packet->data[1] = oid;
+    packet->data[2] = len;
+    memcpy(packet->data + NCI_HEADER_LEN, payload, len);
+    packet->length = NCI_HEADER_LEN + len;
+    queue_count++;
+}
+
+/**
+ * @brief Queue a response after the configured response delay
+ * @note Called with sim_lock held
+ */
+static void sim_respond(uint8_t gid, uint8_t oid, const uint8_t *payload, uint8_t len)
+{
+    sim_push(sim_config.responseDelayUs, NCI_MT_RSP, gid, oid, payload, len);
+}
+
+/**
+ * @brief Queue a response carrying only a status
+ * @note Called with sim_lock held
+ */
+static void sim_respond_status(uint8_t gid, uint8_t oid, uint8_t status)
+{
+    sim_respond(gid, oid, &status, 1);
+}
+
+/**
+ * @brief Build the RF technology specific parameters of a card, as parsed by pn7160_parse_uid()
+ * @param card Card
+ * @param params Output, at least SIM_MAX_PARAMS_LEN bytes
+ * @param protocol Output, RF protocol of the card
+ * @return Parameter length
+ */
+static uint8_t sim_card_params(const struct pn7160_sim_card *card, uint8_t *params, uint8_t *protocol)
+{
+    uint8_t len = 0;
+    switch (card->technology)
+    {
+    case NCI_NFC_B_PASSIVE_POLL:
+        *protocol = SIM_PROTOCOL_ISO_DEP;
+        params[len++] = 12; // SENSB_RES: 0x50, NFCID0, application data, protocol info
+        params[len++] = 0x50;
+        memcpy(params + len, card->uid.bytes, 4);
+        len += 4;
+        memset(params + len, 0, 4);
+        len += 4;
+        params[len++] = 0x00;
+        params[len++] = 0x81;
+        params[len++] = 0x71;
+        break;
+    case NCI_NFC_V_PASSIVE_POLL:
+        *protocol = SIM_PROTOCOL_T5T;
+        params[len++] = 0x00; // RES_FLAG
+        params[len++] = 0x00; // DSFID
+        memcpy(params + len, card->uid.bytes, 8);
+        len += 8;
+        break;
+    default:
+        *protocol = SIM_PROTOCOL_T2T;
+        params[len++] = 0x44; // SENS_RES
+        params[len++] = 0x00;
+        params[len++] = card->uid.len;
+        memcpy(params + len, card->uid.bytes, card->uid.len);
+        len += card->uid.len;
+        params[len++] = 0x01; // SEL_RES
+        params[len++] = 0x00;
+        break;
+    }
+    return len;
+}
+
+/**
+ * @brief Activate a card of the field, or report its activation failure
+ * @note Called with sim_lock held
+ * @param index Index in the field, a card that already left fails to activate
+ * @param id RF discovery ID reported for it
+ * @param delayUs Delay before the notification (us)
+ * @return void
+ */
+static void sim_activate(uint8_t index, uint8_t id, uint32_t delayUs)
+{
+    if (index >= field_count || field[index].failActivation)
+    {
+        uint8_t status = NCI_STATUS_ACTIVATION_FAILED;
+        sim_push(delayUs, NCI_MT_NTF, NCI_GID_CORE, NCI_OID_CORE_GENERIC_ERROR, &status, 1);
+        return;
+    }
+    uint8_t ntf[NCI_MAX_PAYLOAD_LEN];
+    uint8_t pos = 0;
+    uint8_t protocol;
+    ntf[pos++] = id;
+    ntf[pos++] = NCI_RF_INTERFACE_FRAME;
+    pos++; // Protocol, known once the parameters are built
+    ntf[pos++] = field[index].technology;
+    ntf[pos++] = 0xFF; // Max data packet payload
+    ntf[pos++] = 0x01; // Initial credits
+    uint8_t len = sim_card_params(&field[index], ntf + pos + 1, &protocol);
+    ntf[2] = protocol;
+    ntf[pos++] = len;
+    pos += len;
+    ntf[pos++] = field[index].technology; // Data exchange technology and mode
+    ntf[pos++] = 0x00;                    // Transmit bit rate
+    ntf[pos++] = 0x00;                    // Receive bit rate
+    ntf[pos++] = 0x00;                    // No activation parameters
+    sim_push(delayUs, NCI_MT_NTF, NCI_GID_RF, NCI_OID_RF_INTF_ACTIVATED, ntf, pos);
+    rf_state = SIM_RFST_POLL_ACTIVE;
+}
+
+/**
+ * @brief Report the cards in the field after one poll period, a single card is activated directly and several are
+ *        listed with RF_DISCOVER_NTF for the host to select
+ * @note Called with sim_lock held. A single card that fails to activate is reported once, until the field changes
+ * @param delayUs Delay before the first notification (us)
+ * @return void
+ */
+static void sim_detect(uint32_t delayUs)
+{
+    if (rf_state != SIM_RFST_DISCOVERY || field_count == 0)
+    {
+        return;
+    }
+    if (field_count == 1)
+    {
+        sim_activate(0, 1, delayUs);
+        return;
+    }
+    for (uint8_t i = 0; i < field_count; i++)
+    {
+        uint8_t ntf[4 + SIM_MAX_PARAMS_LEN + 1];
+        uint8_t protocol;
+        uint8_t len = sim_card_params(&field[i], ntf + 4, &protocol);
+        ntf[0] = i + 1;
+        ntf[1] = protocol;
+        ntf[2] = field[i].technology;
+        ntf[3] = len;
+        ntf[4 + len] = i + 1 < field_count ? NCI_DISCOVER_NTF_MORE : NCI_DISCOVER_NTF_LAST;
+        sim_push(delayUs, NCI_MT_NTF, NCI_GID_RF, NCI_OID_RF_DISCOVER, ntf, 5 + len);
+    }
+    rf_state = SIM_RFST_W4_HOST_SELECT;
+}
+
+/**
+ * @brief The host is done with the tapped cards, they leave the field
+ * @note Called with sim_lock held
+ * @return true = tapped cards released, give release_semaphore
+ */
+static bool sim_release()
+{
+    if (!field_tap)
+    {
+        return false;
+    }
+    field_tap = false;
+    field_count = 0;
+    release_time = esp_timer_get_time();
+    return true;
+}
+
+/**
+ * @brief Apply the poll period of CORE_SET_CONFIG, other parameters are accepted and ignored
+ * @note Payload: [number of parameters][ID][length][value]..., NXP extension IDs take two bytes
+ */
+static void sim_set_config(const uint8_t *payload, uint8_t len)
+{
+    uint8_t pos = 1;
+    for (uint8_t i = 0; len > 0 && i < payload[0] && pos + 2 <= len; i++)
+    {
+        uint8_t id = payload[pos++];
+        if (id == NCI_PARAM_NXP_EXT)
+        {
+            pos++;
+        }
+        if (pos >= len || pos + 1 + payload[pos] > len)
+        {
+            break;
+        }
+        uint8_t valueLen = payload[pos++];
+        if (id == NCI_PARAM_TOTAL_DURATION && valueLen == 2)
+        {
+            poll_period_us = (payload[pos] | payload[pos + 1] << 8) * 1000;
+        }
+        pos += valueLen;
+    }
+}
+
+/**
+ * @brief Execute one command of the host
+ * @note Called with sim_lock held
+ * @return true = tapped cards released by this command
+ */
+static bool sim_handle_command(uint8_t gid, uint8_t oid, const uint8_t *payload, uint8_t len)
+{
+    bool released = false;
+    if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_RESET)
+    {
+        queue_count = 0; // Pending messages are lost with the reset
+        read_pos = 0;
+        rf_state = SIM_RFST_IDLE;
+        sim_respond_status(gid, oid, NCI_STATUS_OK);
+        uint8_t ntf[] = {SIM_RESET_TRIGGER_CMD, len > 0 ? payload[0] : 0x00, 0x20, 0x04, 0x00};
+        sim_push(sim_config.responseDelayUs, NCI_MT_NTF, gid, oid, ntf, sizeof(ntf));
+    }
+    else if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_INIT)
+    {
+        sim_respond(gid, oid, CORE_INIT_RSP, sizeof(CORE_INIT_RSP));
+    }
+    else if (gid == NCI_GID_CORE && oid == NCI_OID_CORE_SET_CONFIG)
+    {
+        sim_set_config(payload, len);
+        uint8_t rsp[2] = {NCI_STATUS_OK, 0x00}; // No invalid parameters
+        sim_respond(gid, oid, rsp, sizeof(rsp));
+    }
+    else if (gid == NCI_GID_PROPRIETARY || (gid == NCI_GID_RF && oid == NCI_OID_RF_DISCOVER_MAP))
+    {
+        sim_respond_status(gid, oid, NCI_STATUS_OK);
+    }
+    else if (gid == NCI_GID_RF && oid == NCI_OID_RF_DISCOVER)
+    {
+        if (rf_state != SIM_RFST_IDLE)
+        {
+            sim_respond_status(gid, oid, NCI_STATUS_SEMANTIC_ERROR);
+            return false;
+        }
+        sim_respond_status(gid, oid, NCI_STATUS_OK);
+        rf_state = SIM_RFST_DISCOVERY;
+        sim_detect(poll_period_us);
+    }
+    else if (gid == NCI_GID_RF && oid == NCI_OID_RF_DISCOVER_SELECT)
+    {
+        if (rf_state != SIM_RFST_W4_HOST_SELECT || len < 1 || payload[0] == 0)
+        {
+            sim_respond_status(gid, oid, NCI_STATUS_SEMANTIC_ERROR);
+            return false;
+        }
+        sim_respond_status(gid, oid, NCI_STATUS_OK);
+        sim_activate(payload[0] - 1, payload[0], sim_config.activationDelayUs);
+    }
+    else if (gid == NCI_GID_RF && oid == NCI_OID_RF_DEACTIVATE)
+    {
+        uint8_t type = len > 0 ? payload[0] : 0xFF;
+        bool active = rf_state == SIM_RFST_POLL_ACTIVE;
+        bool allowed = active ? type == NCI_DEACTIVATE_IDLE || type == NCI_DEACTIVATE_SLEEP || type == NCI_DEACTIVATE_DISCOVERY
+                              : rf_state != SIM_RFST_IDLE && type == NCI_DEACTIVATE_IDLE;
+        if (!allowed)
+        {
+            sim_respond_status(gid, oid, NCI_STATUS_SEMANTIC_ERROR);
+            return false;
+        }
+        sim_respond_status(gid, oid, NCI_STATUS_OK);
+        if (active)
+        {
+            uint8_t ntf[2] = {type, SIM_DEACTIVATED_DH};
+            sim_push(sim_config.responseDelayUs, NCI_MT_NTF, gid, oid, ntf, sizeof(ntf));
+        }
+        if (type != NCI_DEACTIVATE_SLEEP && rf_state != SIM_RFST_DISCOVERY)
+        {
+            released = sim_release(); // End of the tap
+        }
+        rf_state = type == NCI_DEACTIVATE_SLEEP       ? SIM_RFST_W4_HOST_SELECT
+                   : type == NCI_DEACTIVATE_DISCOVERY ? SIM_RFST_DISCOVERY
+                                                      : SIM_RFST_IDLE;
+        sim_detect(poll_period_us);
+    }
+    else
+    {
+        sim_respond_status(gid, oid, NCI_STATUS_REJECTED);
+    }
+    return released;
+}
+
+/**
+ * @brief Raise INT for every message that became ready and re-arm the timer for the next one
+ * @note Runs from pn7160_task, the esp_timer task and the benchmark task. Without schedule_mutex a caller could re-arm
+ *       the timer for a later message after another caller armed it for an earlier one, leaving a ready message
+ *       without an INT edge while the driver waits for one
+ * @return void
+ */
+static void sim_schedule()
+{
+    xSemaphoreTake(schedule_mutex, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    int64_t next = 0;
+    bool raise = false;
+    taskENTER_CRITICAL(&sim_lock);
+    for (uint8_t i = 0; i < queue_count; i++)
+    {
+        struct sim_packet *packet = &sim_queue[(queue_head + i) % NFC_SIM_QUEUE_LEN];
+        if (packet->signalled)
+        {
+            continue;
+        }
+        if (packet->readyTime > now)
+        {
+            next = packet->readyTime;
+            break;
+        }
+        packet->signalled = true;
+        raise = true;
+    }
+    taskEXIT_CRITICAL(&sim_lock);
+    if (raise)
+    {
+        pn7160_sim_int_edge();
+    }
+    if (next != 0)
+    {
+        esp_timer_stop(int_timer); // Not running is fine
+        esp_timer_start_once(int_timer, next - now);
+    }
+    xSemaphoreGive(schedule_mutex);
+}
+
+/**
+ * @brief int_timer callback
+ */
+static void sim_timer_callback(void *arg)
+{
+    sim_schedule();
+}
+
+/**
+ * @brief Start the emulated NFCC, called before the bring-up; cards and configuration survive a restart
+ * @return esp_err_t ESP_OK = running, ESP_FAIL = out of memory
+ */
+esp_err_t pn7160_sim_start()
+{
+    if (int_timer == NULL)
+    {
+        release_semaphore = xSemaphoreCreateBinary();
+        schedule_mutex = xSemaphoreCreateMutex();
+        esp_timer_create_args_t timer_args = {
+            .callback = sim_timer_callback,
+            .name = "pn7160_sim",
+        };
+        if (release_semaphore == NULL || schedule_mutex == NULL || esp_timer_create(&timer_args, &int_timer) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Emulator creation failed");
+            return ESP_FAIL;
+        }
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    queue_count = 0;
+    read_pos = 0;
+    rf_state = SIM_RFST_IDLE;
+    taskEXIT_CRITICAL(&sim_lock);
+    ESP_LOGI(TAG, "Emulated PN7160 powered on");
+    return ESP_OK;
+}
+
+/**
+ * @brief I2C write to the emulated NFCC: one command packet
+ * @param data Packet, header and payload
+ * @param len Packet length
+ * @return esp_err_t ESP_OK = accepted (or silently ignored when dropped), ESP_ERR_INVALID_ARG = not a command packet
+ */
+esp_err_t pn7160_sim_transmit(const uint8_t *data, size_t len)
+{
+    if (len < NCI_HEADER_LEN || len != NCI_HEADER_LEN + data[2] || (data[0] & NCI_MT_MASK) != NCI_MT_CMD)
+    {
+        ESP_LOGE(TAG, "Malformed command packet");
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t gid = data[0] & NCI_GID_MASK;
+    uint8_t oid = data[1] & NCI_OID_MASK;
+    bool released = false;
+    taskENTER_CRITICAL(&sim_lock);
+    bool drop = sim_config.dropCommandEvery != 0 && ++command_count % sim_config.dropCommandEvery == 0;
+    if (!drop)
+    {
+        released = sim_handle_command(gid, oid, data + NCI_HEADER_LEN, data[2]);
+    }
+    taskEXIT_CRITICAL(&sim_lock);
+    if (drop)
+    {
+        ESP_LOGW(TAG, "Command %02X %02X dropped", data[0], data[1]);
+    }
+    if (released)
+    {
+        xSemaphoreGive(release_semaphore);
+    }
+    sim_schedule();
+    return ESP_OK;
+}
+
+/**
+ * @brief I2C read from the emulated NFCC, continues the oldest ready message where the previous read stopped
+ * @param buf Output
+ * @param len Bytes to read, bytes past the end of the message read as 0xFF
+ * @return esp_err_t ESP_OK = read, ESP_FAIL = nothing ready (NACK)
+ */
+esp_err_t pn7160_sim_receive(uint8_t *buf, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+    taskENTER_CRITICAL(&sim_lock);
+    struct sim_packet *packet = &sim_queue[queue_head];
+    if (queue_count == 0 || packet->readyTime > esp_timer_get_time())
+    {
+        ret = ESP_FAIL;
+    }
+    else
+    {
+        size_t n = packet->length - read_pos < len ? packet->length - read_pos : len;
+        memcpy(buf, packet->data + read_pos, n);
+        memset(buf + n, 0xFF, len - n);
+        read_pos += n;
+        if (read_pos >= packet->length)
+        {
+            queue_head = (queue_head + 1) % NFC_SIM_QUEUE_LEN;
+            queue_count--;
+            read_pos = 0;
+        }
+    }
+    taskEXIT_CRITICAL(&sim_lock);
+    return ret;
+}
+
+/**
+ * @brief Level of the emulated INT line: high while a ready message is waiting
+ * @return 1 = message ready, 0 = none
+ */
+int pn7160_sim_int_level()
+{
+    taskENTER_CRITICAL(&sim_lock);
+    int level = queue_count > 0 && sim_queue[queue_head].readyTime <= esp_timer_get_time();
+    taskEXIT_CRITICAL(&sim_lock);
+    return level;
+}
+
+/**
+ * @brief Replace the cards in the field and report them if the emulated NFCC is polling
+ * @param cards Cards, at most NFC_SIM_MAX_CARDS are used
+ * @param count Number of cards, 0 empties the field
+ * @param tap true = the cards leave the field once the host releases them
+ * @return void
+ */
+static void sim_set_field(const struct pn7160_sim_card *cards, uint8_t count, bool tap)
+{
+    count = count < NFC_SIM_MAX_CARDS ? count : NFC_SIM_MAX_CARDS;
+    taskENTER_CRITICAL(&sim_lock);
+    if (count > 0)
+    {
+        memcpy(field, cards, count * sizeof(struct pn7160_sim_card));
+    }
+    field_count = count;
+    field_tap = tap && count > 0;
+    sim_detect(poll_period_us / 2); // Cards arrive half way through a poll period on average
+    taskEXIT_CRITICAL(&sim_lock);
+    sim_schedule();
+}
+
+/**
+ * @brief Hold cards on the reader: they stay in the field until it is changed again
+ * @param cards Cards, at most NFC_SIM_MAX_CARDS are used
+ * @param count Number of cards, 0 empties the field
+ * @return void
+ */
+void pn7160_sim_set_field(const struct pn7160_sim_card *cards, uint8_t count)
+{
+    sim_set_field(cards, count, false);
+}
+
+/**
+ * @brief Tap cards on the reader: they leave the field as soon as the host releases them (deactivates to idle or to
+ *        discovery), the release is reported by pn7160_sim_wait_release()
+ * @param cards Cards, at most NFC_SIM_MAX_CARDS are used
+ * @param count Number of cards
+ * @return void
+ */
+void pn7160_sim_tap(const struct pn7160_sim_card *cards, uint8_t count)
+{
+    xSemaphoreTake(release_semaphore, 0); // Drop a release of an earlier tap
+    sim_set_field(cards, count, true);
+}
+
+/**
+ * @brief Wait until the host releases the tapped cards
+ * @param ticks Longest wait
+ * @param release_time_out Output, time of the release (us)
+ * @return true = released, false = timeout (the cards stay in the field)
+ */
+bool pn7160_sim_wait_release(TickType_t ticks, int64_t *release_time_out)
+{
+    if (xSemaphoreTake(release_semaphore, ticks) != pdTRUE)
+    {
+        return false;
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    *release_time_out = release_time;
+    taskEXIT_CRITICAL(&sim_lock);
+    return true;
+}
+
+/**
+ * @brief Change the behaviour of the emulated NFCC
+ * @param config New behaviour
+ * @return void
+ */
+void pn7160_sim_configure(const struct pn7160_sim_config *config)
+{
+    taskENTER_CRITICAL(&sim_lock);
+    sim_config = *config;
+    command_count = 0;
+    taskEXIT_CRITICAL(&sim_lock);
+}
+
+/**
+ * @brief Card of a benchmark run: NFC-A, NFC-B and NFC-V in turn, with a UID unique to the run
+ * @param value UID value
+ * @param card Output
+ * @return void
+ */
+static void sim_benchmark_card(uint32_t value, struct pn7160_sim_card *card)
+{
+    memset(card, 0, sizeof(*card));
+    card->technology = value % 3 == 0 ? NCI_NFC_A_PASSIVE_POLL : value % 3 == 1 ? NCI_NFC_B_PASSIVE_POLL : NCI_NFC_V_PASSIVE_POLL;
+    card_uid_from_u64(value, &card->uid);
+    if (card->technology == NCI_NFC_V_PASSIVE_POLL)
+    {
+        memmove(card->uid.bytes + 4, card->uid.bytes, 4);
+        card->uid.bytes[0] = 0xE0; // ISO 15693 UID prefix, NXP
+        card->uid.bytes[1] = 0x04;
+        card->uid.bytes[2] = 0x00;
+        card->uid.bytes[3] = 0x00;
+        card->uid.len = 8;
+    }
+}
+
+/**
+ * @brief Tap cards through the real driver and report tap-to-verdict latency and card throughput
+ * @note Run i taps (i % 3) + 1 cards; every fourth multi-card run has a card that fails to activate. Every card is
+ *       new, so each one goes through the card store lookup and the buzzer feedback instead of the debounce.
+ * @param pvParameters Number of taps to run (cast to uint32_t)
+ * @return void
+ */
+void pn7160_sim_benchmark_task(void *pvParameters)
+{
+    uint32_t runs = (uint32_t)pvParameters;
+    struct latency_stats latency;
+    if (latency_stats_init(&latency, runs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Benchmark aborted: out of memory");
+        vTaskDelete(NULL);
+        return;
+    }
+    vTaskDelay(pdMS_TO_TICKS(3000)); // Let the start-up finish
+
+    struct pn7160_tap_stats before, now;
+    pn7160_get_tap_stats(&before);
+    struct pn7160_sim_card cards[3];
+    uint32_t lost = 0;
+    uint32_t cards_read = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        uint8_t count = i % 3 + 1;
+        for (uint8_t j = 0; j < count; j++)
+        {
+            sim_benchmark_card(NFC_SIM_BENCHMARK_UID_BASE + i * 3 + j, &cards[j]);
+        }
+        cards[count - 1].failActivation = count > 1 && i % 4 == 3;
+        int64_t tapped = esp_timer_get_time();
+        int64_t released;
+        pn7160_sim_tap(cards, count);
+        if (!pn7160_sim_wait_release(pdMS_TO_TICKS(NFC_SIM_BENCHMARK_TIMEOUT_MS), &released))
+        {
+            lost++;
+            pn7160_sim_set_field(NULL, 0);
+            continue;
+        }
+        latency_stats_add(&latency, (released - tapped) / 1000);
+        pn7160_get_tap_stats(&now);
+        cards_read += now.lastCardCount;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    pn7160_get_tap_stats(&now);
+
+    latency_stats_report(&latency, TAG, "taps", "tap-to-verdict");
+    uint32_t taps = now.taps - before.taps;
+    ESP_LOGI(TAG, "Benchmark: %" PRIu32 " lost, %" PRIu32 " cards read, %" PRIu32 " skipped, %" PRIu32 " ms driver time per tap, %.2f cards/s, %" PRIu32 " queue overflows",
+             lost, cards_read, now.skippedTargets - before.skippedTargets, taps ? (now.totalTapMs - before.totalTapMs) / taps : 0,
+             elapsed > 0 ? cards_read * 1000000.0 / elapsed : 0.0, queue_overflows);
+    latency_stats_free(&latency);
+    vTaskDelete(NULL);
+}
+
+#endif
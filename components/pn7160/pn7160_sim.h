@@ -0,0 +1,40 @@
+#ifndef PN7160_SIM_H
+#define PN7160_SIM_H
+
+#include "pn7160_nci.h"
+#include "card_store.h"
+#include "latency_stats.h"
+
+#define NFC_SIM_QUEUE_LEN 16                  // Messages the emulated NFCC holds for the host
+#define NFC_SIM_MAX_CARDS 8                   // Cards the emulated field holds at once
+#define NFC_SIM_BENCHMARK_TIMEOUT_MS 3000     // Time a benchmark run waits for the host to release the cards (ms)
+#define NFC_SIM_BENCHMARK_UID_BASE 0xBE000000 // First UID used by the benchmark, not expected in the card store
+
+// Card placed in the emulated field
+struct pn7160_sim_card
+{
+    struct card_uid uid; // UID: 4, 7 or 10 bytes for NFC-A, 4 bytes for NFC-B, 8 bytes for NFC-V
+    uint8_t technology;  // NCI_NFC_A_PASSIVE_POLL, NCI_NFC_B_PASSIVE_POLL or NCI_NFC_V_PASSIVE_POLL
+    bool failActivation; // Activation fails with CORE_GENERIC_ERROR_NTF (DISCOVERY_TARGET_ACTIVATION_FAILED)
+};
+
+// Behaviour of the emulated NFCC, adjustable at run time with pn7160_sim_configure()
+struct pn7160_sim_config
+{
+    uint32_t responseDelayUs;   // Command -> response (us)
+    uint32_t activationDelayUs; // RF_DISCOVER_SELECT_CMD -> activation notification (us)
+    uint16_t dropCommandEvery;  // Ignore every Nth command (no response, the driver times out), 0 = never
+};
+
+esp_err_t pn7160_sim_start();
+esp_err_t pn7160_sim_transmit(const uint8_t *data, size_t len);
+esp_err_t pn7160_sim_receive(uint8_t *buf, size_t len);
+int pn7160_sim_int_level();
+void pn7160_sim_int_edge();
+void pn7160_sim_set_field(const struct pn7160_sim_card *cards, uint8_t count);
+void pn7160_sim_tap(const struct pn7160_sim_card *cards, uint8_t count);
+bool pn7160_sim_wait_release(TickType_t ticks, int64_t *release_time);
+void pn7160_sim_configure(const struct pn7160_sim_config *config);
+void pn7160_sim_benchmark_task(void *pvParameters);
+
+#endif
@@ -17,15 +17,12 @@ extern uint8_t g_input_len;
 extern SemaphoreHandle_t si14tp_semaphore;
 extern SemaphoreHandle_t fingerprint_semaphore;
 extern SemaphoreHandle_t si523_semaphore;
-extern void cancel_current_operation_and_execute_command();
-extern void prepare_turn_off_fingerprint();
+extern void cancel_and_turn_off_fingerprint();
 extern bool g_touch_wakeup_flag;
-extern i2c_master_dev_handle_t pn7160_handle;
-extern SemaphoreHandle_t pn7160_semaphore;
-extern TaskHandle_t pn7160_task_handle;
 
 void notify_user_activity(void);
 esp_err_t sleep_initialization(void);
-extern void pn7160_task(void *arg);
+extern esp_err_t pn7160_enter_low_power();
+extern esp_err_t pn7160_resume(int64_t wake_time);
 
 #endif // SLEEP_H
\ No newline at end of file
@@ -8,84 +8,422 @@ SemaphoreHandle_t fingerprint_semaphore = NULL; // Semaphore for fingerprint mod
 
 static QueueHandle_t uart2_queue; // UART2 event queue
 
+uint8_t g_fingerprint_keep_warm_time = DEFAULT_FINGERPRINT_KEEP_WARM_TIME; // Keep-warm window in seconds
+
+static esp_timer_handle_t keep_warm_timer = NULL; // One-shot timer ending the keep-warm window
+static portMUX_TYPE idle_lock = portMUX_INITIALIZER_UNLOCKED; // Touch, keep-warm timer and operation queue race to leave idle or power on
+
+static struct fingerprint_timing timing = {0}; // Latency measurements of the last verification
+static int64_t touch_time = 0;                 // Time the last touch was detected (us)
+static int64_t power_on_time = 0;              // Time the power control pin was switched on (us)
+static int64_t identify_time = 0;              // Time the identify command was sent (us)
+static bool awaiting_first_response = false;   // Whether the first response to the identify command is pending
+static bool awaiting_power_on = false;         // Whether the 0x55 handshake of a module just powered on is pending
+
+static uint16_t armed_ids[CARD_BOUND_FINGERS_MAX]; // Fingerprint IDs armed by a two-factor card
+static uint8_t armed_count = 0;                    // Number of armed IDs, 0 = not armed
+static int64_t armed_deadline = 0;                 // Time the armed window ends (us)
+static uint16_t bound_ids[CARD_BOUND_FINGERS_MAX]; // Fingerprint IDs the running verification is restricted to
+static uint8_t bound_count = 0;                    // Number of bound IDs, 0 = ordinary 1:N verification
+static uint8_t card_required[FINGERPRINT_CARD_REQUIRED_BYTES]; // Templates that only unlock after their card (bitmap)
+static portMUX_TYPE arm_lock = portMUX_INITIALIZER_UNLOCKED;
+static portMUX_TYPE index_lock = portMUX_INITIALIZER_UNLOCKED; // Bitmap pointer, size and capacity change together on resize
+
+// Steps of a template backup or restore operation
+enum transfer_step
+{
+    TRANSFER_LOAD,     // LoadChar sent, waiting for the template to be loaded into the character buffer
+    TRANSFER_UPLOAD,   // UpChar sent, receiving data packets
+    TRANSFER_DOWNLOAD, // DownChar sent, waiting for the module to accept data packets
+    TRANSFER_STORE,    // Template sent and StoreChar issued, waiting for the storage result
+};
+
+static enum transfer_step transfer_step = TRANSFER_LOAD; // Step of the in-flight backup or restore operation
+static uint32_t transfer_bytes = 0;                     // Template bytes moved by the in-flight transfer
+
+static uint8_t index_page = 0;         // Index table page currently being read
+static bool index_in_doubt = false;     // An operation ended without a result since the index was last read, it may have changed the module
+static bool index_doubt_before = false; // index_in_doubt when the in-flight operation started
+
 static const char *TAG = "zw111";
 
+// UART access goes through these so the in-process simulator can stand in for the module
+#if FINGERPRINT_SIMULATOR
+#define fingerprint_uart_write(data, len) zw111_sim_write((data), (len))
+#define fingerprint_uart_read(buf, len, ticks) zw111_sim_read((buf), (len), (ticks))
+#define fingerprint_uart_buffered_len(size) zw111_sim_buffered_len(size)
+#define fingerprint_uart_pattern_pop_pos() zw111_sim_pattern_pop_pos()
+#define fingerprint_uart_flush_input() zw111_sim_flush_input()
+#else
+#define fingerprint_uart_write(data, len) uart_write_bytes(EX_UART_NUM, (const char *)(data), (len))
+#define fingerprint_uart_read(buf, len, ticks) uart_read_bytes(EX_UART_NUM, (buf), (len), (ticks))
+#define fingerprint_uart_buffered_len(size) uart_get_buffered_data_len(EX_UART_NUM, (size))
+#define fingerprint_uart_pattern_pop_pos() uart_pattern_pop_pos(EX_UART_NUM)
+#define fingerprint_uart_flush_input() uart_flush_input(EX_UART_NUM)
+#endif
+
+/**
+ * Command descriptor table
+ * Command code and parameter length are fixed per command, so the frame layout of every command is known at
+ * compile time and only the parameter bytes vary between calls.
+ */
+enum command_index
+{
+    CMD_INDEX_AUTO_ENROLL,
+    CMD_INDEX_AUTO_IDENTIFY,
+    CMD_INDEX_CONTROL_LED,
+    CMD_INDEX_CONTROL_COLORFUL_LED,
+    CMD_INDEX_DELETE_CHAR,
+    CMD_INDEX_EMPTY,
+    CMD_INDEX_CANCEL,
+    CMD_INDEX_SLEEP,
+    CMD_INDEX_READ_INDEX_TABLE,
+    CMD_INDEX_READ_SYS_PARA,
+    CMD_INDEX_STORE_CHAR,
+    CMD_INDEX_LOAD_CHAR,
+    CMD_INDEX_UP_CHAR,
+    CMD_INDEX_DOWN_CHAR,
+    CMD_INDEX_COUNT
+};
+
+struct command_descriptor
+{
+    uint8_t code;     // Command code
+    uint8_t paramLen; // Number of parameter bytes following the command code
+    const char *name; // Command name used in log messages
+};
+
+static const struct command_descriptor command_table[CMD_INDEX_COUNT] = {
+    [CMD_INDEX_AUTO_ENROLL] = {CMD_AUTO_ENROLL, 5, "Auto-enrollment"},
+    [CMD_INDEX_AUTO_IDENTIFY] = {CMD_AUTO_IDENTIFY, 5, "Auto-identification"},
+    [CMD_INDEX_CONTROL_LED] = {CMD_CONTROL_BLN, 4, "LED control"},
+    [CMD_INDEX_CONTROL_COLORFUL_LED] = {CMD_CONTROL_BLN, 5, "Colorful light control"},
+    [CMD_INDEX_DELETE_CHAR] = {CMD_DELET_CHAR, 4, "Fingerprint deletion"},
+    [CMD_INDEX_EMPTY] = {CMD_EMPTY, 0, "Clear all fingerprints"},
+    [CMD_INDEX_CANCEL] = {CMD_CANCEL, 0, "Cancel operation"},
+    [CMD_INDEX_SLEEP] = {CMD_SLEEP, 0, "Sleep"},
+    [CMD_INDEX_READ_INDEX_TABLE] = {CMD_READ_INDEX_TABLE, 1, "Read index table"},
+    [CMD_INDEX_READ_SYS_PARA] = {CMD_READ_SYS_PARA, 0, "Read system parameters"},
+    [CMD_INDEX_STORE_CHAR] = {CMD_STORE_CHAR, 3, "Store template"},
+    [CMD_INDEX_LOAD_CHAR] = {CMD_LOAD_CHAR, 3, "Load template"},
+    [CMD_INDEX_UP_CHAR] = {CMD_UP_CHAR, 1, "Upload template"},
+    [CMD_INDEX_DOWN_CHAR] = {CMD_DOWN_CHAR, 1, "Download template"},
+};
+
+// A single command waiting to be encoded: table index plus its parameter bytes
+struct command_request
+{
+    uint8_t index;                    // Index into command_table
+    uint8_t param[CMD_MAX_PARAM_LEN]; // Parameter bytes (only the first paramLen bytes are sent)
+};
+
+// Commands collected to go out in a single UART write
+struct command_batch
+{
+    struct command_request requests[CMD_BATCH_MAX];
+    uint8_t count;
+};
+
+/**
+ * @brief Encode a command frame in a single pass (header, address, identifier, length, payload and checksum)
+ * @param out Output buffer, must hold at least CMD_FRAME_MAX_LEN bytes
+ * @param request Command to encode
+ * @return uint16_t Number of bytes written
+ */
+static uint16_t encode_command(uint8_t *out, const struct command_request *request)
+{
+    const struct command_descriptor *desc = &command_table[request->index];
+    uint16_t dataLen = 1 + desc->paramLen + CHECKSUM_LEN; // Command code + parameters + checksum
+    uint16_t pos = 0;
+    out[pos++] = FRAME_HEADER[0];
+    out[pos++] = FRAME_HEADER[1];
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        out[pos++] = zw111.deviceAddress[i];
+    }
+    // Checksum is accumulated while the bytes from the packet identifier onwards are written
+    uint16_t checksum = PACKET_CMD + (dataLen >> 8) + (dataLen & 0xFF) + desc->code;
+    out[pos++] = PACKET_CMD;
+    out[pos++] = (uint8_t)(dataLen >> 8);
+    out[pos++] = (uint8_t)dataLen;
+    out[pos++] = desc->code;
+    for (uint8_t i = 0; i < desc->paramLen; i++)
+    {
+        out[pos++] = request->param[i];
+        checksum += request->param[i];
+    }
+    out[pos++] = (uint8_t)(checksum >> 8);
+    out[pos++] = (uint8_t)checksum;
+    return pos;
+}
+
 /**
- * @brief Calculate the checksum of the data frame
- * @param receive_data Data frame buffer
- * @param data_length Total length of the data frame
- * @return uint16_t Calculated 16-bit checksum (high byte first), returns 0 if parameters are invalid
+ * @brief Encode one or more commands back to back and hand them to the UART driver in one write
+ * @param requests Commands to send, in order
+ * @param count Number of commands (1-CMD_BATCH_MAX)
+ * @return esp_err_t Operation result: ESP_OK = commands sent successfully, ESP_FAIL = command sent failed
  */
-static uint16_t calculate_checksum(const uint8_t *receive_data, uint16_t data_length)
+static esp_err_t send_commands(const struct command_request *requests, uint8_t count)
 {
-    uint16_t checksum = 0;
-    uint8_t checksumEndIndex = data_length - CHECKSUM_LEN - 1; // Index of the byte before checksum field
-    // Accumulation range for checksum: from CHECKSUM_START_INDEX to checksumEndIndex
-    for (uint8_t i = CHECKSUM_START_INDEX; i <= checksumEndIndex; i++)
+    uint8_t buffer[CMD_BATCH_MAX * CMD_FRAME_MAX_LEN];
+    if (count == 0 || count > CMD_BATCH_MAX)
+    {
+        ESP_LOGE(TAG, "Sending failed: Invalid command count (1-%u required, current %u)", CMD_BATCH_MAX, count);
+        return ESP_FAIL;
+    }
+    size_t total = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        total += encode_command(buffer + total, &requests[i]);
+    }
+
+    // Send command via UART
+    int len = fingerprint_uart_write(buffer, total);
+    if (len == total)
     {
-        checksum += receive_data[i];
+        // Send succeeded
+        for (uint8_t i = 0; i < count; i++)
+        {
+            ESP_LOGI(TAG, "%s command sent successfully", command_table[requests[i].index].name);
+        }
+        return ESP_OK;
+    }
+    else
+    {
+        // Send failed
+        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
+        return ESP_FAIL;
     }
-    return (checksum & 0xFFFF);
 }
 
 /**
- * @brief Verify the validity of received data from fingerprint module
- * @param receive_data Received data packet buffer
- * @param data_length Actual number of received bytes
- * @return esp_err_t Verification result: ESP_OK = valid data, ESP_FAIL = invalid data
+ * @brief Send a command immediately, or append it to a batch to be sent later with flush_command_batch()
+ * @param batch Batch to append to, NULL = send immediately
+ * @param request Command to send
+ * @return esp_err_t Operation result: ESP_OK = command sent or queued, ESP_FAIL = batch full or command sent failed
  */
-static esp_err_t verify_received_data(const uint8_t *receive_data, uint16_t data_length)
+static esp_err_t submit_command(struct command_batch *batch, const struct command_request *request)
 {
-    // Basic validity check
-    if (receive_data == NULL || data_length < 12)
+    if (batch == NULL)
+    {
+        return send_commands(request, 1);
+    }
+    if (batch->count >= CMD_BATCH_MAX)
     {
-        ESP_LOGE(TAG, "Verification failed: Data is null or length insufficient (min 9 bytes required, actual %u)", data_length);
+        ESP_LOGE(TAG, "Command batch full, %s command dropped", command_table[request->index].name);
         return ESP_FAIL;
     }
-    // Verify data length
-    uint16_t expectedDataLen = (receive_data[7] << 8) | receive_data[8]; // Data field length
-    if (expectedDataLen + 9 != data_length)
+    batch->requests[batch->count++] = *request;
+    return ESP_OK;
+}
+
+/**
+ * @brief Send all commands collected in a batch with a single UART write
+ * @param batch Batch to send, emptied afterwards
+ * @return esp_err_t Operation result: ESP_OK = commands sent successfully, ESP_FAIL = command sent failed
+ */
+static esp_err_t flush_command_batch(struct command_batch *batch)
+{
+    esp_err_t ret = send_commands(batch->requests, batch->count);
+    batch->count = 0;
+    return ret;
+}
+
+/**
+ * @brief Send one data packet of a template download
+ * @param pid Packet identifier: PACKET_DATA_MORE, or PACKET_DATA_LAST for the final packet
+ * @param data Packet payload
+ * @param len Payload length (at most FINGERPRINT_MAX_PACKET_SIZE)
+ * @return esp_err_t Operation result: ESP_OK = packet sent successfully, ESP_FAIL = packet sent failed
+ */
+static esp_err_t send_data_packet(uint8_t pid, const uint8_t *data, uint16_t len)
+{
+    static uint8_t buffer[FRAME_HEADER_LEN + FINGERPRINT_MAX_PACKET_SIZE + CHECKSUM_LEN];
+    if (len > FINGERPRINT_MAX_PACKET_SIZE)
     {
-        ESP_LOGE(TAG, "Verification failed: Length mismatch (expected total length %u, actual %u)", 9 + expectedDataLen, data_length);
+        ESP_LOGE(TAG, "Sending failed: Data packet too long (%u bytes)", len);
         return ESP_FAIL;
     }
-    // Verify frame header
-    if (receive_data[0] != FRAME_HEADER[0] || receive_data[1] != FRAME_HEADER[1])
+    uint16_t dataLen = len + CHECKSUM_LEN;
+    uint16_t pos = 0;
+    buffer[pos++] = FRAME_HEADER[0];
+    buffer[pos++] = FRAME_HEADER[1];
+    for (uint8_t i = 0; i < 4; i++)
     {
-        ESP_LOGE(TAG, "Verification failed: Frame header mismatch (expected %02X%02X, actual %02X%02X)", FRAME_HEADER[0], FRAME_HEADER[1], receive_data[0], receive_data[1]);
+        buffer[pos++] = zw111.deviceAddress[i];
+    }
+    uint16_t checksum = pid + (dataLen >> 8) + (dataLen & 0xFF);
+    buffer[pos++] = pid;
+    buffer[pos++] = (uint8_t)(dataLen >> 8);
+    buffer[pos++] = (uint8_t)dataLen;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        buffer[pos++] = data[i];
+        checksum += data[i];
+    }
+    buffer[pos++] = (uint8_t)(checksum >> 8);
+    buffer[pos++] = (uint8_t)checksum;
+    // Blocks while the UART TX buffer is full, so packets leave at line rate without being dropped
+    int written = fingerprint_uart_write(buffer, pos);
+    if (written != pos)
+    {
+        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", written);
         return ESP_FAIL;
     }
-    // Verify device address
-    for (int i = 2; i < 6; i++)
+    return ESP_OK;
+}
+
+/**
+ * Streaming frame reassembler state
+ * Bytes are appended as the UART driver delivers them and validated one at a time, so a frame split over several
+ * UART_DATA events or several frames coalesced into one event are handled the same way.
+ */
+static struct
+{
+    uint8_t frame[FRAME_MAX_LEN]; // Frame being assembled, always starts at a header candidate
+    uint16_t length;              // Number of bytes currently held in frame
+    uint16_t checked;             // Number of bytes already validated
+    uint16_t expected;            // Total frame length once the length field is known, 0 before that
+    uint16_t checksum;            // Running checksum from packet identifier to the end of the data field
+    uint8_t complete[FRAME_MAX_LEN]; // Last complete frame, handed to the handler while the next one is assembled
+} rx_frame;
+
+static void fingerprint_handle_frame(const uint8_t *receive_data, uint16_t length);
+
+/**
+ * @brief Reset the frame reassembler, discarding any partially received frame
+ * @return void
+ */
+static void fingerprint_reset_reassembler()
+{
+    rx_frame.length = 0;
+    rx_frame.checked = 0;
+    rx_frame.expected = 0;
+    rx_frame.checksum = 0;
+}
+
+/**
+ * @brief Validate the bytes received since the last call
+ * @return esp_err_t ESP_OK = a complete valid frame is held, ESP_ERR_NOT_FINISHED = more bytes needed, ESP_FAIL = invalid frame
+ */
+static esp_err_t fingerprint_check_frame()
+{
+    while (rx_frame.checked < rx_frame.length)
     {
-        if (receive_data[i] != zw111.deviceAddress[i - 2])
+        uint16_t i = rx_frame.checked;
+        uint8_t byte = rx_frame.frame[i];
+        if (i < 2) // Frame header, mismatches are line noise and dropped silently
         {
-            ESP_LOGE(TAG, "Verification failed: Device address mismatch (expected %02X%02X%02X%02X, actual %02X%02X%02X%02X)",
-                     zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3],
-                     receive_data[2], receive_data[3], receive_data[4], receive_data[5]);
-            return ESP_FAIL;
+            if (byte != FRAME_HEADER[i])
+            {
+                return ESP_FAIL;
+            }
+        }
+        else if (i < CHECKSUM_START_INDEX) // Device address
+        {
+            if (byte != zw111.deviceAddress[i - 2])
+            {
+                ESP_LOGE(TAG, "Frame discarded: Device address mismatch at byte %u (expected %02X, actual %02X)", i, zw111.deviceAddress[i - 2], byte);
+                return ESP_FAIL;
+            }
+        }
+        else if (i < FRAME_HEADER_LEN) // Packet identifier and length field
+        {
+            rx_frame.checksum += byte;
+            if (i == FRAME_HEADER_LEN - 1)
+            {
+                uint16_t dataLen = (rx_frame.frame[7] << 8) | byte; // Data field length (including checksum)
+                if (dataLen < CHECKSUM_LEN || FRAME_HEADER_LEN + dataLen > FRAME_MAX_LEN)
+                {
+                    ESP_LOGE(TAG, "Frame discarded: Invalid length field %u", dataLen);
+                    timing.droppedFrames++;
+                    return ESP_FAIL;
+                }
+                rx_frame.expected = FRAME_HEADER_LEN + dataLen;
+            }
+        }
+        else if (i < rx_frame.expected - CHECKSUM_LEN) // Data field
+        {
+            rx_frame.checksum += byte;
+        }
+        else if (i == rx_frame.expected - 1) // Last checksum byte
+        {
+            rx_frame.checked++;
+            uint16_t receivedChecksum = (rx_frame.frame[i - 1] << 8) | byte;
+            if (rx_frame.checksum != receivedChecksum)
+            {
+                ESP_LOGE(TAG, "Frame discarded: Checksum mismatch (expected 0x%04X, actual 0x%04X)", rx_frame.checksum, receivedChecksum);
+                timing.droppedFrames++;
+                return ESP_FAIL;
+            }
+            return ESP_OK;
         }
+        rx_frame.checked++;
     }
-    // Verify packet identifier
-    if (receive_data[6] != PACKET_RESPONSE)
+    return ESP_ERR_NOT_FINISHED;
+}
+
+/**
+ * @brief Drop the current header candidate and restart from the next possible header byte
+ * @note Bytes after the false start are kept and re-validated, so a real frame hidden behind garbage is not lost
+ * @return void
+ */
+static void fingerprint_resync()
+{
+    uint16_t start = 1;
+    while (start < rx_frame.length && rx_frame.frame[start] != FRAME_HEADER[0])
     {
-        ESP_LOGE(TAG, "Verification failed: Incorrect packet identifier (expected response packet %02X, actual %02X)", PACKET_RESPONSE, receive_data[6]);
-        return ESP_FAIL;
+        start++;
     }
-    // Verify checksum
-    uint16_t receivedChecksum = (receive_data[data_length - 2] << 8) | receive_data[data_length - 1];
-    if (calculate_checksum(receive_data, data_length) != receivedChecksum)
+    rx_frame.length -= start;
+    memmove(rx_frame.frame, rx_frame.frame + start, rx_frame.length);
+    rx_frame.checked = 0;
+    rx_frame.expected = 0;
+    rx_frame.checksum = 0;
+}
+
+/**
+ * @brief Feed raw bytes from the UART into the frame reassembler
+ * @note Every complete frame is passed to fingerprint_handle_frame() as soon as its last byte arrives,
+ *       regardless of how the driver chunked the stream
+ * @param data Received bytes
+ * @param size Number of received bytes
+ * @return void
+ */
+static void fingerprint_feed_bytes(const uint8_t *data, size_t size)
+{
+    for (size_t n = 0; n < size; n++)
     {
-        ESP_LOGE(TAG, "Verification failed: Checksum mismatch (expected 0x%04X, actual 0x%04X)", calculate_checksum(receive_data, data_length), receivedChecksum);
-        return ESP_FAIL;
+        rx_frame.frame[rx_frame.length++] = data[n];
+        while (rx_frame.length > 0)
+        {
+            esp_err_t ret = fingerprint_check_frame();
+            if (ret == ESP_ERR_NOT_FINISHED)
+            {
+                break; // Wait for more bytes
+            }
+            if (ret == ESP_OK)
+            {
+                // Bytes kept by a resync may already hold the start of the next frame, move them to the front
+                uint16_t length = rx_frame.expected;
+                memcpy(rx_frame.complete, rx_frame.frame, length);
+                rx_frame.length -= length;
+                memmove(rx_frame.frame, rx_frame.frame + length, rx_frame.length);
+                rx_frame.checked = 0;
+                rx_frame.expected = 0;
+                rx_frame.checksum = 0;
+                fingerprint_handle_frame(rx_frame.complete, length);
+                continue; // Validate the remaining bytes
+            }
+            fingerprint_resync(); // Invalid frame, rescan remaining bytes
+        }
     }
-    ESP_LOGI(TAG, "Verification succeeded: Data is valid");
-    return ESP_OK;
 }
 
 /**
  * @brief Auto-enrollment function for fingerprint module
- * @param ID Fingerprint ID (0-99, returns failure if out of range)
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param ID Fingerprint ID (0 to capacity-1, returns failure if out of range)
  * @param enrollTimes Enrollment times (2-255, returns failure if out of range)
  * @param ledControl Image capture backlight control: false = always on; true = off after successful capture
  * @param preprocess Image capture preprocessing control: false = no preprocessing; true = enable preprocessing
@@ -95,12 +433,12 @@ static esp_err_t verify_received_data(const uint8_t *receive_data, uint16_t data
  * @param requireRemove Finger removal requirement: false = need to remove; true = no need to remove
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
  */
-static esp_err_t auto_enroll(uint16_t ID, uint8_t enrollTimes, bool ledControl, bool preprocess, bool returnStatus, bool allowOverwrite, bool allowDuplicate, bool requireRemove)
+static esp_err_t auto_enroll(struct command_batch *batch, uint16_t ID, uint8_t enrollTimes, bool ledControl, bool preprocess, bool returnStatus, bool allowOverwrite, bool allowDuplicate, bool requireRemove)
 {
     // Check ID validity
-    if (ID >= 100)
+    if (ID >= zw111.capacity)
     {
-        ESP_LOGE(TAG, "Enrollment failed: ID out of range (0-99 required, current %u)", ID);
+        ESP_LOGE(TAG, "Enrollment failed: ID out of range (0-%u required, current %u)", zw111.capacity - 1, ID);
         return ESP_FAIL;
     }
     // Check enrollment times validity
@@ -117,49 +455,27 @@ static esp_err_t auto_enroll(uint16_t ID, uint8_t enrollTimes, bool ledControl,
     param |= (allowOverwrite ? 1 << 3 : 0); // bit3: ID overwrite control
     param |= (allowDuplicate ? 1 << 4 : 0); // bit4: Duplicate enrollment control
     param |= (requireRemove ? 1 << 5 : 0);  // bit5: Finger removal control
-    // Construct data frame
-    uint8_t frame[17] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x08,                                                                                     // Data length (2 bytes, fixed 8 bytes)
-        CMD_AUTO_ENROLL,                                                                                // Command code (1 byte)
-        (uint8_t)(ID >> 8), (uint8_t)ID,                                                                // Fingerprint ID (2 bytes, high byte first)
-        enrollTimes,                                                                                    // Enrollment times (1 byte)
-        (uint8_t)(param >> 8), (uint8_t)param,                                                          // Control parameters (2 bytes, high byte first)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[15] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[16] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Auto-enrollment command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {
+        .index = CMD_INDEX_AUTO_ENROLL,
+        .param = {
+            (uint8_t)(ID >> 8), (uint8_t)ID,       // Fingerprint ID (2 bytes, high byte first)
+            enrollTimes,                           // Enrollment times (1 byte)
+            (uint8_t)(param >> 8), (uint8_t)param, // Control parameters (2 bytes, high byte first)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Auto-identification function for fingerprint module
- * @param ID Fingerprint ID: specific value (0-99) = verify specified ID; 0xFFFF = verify all enrolled fingerprints
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param ID Fingerprint ID: specific value (0 to capacity-1) = verify specified ID; 0xFFFF = verify all enrolled fingerprints
  * @param scoreLevel Matching score level (1-5, higher level = stricter matching, default recommended 2)
  * @param ledControl Image capture backlight control: false = always on; true = off after successful capture
  * @param preprocess Image capture preprocessing control: false = no preprocessing; true = enable preprocessing
  * @param returnStatus Identification status return control: false = return status; true = no status return
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
  */
-static esp_err_t auto_identify(uint16_t ID, uint8_t scoreLevel, bool ledControl, bool preprocess, bool returnStatus)
+static esp_err_t auto_identify(struct command_batch *batch, uint16_t ID, uint8_t scoreLevel, bool ledControl, bool preprocess, bool returnStatus)
 {
     if (scoreLevel < 1 || scoreLevel > 5)
     {
@@ -171,48 +487,26 @@ static esp_err_t auto_identify(uint16_t ID, uint8_t scoreLevel, bool ledControl,
     param |= (ledControl ? 1 << 0 : 0);   // bit0: Backlight control
     param |= (preprocess ? 1 << 1 : 0);   // bit1: Preprocessing control
     param |= (returnStatus ? 1 << 2 : 0); // bit2: Status return control
-    // Construct data frame
-    uint8_t frame[17] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x08,                                                                                     // Data length (2 bytes, fixed 8 bytes)
-        CMD_AUTO_IDENTIFY,                                                                              // Command code (1 byte)
-        scoreLevel,                                                                                     // Score level (1 byte)
-        (uint8_t)(ID >> 8), (uint8_t)ID,                                                                // Fingerprint ID (2 bytes, high byte first)
-        (uint8_t)(param >> 8), (uint8_t)param,                                                          // Control parameters (2 bytes, high byte first)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[15] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[16] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Auto-identification command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {
+        .index = CMD_INDEX_AUTO_IDENTIFY,
+        .param = {
+            scoreLevel,                            // Score level (1 byte)
+            (uint8_t)(ID >> 8), (uint8_t)ID,       // Fingerprint ID (2 bytes, high byte first)
+            (uint8_t)(param >> 8), (uint8_t)param, // Control parameters (2 bytes, high byte first)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief LED control function for fingerprint module (supports breathing, flashing, on/off modes)
+ * @param batch Batch to append the command to, NULL = send immediately
  * @param functionCode Function code (1-6, refer to BLN_xxx macros, e.g., BLN_BREATH = breathing light)
  * @param startColor Start color (bit0-Blue, bit1-Green, bit2-Red, refer to LED_xxx macros)
  * @param endColor End color (only valid for function code 1 - breathing light, ignored for other modes)
  * @param cycleTimes Cycle times (only valid for function code 1-breathing/2-flashing, 0 = infinite cycle)
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
  */
-static esp_err_t control_led(uint8_t functionCode, uint8_t startColor, uint8_t endColor, uint8_t cycleTimes)
+static esp_err_t control_led(struct command_batch *batch, uint8_t functionCode, uint8_t startColor, uint8_t endColor, uint8_t cycleTimes)
 {
     // Parameter validity check
     if (functionCode < BLN_BREATH || functionCode > BLN_FADE_OUT)
@@ -231,48 +525,26 @@ static esp_err_t control_led(uint8_t functionCode, uint8_t startColor, uint8_t e
         ESP_LOGE(TAG, "LED control warning: Only lower 3 bits of end color are valid, filtered to 0x%02X\n", endColor & 0x07);
         endColor &= 0x07;
     }
-    // Construct data frame
-    uint8_t frame[16] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x07,                                                                                     // Data length (2 bytes, fixed 7 bytes)
-        CMD_CONTROL_BLN,                                                                                // Command code (1 byte)
-        functionCode,                                                                                   // Function code (1 byte)
-        startColor,                                                                                     // Start color (1 byte)
-        endColor,                                                                                       // End color (1 byte)
-        cycleTimes,                                                                                     // Cycle times (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[14] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[15] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "LED control command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {
+        .index = CMD_INDEX_CONTROL_LED,
+        .param = {
+            functionCode, // Function code (1 byte)
+            startColor,   // Start color (1 byte)
+            endColor,     // End color (1 byte)
+            cycleTimes,   // Cycle times (1 byte)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Colorful running light control function for fingerprint module (7-color cycle mode)
+ * @param batch Batch to append the command to, NULL = send immediately
  * @param startColor Start color configuration (refer to LED_xxx macros, only lower 3 bits valid)
  * @param timeBit Breathing cycle time parameter (1-100, corresponding to 0.1s-10s)
  * @param cycleTimes Cycle times (0 = infinite cycle)
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
  */
-static esp_err_t control_colorful_led(uint8_t startColor, uint8_t timeBit, uint8_t cycleTimes)
+static esp_err_t control_colorful_led(struct command_batch *batch, uint8_t startColor, uint8_t timeBit, uint8_t cycleTimes)
 {
     // Parameter validity check
     if (timeBit < 1 || timeBit > 100)
@@ -286,372 +558,471 @@ static esp_err_t control_colorful_led(uint8_t startColor, uint8_t timeBit, uint8
         ESP_LOGE(TAG, "Colorful light control failed: Only lower 3 bits of start color are valid, filtered to 0x%02X\n", startColor & 0x07);
         startColor &= 0x07;
     }
-    // Construct data frame
-    uint8_t frame[17] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x08,                                                                                     // Data length (2 bytes, fixed 8 bytes)
-        CMD_CONTROL_BLN,                                                                                // Command code (1 byte)
-        BLN_COLORFUL,                                                                                   // Function code (1 byte, colorful mode)
-        startColor,                                                                                     // Start color (1 byte)
-        0x11,                                                                                           // Fixed duty cycle value
-        cycleTimes,                                                                                     // Cycle times (1 byte)
-        timeBit,                                                                                        // Cycle time parameter (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[15] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[16] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Colorful light control command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {
+        .index = CMD_INDEX_CONTROL_COLORFUL_LED,
+        .param = {
+            BLN_COLORFUL, // Function code (1 byte, colorful mode)
+            startColor,   // Start color (1 byte)
+            0x11,         // Fixed duty cycle value
+            cycleTimes,   // Cycle times (1 byte)
+            timeBit,      // Cycle time parameter (1 byte)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Delete specified number of fingerprints (delete continuously from specified ID)
- * @param ID Start fingerprint ID (0-99, returns failure if out of range)
- * @param count Number of fingerprints to delete (1-100, must not exceed ID range)
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param ID Start fingerprint ID (0 to capacity-1, returns failure if out of range)
+ * @param count Number of fingerprints to delete (1 to capacity, must not exceed ID range)
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
  */
-static esp_err_t delete_char(uint16_t ID, uint16_t count)
+static esp_err_t delete_char(struct command_batch *batch, uint16_t ID, uint16_t count)
 {
     // Parameter validity check
-    if (ID >= 100)
+    if (ID >= zw111.capacity)
     {
         // ID out of range
-        ESP_LOGE(TAG, "Deletion failed: Start ID out of range (0-99 required, current %u)", ID);
+        ESP_LOGE(TAG, "Deletion failed: Start ID out of range (0-%u required, current %u)", zw111.capacity - 1, ID);
         return ESP_FAIL;
     }
-    if (count == 0 || count > 100 || (ID + count) > 100)
+    if (count == 0 || count > zw111.capacity || (ID + count) > zw111.capacity)
     {
-        ESP_LOGE(TAG, "Deletion failed: Invalid count (1-100 required and no exceed ID range, current count %u)", count);
+        ESP_LOGE(TAG, "Deletion failed: Invalid count (1-%u required and no exceed ID range, current count %u)", zw111.capacity, count);
         // Invalid count or exceed ID range
         return ESP_FAIL;
     }
-    // Construct data frame
-    uint8_t frame[16] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x07,                                                                                     // Data length (2 bytes, fixed 7 bytes)
-        CMD_DELET_CHAR,                                                                                 // Command code (1 byte)
-        (uint8_t)(ID >> 8), (uint8_t)ID,                                                                // Start ID (2 bytes, high byte first)
-        (uint8_t)(count >> 8), (uint8_t)count,                                                          // Delete count (2 bytes, high byte first)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[14] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[15] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Fingerprint deletion command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {
+        .index = CMD_INDEX_DELETE_CHAR,
+        .param = {
+            (uint8_t)(ID >> 8), (uint8_t)ID,       // Start ID (2 bytes, high byte first)
+            (uint8_t)(count >> 8), (uint8_t)count, // Delete count (2 bytes, high byte first)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Clear all enrolled fingerprints in the module
+ * @param batch Batch to append the command to, NULL = send immediately
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
  */
-static esp_err_t empty()
+static esp_err_t empty(struct command_batch *batch)
 {
-    // Construct data frame
-    uint8_t frame[12] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x03,                                                                                     // Data length (2 bytes)
-        CMD_EMPTY,                                                                                      // Command code (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[10] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[11] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Clear all fingerprints command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {.index = CMD_INDEX_EMPTY};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Cancel the current operation of the module (e.g., enrollment, identification)
+ * @param batch Batch to append the command to, NULL = send immediately
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
  */
-static esp_err_t cancel()
+static esp_err_t cancel(struct command_batch *batch)
 {
-    // Construct data frame
-    uint8_t frame[12] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x03,                                                                                     // Data length (2 bytes)
-        CMD_CANCEL,                                                                                     // Command code (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[10] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[11] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Cancel operation command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {.index = CMD_INDEX_CANCEL};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Control the module to enter sleep mode
+ * @param batch Batch to append the command to, NULL = send immediately
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
  */
-static esp_err_t sleep()
+static esp_err_t sleep(struct command_batch *batch)
 {
-    // Construct data frame
-    uint8_t frame[12] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x03,                                                                                     // Data length (2 bytes)
-        CMD_SLEEP,                                                                                      // Command code (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[10] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[11] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
-
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
-    {
-        // Send succeeded
-        ESP_LOGI(TAG, "Sleep command sent successfully");
-        return ESP_OK;
-    }
-    else
-    {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
-        return ESP_FAIL;
-    }
+    struct command_request request = {.index = CMD_INDEX_SLEEP};
+    return submit_command(batch, &request);
 }
 
 /**
  * @brief Read fingerprint index table from the module (get enrolled fingerprint IDs)
- * @param page Page number (0-4, each page corresponds to 20 fingerprints, total 100)
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param page Page number (each page covers FINGERPRINT_INDEX_PAGE_IDS IDs, pages beyond the capacity are rejected)
  * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
  */
-static esp_err_t read_index_table(uint8_t page)
+static esp_err_t read_index_table(struct command_batch *batch, uint8_t page)
 {
     // Parameter validity check
-    if (page > 4)
+    uint8_t pages = (zw111.capacity + FINGERPRINT_INDEX_PAGE_IDS - 1) / FINGERPRINT_INDEX_PAGE_IDS;
+    if (page >= pages)
     {
-        ESP_LOGE(TAG, "Invalid page number (0-4 required, current %u)", page);
+        ESP_LOGE(TAG, "Invalid page number (0-%u required, current %u)", pages - 1, page);
         return ESP_FAIL;
     }
-    // Construct data frame
-    uint8_t frame[13] = {
-        FRAME_HEADER[0], FRAME_HEADER[1],                                                               // Frame header (2 bytes)
-        zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3], // Device address (4 bytes)
-        PACKET_CMD,                                                                                     // Packet identifier (1 byte)
-        0x00, 0x04,                                                                                     // Data length (2 bytes, fixed 4 bytes)
-        CMD_READ_INDEX_TABLE,                                                                           // Command code (1 byte)
-        page,                                                                                           // Page number (1 byte)
-        0x00, 0x00                                                                                      // Checksum (2 bytes, to be calculated)
-    };
-    // Calculate and fill checksum
-    uint16_t checksum = calculate_checksum(frame, sizeof(frame));
-    frame[11] = (uint8_t)(checksum >> 8);   // High byte of checksum
-    frame[12] = (uint8_t)(checksum & 0xFF); // Low byte of checksum
+    struct command_request request = {
+        .index = CMD_INDEX_READ_INDEX_TABLE,
+        .param = {
+            page, // Page number (1 byte)
+        }};
+    return submit_command(batch, &request);
+}
 
-    // Send command via UART
-    int len = uart_write_bytes(EX_UART_NUM, (const char *)frame, sizeof(frame));
-    if (len == sizeof(frame))
+/**
+ * @brief Read the system parameters of the module (status, sensor type, template capacity, ...)
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
+ */
+static esp_err_t read_sys_para(struct command_batch *batch)
+{
+    struct command_request request = {.index = CMD_INDEX_READ_SYS_PARA};
+    return submit_command(batch, &request);
+}
+
+/**
+ * @brief Store the template in a character buffer at a fingerprint ID
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param bufferID Character buffer number
+ * @param ID Fingerprint ID (0 to capacity-1, returns failure if out of range)
+ * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
+ */
+static esp_err_t store_char(struct command_batch *batch, uint8_t bufferID, uint16_t ID)
+{
+    if (ID >= zw111.capacity)
     {
-        // Send succeeded
-        ESP_LOGI(TAG, "Read index table command sent successfully");
-        return ESP_OK;
+        ESP_LOGE(TAG, "Storage failed: ID out of range (0-%u required, current %u)", zw111.capacity - 1, ID);
+        return ESP_FAIL;
     }
-    else
+    struct command_request request = {
+        .index = CMD_INDEX_STORE_CHAR,
+        .param = {
+            bufferID,                        // Character buffer number (1 byte)
+            (uint8_t)(ID >> 8), (uint8_t)ID, // Fingerprint ID (2 bytes, high byte first)
+        }};
+    return submit_command(batch, &request);
+}
+
+/**
+ * @brief Load the template stored at a fingerprint ID into a character buffer
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param bufferID Character buffer number
+ * @param ID Fingerprint ID (0 to capacity-1, returns failure if out of range)
+ * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = invalid parameters or command sent failed
+ */
+static esp_err_t load_char(struct command_batch *batch, uint8_t bufferID, uint16_t ID)
+{
+    if (ID >= zw111.capacity)
     {
-        // Send failed
-        ESP_LOGE(TAG, "Sending failed, actual bytes sent: %d", len);
+        ESP_LOGE(TAG, "Loading failed: ID out of range (0-%u required, current %u)", zw111.capacity - 1, ID);
         return ESP_FAIL;
     }
+    struct command_request request = {
+        .index = CMD_INDEX_LOAD_CHAR,
+        .param = {
+            bufferID,                        // Character buffer number (1 byte)
+            (uint8_t)(ID >> 8), (uint8_t)ID, // Fingerprint ID (2 bytes, high byte first)
+        }};
+    return submit_command(batch, &request);
 }
 
 /**
- * @brief Parse the return data of read index table command and extract enrolled fingerprint IDs
- * @param receive_data Received data packet buffer
- * @param data_length Actual number of received bytes (must be explicitly passed)
- * @return esp_err_t Parsing result: ESP_OK = parsing succeeded, ESP_FAIL = invalid data or parsing failed
+ * @brief Upload a character buffer to the host, the module answers with an acknowledgement followed by data packets
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param bufferID Character buffer number
+ * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
  */
-static esp_err_t fingerprint_parse_frame(const uint8_t *receive_data, uint16_t data_length)
+static esp_err_t up_char(struct command_batch *batch, uint8_t bufferID)
 {
-    // Initialize fingerprint ID array (0xFF means unused)
-    memset(zw111.fingerIDArray, 0xFF, sizeof(zw111.fingerIDArray));
-    zw111.fingerNumber = 0;
-    // Mask array (used to detect if each bit is set)
-    uint8_t mask[] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
-    uint8_t tempCount = 0; // Temporary count variable
-    // Parse data field (index table data starts from byte 10, 13 bytes total, corresponding to 104 bits, 100 valid bits actually)
-    for (uint8_t i = 10; i <= 22; i++) // i=10 to 22 (13 bytes total)
-    {
-        uint8_t byteData = receive_data[i];
-        if (byteData == 0)
-            continue; // Skip bytes with no fingerprints
-        // Detect each bit of current byte (corresponding to 8 fingerprint IDs)
-        for (uint8_t j = 0; j < 8; j++)
-        {
-            if (byteData & mask[j])
-            {
-                // Calculate fingerprint ID: (byte offset)×8 + bit offset
-                uint8_t fingerID = (i - 10) * 8 + j;
-                if (fingerID < 100) // Only keep valid IDs (0-99)
-                {
-                    zw111.fingerIDArray[tempCount] = fingerID;
-                    tempCount++;
-                    if (tempCount >= 100)
-                        break; // Stop when maximum capacity is reached
-                }
-            }
+    struct command_request request = {
+        .index = CMD_INDEX_UP_CHAR,
+        .param = {
+            bufferID, // Character buffer number (1 byte)
+        }};
+    return submit_command(batch, &request);
+}
+
+/**
+ * @brief Download a character buffer from the host, data packets are sent once the module acknowledges
+ * @param batch Batch to append the command to, NULL = send immediately
+ * @param bufferID Character buffer number
+ * @return esp_err_t Operation result: ESP_OK = command sent successfully, ESP_FAIL = command sent failed
+ */
+static esp_err_t down_char(struct command_batch *batch, uint8_t bufferID)
+{
+    struct command_request request = {
+        .index = CMD_INDEX_DOWN_CHAR,
+        .param = {
+            bufferID, // Character buffer number (1 byte)
+        }};
+    return submit_command(batch, &request);
+}
+
+/**
+ * @brief Resize the enrolled ID bitmap to a new template capacity, known IDs below the new capacity are kept
+ * @note The new bitmap, its size and the capacity are published together under index_lock, and the old bitmap is
+ *       freed only afterwards; readers on other tasks (fingerprint_id_exists/fingerprint_id_next) take the same lock
+ * @param capacity New template capacity (1 to FINGERPRINT_MAX_CAPACITY)
+ * @return esp_err_t ESP_OK = resized, ESP_FAIL = invalid capacity, ESP_ERR_NO_MEM = allocation failed
+ */
+static esp_err_t fingerprint_resize_index(uint16_t capacity)
+{
+    if (capacity == 0 || capacity > FINGERPRINT_MAX_CAPACITY)
+    {
+        ESP_LOGE(TAG, "Invalid template capacity (1-%u required, current %u)", FINGERPRINT_MAX_CAPACITY, capacity);
+        return ESP_FAIL;
+    }
+    uint16_t bytes = (capacity + 7) / 8;
+    uint8_t *bitmap = calloc(bytes, 1);
+    if (bitmap == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate ID bitmap for capacity %u", capacity);
+        return ESP_ERR_NO_MEM;
+    }
+    taskENTER_CRITICAL(&index_lock);
+    uint8_t *old = zw111.fingerIDBitmap;
+    if (old != NULL)
+    {
+        memcpy(bitmap, old, bytes < zw111.bitmapBytes ? bytes : zw111.bitmapBytes);
+    }
+    if (capacity % 8)
+    {
+        bitmap[bytes - 1] &= (1 << (capacity % 8)) - 1; // Drop bits beyond the capacity
+    }
+    zw111.fingerIDBitmap = bitmap;
+    zw111.bitmapBytes = bytes;
+    zw111.capacity = capacity;
+    taskEXIT_CRITICAL(&index_lock);
+    free(old);
+    ESP_LOGI(TAG, "Fingerprint template capacity: %u", capacity);
+    return ESP_OK;
+}
+
+/**
+ * @brief Count the enrolled fingerprint IDs in the bitmap
+ * @return uint16_t Number of enrolled fingerprints
+ */
+static uint16_t fingerprint_id_count()
+{
+    uint16_t count = 0;
+    taskENTER_CRITICAL(&index_lock);
+    for (uint16_t i = 0; i < zw111.bitmapBytes; i++)
+    {
+        count += __builtin_popcount(zw111.fingerIDBitmap[i]);
+    }
+    taskEXIT_CRITICAL(&index_lock);
+    return count;
+}
+
+/**
+ * @brief Check whether a fingerprint ID is enrolled
+ * @param id Fingerprint ID
+ * @return bool true = enrolled, false = unused or out of range
+ */
+bool fingerprint_id_exists(uint16_t id)
+{
+    bool exists = false;
+    taskENTER_CRITICAL(&index_lock);
+    if (id < zw111.capacity)
+    {
+        exists = (zw111.fingerIDBitmap[id >> 3] >> (id & 0x07)) & 0x01;
+    }
+    taskEXIT_CRITICAL(&index_lock);
+    return exists;
+}
+
+/**
+ * @brief Find the next enrolled fingerprint ID, used to iterate IDs in ascending order
+ * @param id First ID to consider
+ * @return uint16_t Smallest enrolled ID >= id, FINGERPRINT_ID_NONE if there is none
+ */
+uint16_t fingerprint_id_next(uint16_t id)
+{
+    uint16_t next = FINGERPRINT_ID_NONE;
+    taskENTER_CRITICAL(&index_lock);
+    while (id < zw111.capacity)
+    {
+        uint8_t byteData = zw111.fingerIDBitmap[id >> 3] >> (id & 0x07);
+        if (byteData != 0)
+        {
+            id += __builtin_ctz(byteData);
+            next = id < zw111.capacity ? id : FINGERPRINT_ID_NONE;
+            break;
         }
-        if (tempCount >= 100)
-            break; // Stop when maximum capacity is reached
+        id = (id | 0x07) + 1; // Continue at the start of the next byte
     }
-    // Update valid fingerprint count
-    zw111.fingerNumber = tempCount;
-    if (zw111.fingerNumber > 0)
+    taskEXIT_CRITICAL(&index_lock);
+    return next;
+}
+
+/**
+ * @brief Find the smallest unused fingerprint ID
+ * @return uint16_t Smallest unused ID, FINGERPRINT_ID_NONE if the module is full
+ */
+uint16_t get_mini_unused_id()
+{
+    uint16_t unused = FINGERPRINT_ID_NONE;
+    taskENTER_CRITICAL(&index_lock);
+    for (uint16_t i = 0; i < zw111.bitmapBytes; i++)
     {
-        ESP_LOGI(TAG, "Detected %u enrolled fingerprint IDs: ", zw111.fingerNumber);
-        for (size_t i = 0; i < zw111.fingerNumber; i++)
+        if (zw111.fingerIDBitmap[i] != 0xFF)
         {
-            ESP_LOGI(TAG, "%u ", zw111.fingerIDArray[i]);
+            uint16_t id = i * 8 + __builtin_ctz((uint8_t)~zw111.fingerIDBitmap[i]);
+            unused = id < zw111.capacity ? id : FINGERPRINT_ID_NONE;
+            break;
         }
     }
-    else
+    taskEXIT_CRITICAL(&index_lock);
+    return unused;
+}
+
+/**
+ * @brief Mark a fingerprint ID as enrolled
+ * @param id Fingerprint ID
+ * @return esp_err_t ESP_OK = marked, ESP_FAIL = ID out of range
+ */
+static esp_err_t insert_fingerprint_id(uint16_t id)
+{
+    if (id >= zw111.capacity)
     {
-        ESP_LOGI(TAG, "No enrolled fingerprints detected");
+        return ESP_FAIL; // Invalid ID
     }
+    zw111.fingerIDBitmap[id >> 3] |= 1 << (id & 0x07);
+    zw111.fingerNumber = fingerprint_id_count();
+    ESP_LOGI(TAG, "Insert fingerprint ID %u succeeded", id);
     return ESP_OK;
 }
 
 /**
- * Find the smallest unused ID in the fingerprint list and return it
- * @return Smallest unused fingerprint ID, returns 255 if no available ID
+ * @brief Mark a fingerprint ID as unused
+ * @param id Fingerprint ID
+ * @return esp_err_t ESP_OK = cleared, ESP_FAIL = ID out of range
  */
-uint8_t get_mini_unused_id()
+static esp_err_t remove_fingerprint_id(uint16_t id)
 {
-    // Special case: no fingerprints exist, return 0 directly
-    if (zw111.fingerNumber == 0)
+    if (id >= zw111.capacity)
     {
-        return 0;
+        return ESP_FAIL; // Invalid ID
+    }
+    zw111.fingerIDBitmap[id >> 3] &= ~(1 << (id & 0x07));
+    zw111.fingerNumber = fingerprint_id_count();
+    return ESP_OK;
+}
+
+/**
+ * @brief Parse one page of the read index table response into the enrolled ID bitmap
+ * @param receive_data Received data packet buffer
+ * @param data_length Actual number of received bytes (must be explicitly passed)
+ * @param page Page number the response belongs to
+ * @return esp_err_t Parsing result: ESP_OK = parsing succeeded, ESP_FAIL = invalid data or parsing failed
+ */
+static esp_err_t fingerprint_parse_frame(const uint8_t *receive_data, uint16_t data_length, uint8_t page)
+{
+    // Index table data starts from byte 10 and uses the same layout as the bitmap, copy it as is
+    if (data_length < 10 + FINGERPRINT_INDEX_PAGE_BYTES + CHECKSUM_LEN)
+    {
+        ESP_LOGE(TAG, "Index table data too short: %u", data_length);
+        return ESP_FAIL;
     }
-    // Check if the first ID is 0, if not, 0 is unused
-    if (zw111.fingerIDArray[0] > 0)
+    uint16_t offset = page * FINGERPRINT_INDEX_PAGE_BYTES;
+    if (offset >= zw111.bitmapBytes)
     {
-        return 0;
+        return ESP_FAIL;
+    }
+    uint16_t bytes = zw111.bitmapBytes - offset;
+    if (bytes > FINGERPRINT_INDEX_PAGE_BYTES)
+    {
+        bytes = FINGERPRINT_INDEX_PAGE_BYTES;
     }
-    // Traverse sorted ID array to find gaps in continuous sequence
-    for (uint8_t i = 0; i < zw111.fingerNumber - 1; i++)
+    memcpy(&zw111.fingerIDBitmap[offset], &receive_data[10], bytes);
+    if (offset + bytes == zw111.bitmapBytes && zw111.capacity % 8)
+    {
+        // Drop bits beyond the module capacity
+        zw111.fingerIDBitmap[zw111.bitmapBytes - 1] &= (1 << (zw111.capacity % 8)) - 1;
+    }
+    zw111.fingerNumber = fingerprint_id_count();
+    return ESP_OK;
+}
+
+/**
+ * @brief Log the enrolled fingerprint IDs once the whole index table has been read
+ * @return void
+ */
+static void fingerprint_log_index()
+{
+    if (zw111.fingerNumber > 0)
     {
-        // There is a gap between current ID and next ID
-        if (zw111.fingerIDArray[i + 1] > zw111.fingerIDArray[i] + 1)
+        ESP_LOGI(TAG, "Detected %u enrolled fingerprint IDs: ", zw111.fingerNumber);
+        for (uint16_t id = fingerprint_id_next(0); id != FINGERPRINT_ID_NONE; id = fingerprint_id_next(id + 1))
         {
-            return zw111.fingerIDArray[i] + 1;
+            ESP_LOGI(TAG, "%u ", id);
         }
     }
-    // All existing IDs are continuous, return next value of last ID
-    uint8_t last_id = zw111.fingerIDArray[zw111.fingerNumber - 1];
-    if (last_id + 1 < 100) // Ensure not exceed maximum supported ID range
+    else
     {
-        return last_id + 1;
+        ESP_LOGI(TAG, "No enrolled fingerprints detected");
     }
-    // All possible IDs are used
-    return 255;
 }
 
 /**
- * Insert newly enrolled fingerprint ID into array while maintaining array order
- * @param new_id New fingerprint ID to insert (should be obtained via get_mini_unused_id())
- * @return ESP_OK for successful insertion, ESP_FAIL for failure
+ * @brief Mark the cached index as suspect (an operation that changes the module's index is running) or trusted again
+ * @param pending true = suspect, the module is re-read at the next boot; false = cache matches the module
+ * @return void
  */
-static esp_err_t insert_fingerprint_id(uint8_t new_id)
+static void fingerprint_set_index_pending(bool pending)
 {
-    // Check ID validity
-    if (new_id >= 100)
+    if (nvs_custom_set_u8(NULL, "fingerprint", "idx_pending", pending ? 1 : 0) != ESP_OK)
     {
-        return ESP_FAIL; // Invalid ID
+        ESP_LOGW(TAG, "Failed to update index cache state");
+    }
+}
+
+/**
+ * @brief Save the enrolled ID bitmap to NVS
+ * @note The cache is only marked trusted when no earlier operation ended without a result; such an operation may have
+ *       changed the module behind the bitmap's back (e.g. an enroll that was stored but whose acknowledgement was lost),
+ *       so the cache stays suspect until the index has been read from the module again
+ * @return esp_err_t ESP_OK = saved, others = NVS write failed (cache stays suspect)
+ */
+static esp_err_t fingerprint_save_index_cache()
+{
+    esp_err_t ret = nvs_custom_set_blob(NULL, "fingerprint", "idx_bitmap", zw111.fingerIDBitmap, zw111.bitmapBytes);
+    if (ret == ESP_OK)
+    {
+        ret = nvs_custom_set_u16(NULL, "fingerprint", "idx_capacity", zw111.capacity);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save fingerprint index cache: 0x%x", ret);
+        return ret;
+    }
+    if (index_in_doubt)
+    {
+        ESP_LOGW(TAG, "Fingerprint index cache saved but left suspect, the module is re-read at the next boot");
+        return ESP_OK;
     }
-    // Check if array is full
-    if (zw111.fingerNumber >= 100)
+    fingerprint_set_index_pending(false); // Written last, the cache is only trusted once complete
+    ESP_LOGI(TAG, "Fingerprint index cache saved, %u enrolled", zw111.fingerNumber);
+    return ESP_OK;
+}
+
+/**
+ * @brief Load the enrolled ID bitmap from NVS
+ * @return esp_err_t ESP_OK = cache loaded and trusted, ESP_FAIL = no cache or cache suspect, the module must be read
+ */
+static esp_err_t fingerprint_load_index_cache()
+{
+    uint8_t pending = 1;
+    uint16_t capacity = 0;
+    if (nvs_custom_get_u8(NULL, "fingerprint", "idx_pending", &pending) != ESP_OK || pending != 0 ||
+        nvs_custom_get_u16(NULL, "fingerprint", "idx_capacity", &capacity) != ESP_OK)
     {
-        return ESP_FAIL; // Maximum capacity reached, cannot insert
+        ESP_LOGI(TAG, "No trusted fingerprint index cache, reading index from module");
+        return ESP_FAIL;
     }
-    // Find insertion position
-    uint8_t insert_pos = 0;
-    while (insert_pos < zw111.fingerNumber &&
-           zw111.fingerIDArray[insert_pos] < new_id)
+    if (fingerprint_resize_index(capacity) != ESP_OK)
     {
-        insert_pos++;
+        return ESP_FAIL;
     }
-    // Move elements to make space for new ID
-    for (uint8_t i = zw111.fingerNumber; i > insert_pos; i--)
+    size_t size = zw111.bitmapBytes;
+    if (nvs_custom_get_blob(NULL, "fingerprint", "idx_bitmap", zw111.fingerIDBitmap, &size) != ESP_OK ||
+        size != zw111.bitmapBytes)
     {
-        zw111.fingerIDArray[i] = zw111.fingerIDArray[i - 1];
+        ESP_LOGW(TAG, "Fingerprint index cache corrupted, reading index from module");
+        memset(zw111.fingerIDBitmap, 0, zw111.bitmapBytes);
+        return ESP_FAIL;
     }
-    // Insert new ID
-    zw111.fingerIDArray[insert_pos] = new_id;
-    // Update fingerprint count
-    zw111.fingerNumber++;
-    ESP_LOGI(TAG, "Insert fingerprint ID %u succeeded", zw111.fingerIDArray[insert_pos]);
-    return ESP_OK; // Insertion succeeded
+    zw111.fingerNumber = fingerprint_id_count();
+    ESP_LOGI(TAG, "Fingerprint index loaded from cache, %u enrolled", zw111.fingerNumber);
+    return ESP_OK;
 }
 
 /**
@@ -663,7 +1034,7 @@ void cancel_current_operation_and_execute_command()
 {
     zw111.state = 0x0A; // Switch to cancel state
     // Send cancel command
-    if (cancel() == ESP_OK)
+    if (cancel(NULL) == ESP_OK)
     {
         ESP_LOGI(TAG, "Preparing to cancel current operation, module state switched to cancel state");
     }
@@ -680,6 +1051,9 @@ void cancel_current_operation_and_execute_command()
  */
 static esp_err_t fingerprint_initialization_uart()
 {
+#if FINGERPRINT_SIMULATOR
+    return zw111_sim_start(&uart2_queue); // Simulated module powers up and reports 0x55
+#else
     esp_err_t ret = ESP_OK;
     // Check if driver is already installed
     if (uart_is_driver_installed(EX_UART_NUM))
@@ -737,6 +1111,7 @@ static esp_err_t fingerprint_initialization_uart()
     }
     ESP_LOGI(TAG, "UART initialization succeeded");
     return ESP_OK;
+#endif
 }
 
 /**
@@ -745,6 +1120,11 @@ static esp_err_t fingerprint_initialization_uart()
  */
 static esp_err_t fingerprint_deinitialization_uart()
 {
+#if FINGERPRINT_SIMULATOR
+    zw111_sim_stop();
+    uart2_queue = NULL;
+    return ESP_OK;
+#else
     if (!uart_is_driver_installed(EX_UART_NUM))
     {
         ESP_LOGE(TAG, "UART driver not installed, cannot delete");
@@ -773,20 +1153,39 @@ static esp_err_t fingerprint_deinitialization_uart()
     }
     ESP_LOGI(TAG, "UART driver deleted");
     return ESP_OK;
+#endif
 }
 
 /**
  * @brief Turn on fingerprint module
- * @note This function will power on the fingerprint module and set the state to powered on
- * @return void
+ * @note A touch (fingerprint_task) and operation submitters (web server, template tasks) may find the module off at the
+ *       same time; the check and zw111.power change under idle_lock, so only the first caller installs the UART driver
+ *       and starts uart_task, later callers leave the module and its state alone
+ * @param state State to switch to, decides what the power-on handshake starts
+ * @return bool true = powered on by this call, false = already powered on
  */
-void turn_on_fingerprint()
+bool turn_on_fingerprint(uint8_t state)
 {
+    taskENTER_CRITICAL(&idle_lock);
+    bool off = zw111.power == false;
+    if (off)
+    {
+        zw111.power = true;
+        zw111.state = state;
+    }
+    taskEXIT_CRITICAL(&idle_lock);
+    if (!off)
+    {
+        return false;
+    }
+    power_on_time = esp_timer_get_time();
+    awaiting_power_on = true;
     gpio_set_level(FINGERPRINT_CTL_PIN, 0); // Power on fingerprint module
+    fingerprint_reset_reassembler();        // Start from a clean frame stream
     fingerprint_initialization_uart();      // Initialize UART communication
     xTaskCreate(uart_task, "uart_task", 8192, NULL, 10, NULL);
-    zw111.power = true;
     ESP_LOGI(TAG, "Fingerprint module powered on");
+    return true;
 }
 
 /**
@@ -798,7 +1197,7 @@ void prepare_turn_off_fingerprint()
 {
     zw111.state = 0x0B; // Switch to sleep state
     // Send sleep command
-    if (sleep() == ESP_OK)
+    if (sleep(NULL) == ESP_OK)
     {
         ESP_LOGI(TAG, "Preparing to sleep, module state switched to sleep state");
     }
@@ -810,570 +1209,1426 @@ void prepare_turn_off_fingerprint()
 }
 
 /**
- * @brief Touch interrupt service routine
- * @param arg Interrupt parameter (GPIO number passed in)
+ * @brief Cancel the current operation and turn off the module
+ * @note Cancel and sleep commands are sent back to back in a single UART write, the module is powered off once the
+ *       acknowledgement arrives
  * @return void
  */
-static void IRAM_ATTR gpio_isr_handler(void *arg)
+void cancel_and_turn_off_fingerprint()
 {
-    ESP_EARLY_LOGI(TAG, "Fingerprint touch detected");
-    gpio_set_intr_type(FINGERPRINT_INT_PIN, GPIO_INTR_POSEDGE);
-    gpio_intr_enable(FINGERPRINT_INT_PIN);
-    uint32_t gpio_num = (uint32_t)arg;
-    if (gpio_num == FINGERPRINT_INT_PIN)
+    struct command_batch batch = {0};
+    zw111.state = 0x0B; // Switch to sleep state
+    cancel(&batch);
+    sleep(&batch);
+    if (flush_command_batch(&batch) == ESP_OK)
     {
-        xSemaphoreGiveFromISR(fingerprint_semaphore, NULL);
+        ESP_LOGI(TAG, "Preparing to cancel current operation and sleep, module state switched to sleep state");
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to cancel current operation and sleep");
     }
 }
 
 /**
- * @brief Initialize fingerprint module
- * @return esp_err_t ESP_OK = initialization succeeded, ESP_FAIL = invalid data or initialization failed
+ * @brief Leave the keep-warm idle state (0x05) if the module is still in it
+ * @note The touch, the keep-warm timer (esp_timer task) and a queued operation (web server) all start from idle, the
+ *       check and the transition happen under one lock so exactly one of them sends its command to the module
+ * @param state State to switch to
+ * @return true = the module was idle and now belongs to the caller, false = it already left idle
  */
-esp_err_t fingerprint_initialization()
+static bool fingerprint_leave_idle(uint8_t state)
 {
-    fingerprint_semaphore = xSemaphoreCreateBinary(); // Only used to activate the module after touch detection
-    if (g_gpio_isr_service_installed == false)
+    bool idle;
+    taskENTER_CRITICAL(&idle_lock);
+    idle = zw111.power == true && zw111.state == 0x05;
+    if (idle)
     {
-        gpio_install_isr_service(0);
-        g_gpio_isr_service_installed = true;
+        zw111.state = state;
     }
+    taskEXIT_CRITICAL(&idle_lock);
+    return idle;
+}
 
-    // Initialize UART communication
-    if (fingerprint_initialization_uart() != ESP_OK)
+/**
+ * @brief Keep-warm timer callback, powers the module off if it is still idle when the window ends
+ * @note esp_timer_stop() does not wait for a callback that is already running, a touch at the end of the window is
+ *       resolved by fingerprint_leave_idle()
+ * @param arg Timer parameter (unused)
+ * @return void
+ */
+static void keep_warm_timer_callback(void *arg)
+{
+    if (fingerprint_leave_idle(0x0B))
     {
-        return ESP_FAIL;
+        ESP_LOGI(TAG, "Keep-warm window of %u s expired", g_fingerprint_keep_warm_time);
+        prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
     }
+}
 
-    // Initialize fingerprint module data structure
-    zw111.deviceAddress[0] = 0xFF;
-    zw111.deviceAddress[1] = 0xFF;
-    zw111.deviceAddress[2] = 0xFF;
-    zw111.deviceAddress[3] = 0xFF;
-
-    gpio_config_t zw111_int_gpio_config = {
-        .pin_bit_mask = (1ULL << FINGERPRINT_INT_PIN),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_ENABLE,
-        .intr_type = GPIO_INTR_POSEDGE};
-    gpio_config(&zw111_int_gpio_config);
-
-    gpio_config_t fingerprint_ctl_gpio_config = {
-        .pin_bit_mask = (1ULL << FINGERPRINT_CTL_PIN),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE};
-    gpio_config(&fingerprint_ctl_gpio_config);
-
-    gpio_set_level(FINGERPRINT_CTL_PIN, 0);
-
-    gpio_isr_handler_add(FINGERPRINT_INT_PIN, gpio_isr_handler, (void *)FINGERPRINT_INT_PIN);
-    ESP_LOGI(TAG, "zw111 interrupt gpio configured");
-
-    // Create a task to handle UART event from ISR
-    xTaskCreate(uart_task, "uart_task", 8192, NULL, 10, NULL);
-    ESP_LOGI(TAG, "uart task created");
-
-    // Create a task to handle fingerprint processing after touch detection
-    xTaskCreate(fingerprint_task, "fingerprint_task", 8192, NULL, 10, NULL);
-    ESP_LOGI(TAG, "fingerprint task created");
-
-    return ESP_OK;
+/**
+ * @brief Leave the module powered in idle state for the keep-warm window, or turn it off when the window is 0
+ * @return void
+ */
+static void fingerprint_enter_idle()
+{
+    if (g_fingerprint_keep_warm_time == 0 || keep_warm_timer == NULL)
+    {
+        prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
+        return;
+    }
+    zw111.state = 0x05; // Switch to idle state
+    esp_timer_stop(keep_warm_timer);
+    esp_timer_start_once(keep_warm_timer, (uint64_t)g_fingerprint_keep_warm_time * 1000000ULL);
+    ESP_LOGI(TAG, "Fingerprint module idle, keeping warm for %u s", g_fingerprint_keep_warm_time);
 }
 
 /**
- * @brief Fingerprint task
- * @param pvParameters Task parameters (unused)
+ * @brief Restrict the next verification to the fingerprints bound to a presented card
+ * @note The window is consumed by the next touch, whether or not it succeeds
+ * @param ids Bound fingerprint IDs
+ * @param count Number of IDs (at most CARD_BOUND_FINGERS_MAX), 0 = disarm
+ * @param windowMs Time in which the finger has to touch the sensor (ms)
  * @return void
  */
-void fingerprint_task(void *pvParameters)
+void fingerprint_arm_verification(const uint16_t *ids, uint8_t count, uint32_t windowMs)
 {
-    while (1)
+    if (count > CARD_BOUND_FINGERS_MAX)
     {
-        // Wait for semaphore to be released
-        if (xSemaphoreTake(fingerprint_semaphore, portMAX_DELAY) == pdTRUE)
+        count = CARD_BOUND_FINGERS_MAX;
+    }
+    taskENTER_CRITICAL(&arm_lock);
+    memcpy(armed_ids, ids, count * sizeof(uint16_t));
+    armed_count = count;
+    armed_deadline = esp_timer_get_time() + (int64_t)windowMs * 1000;
+    taskEXIT_CRITICAL(&arm_lock);
+    ESP_LOGI(TAG, "Verification armed for %u bound fingerprint(s), window %" PRIu32 " ms", count, windowMs);
+}
+
+/**
+ * @brief Replace the set of fingerprints bound to a two-factor card, such a finger is refused unless its card was
+ *        presented
+ * @note The bitmap is swapped in as a whole, a verification never sees a half-built set
+ * @param required Bitmap of FINGERPRINT_CARD_REQUIRED_BYTES, bit set = card required
+ * @return void
+ */
+void fingerprint_set_card_requirements(const uint8_t *required)
+{
+    taskENTER_CRITICAL(&arm_lock);
+    memcpy(card_required, required, sizeof(card_required));
+    taskEXIT_CRITICAL(&arm_lock);
+}
+
+/**
+ * @brief Check whether a matched fingerprint may unlock in the running verification
+ * @note The bound set and the card requirements are read in one snapshot under arm_lock
+ * @param id Matched fingerprint ID
+ * @return true = accepted, false = refused by the two-factor policy
+ */
+static bool fingerprint_match_allowed(uint16_t id)
+{
+    uint16_t ids[CARD_BOUND_FINGERS_MAX];
+    taskENTER_CRITICAL(&arm_lock);
+    uint8_t count = bound_count;
+    memcpy(ids, bound_ids, count * sizeof(uint16_t));
+    bool required = id < FINGERPRINT_MAX_CAPACITY && ((card_required[id >> 3] >> (id & 0x07)) & 0x01);
+    taskEXIT_CRITICAL(&arm_lock);
+    if (count > 0)
+    {
+        for (uint8_t i = 0; i < count; i++)
         {
-            notify_user_activity();
-            // Semaphore released, indicating fingerprint module is ready
-            ESP_LOGI(TAG, "Fingerprint module is ready, start processing tasks");
-            // Print current module state
-            ESP_LOGI(TAG, "Fingerprint module power state: %s", zw111.power ? "Powered on" : "Powered off");
-            ESP_LOGI(TAG, "Fingerprint module state: %s",
-                     zw111.state == 0x00   ? "Initial state"
-                     : zw111.state == 0x01 ? "Read index table state"
-                     : zw111.state == 0x02 ? "Enroll fingerprint state"
-                     : zw111.state == 0x03 ? "Delete fingerprint state"
-                     : zw111.state == 0x04 ? "Verify fingerprint state"
-                     : zw111.state == 0x0A ? "Cancel state"
-                     : zw111.state == 0x0B ? "Sleep state"
-                                           : "Unknown state");
-            ESP_LOGI(TAG, "Fingerprint module device address: %02X:%02X:%02X:%02X",
-                     zw111.deviceAddress[0], zw111.deviceAddress[1],
-                     zw111.deviceAddress[2], zw111.deviceAddress[3]);
-            ESP_LOGI(TAG, "Number of enrolled fingerprints in module: %u", zw111.fingerNumber);
-            ESP_LOGI(TAG, "Enrolled fingerprint IDs in module: ");
-            for (size_t i = 0; i < zw111.fingerNumber; i++)
-            {
-                ESP_LOGI(TAG, "%u ", zw111.fingerIDArray[i]);
-            }
-            // Start fingerprint verification
-            if (zw111.power == false) // Power off state
-            {
-                ESP_LOGI(TAG, "Current state is power off, preparing to verify fingerprint");
-                zw111.state = 0x04;    // Switch to verify fingerprint state
-                turn_on_fingerprint(); // Power on fingerprint module
-            }
-            // Handle abnormal module state
-            else if (zw111.power == true) // Power on state
+            if (ids[i] == id)
             {
-                ESP_LOGE(TAG, "Current state is abnormal, preparing to turn off fingerprint module");
-                cancel_current_operation_and_execute_command(); // Cancel current operation
-                prepare_turn_off_fingerprint();                 // Prepare to turn off fingerprint module
+                return true;
             }
         }
+        return false; // Matched a finger that is not bound to the presented card
     }
+    return !required;
 }
 
 /**
- * @brief UART event handling task
- * @param pvParameters Task parameters (unused)
+ * @brief Send the identify command and start timing the response
+ * @note A single fingerprint bound to a presented card is verified 1:1, several bound fingerprints are searched 1:N
+ *       and the match is checked against the bound set
  * @return void
  */
-void uart_task(void *pvParameters)
+static void fingerprint_start_identify()
 {
-    uart_event_t event;
-    static uint8_t dtmp[1024];
-    while (1)
+    zw111.state = 0x04; // Switch to verify fingerprint state
+    taskENTER_CRITICAL(&arm_lock);
+    bound_count = 0;
+    if (armed_count > 0 && touch_time <= armed_deadline)
     {
-        if (xQueueReceive(uart2_queue, (void *)&event, portMAX_DELAY) == pdTRUE)
-        {
-            bzero(dtmp, 1024);
-            size_t buffered_size;
-            switch (event.type)
-            {
-            case UART_DATA:
-                if (zw111.state == 0X0B && event.size == 12) // Sleep state
-                {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    if (dtmp[9] == 0x00) // Confirm code = 00H means sleep setting succeeded
-                    {
-                        fingerprint_deinitialization_uart();    // Delete UART driver
-                        zw111.power = false;                    // Set power state to false
-                        zw111.state = 0X00;                     // Switch to initial state
-                        gpio_set_level(FINGERPRINT_CTL_PIN, 1); // Power off fingerprint module
-                        ESP_LOGI(TAG, "Fingerprint module powered off, state reset to initial state");
-                        // gpio_intr_enable(FINGERPRINT_INT_PIN);
-                        vTaskDelete(NULL); // Delete current task
-                    }
-                }
-                else if (zw111.state == 0X0A && event.size == 12) // Cancel state
-                {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    if (dtmp[9] == 0x00) // Confirm code = 00H means cancel operation succeeded
-                    {
-                        ESP_LOGI(TAG, "Cancel operation succeeded, preparing to execute other commands");
-                        if (g_ready_add_fingerprint == true)
-                        {
-                            zw111.state = 0x02;              // Set state to enroll fingerprint state
-                            g_ready_add_fingerprint = false; // Reset add fingerprint flag
-                            // Send enroll fingerprint command
-                            if (auto_enroll(get_mini_unused_id(), 5, false, false, false, false, true, false) != ESP_OK)
-                            {
-                                ESP_LOGE(TAG, "Failed to send enroll fingerprint command");
-                                prepare_turn_off_fingerprint();
-                            }
-                        }
-                        else if (g_cancel_add_fingerprint == true)
-                        {
-                            g_cancel_add_fingerprint = false; // Reset cancel add fingerprint flag
-                            prepare_turn_off_fingerprint();   // Prepare to turn off fingerprint module
-                        }
-                        else if (g_ready_delete_fingerprint == true && g_ready_delete_all_fingerprint == false)
-                        {
-                            zw111.state = 0x03; // Set state to delete fingerprint state
-                            // Send delete fingerprint command
-                            if (delete_char(g_deleteFingerprintID, 1) != ESP_OK)
-                            {
-                                ESP_LOGE(TAG, "Failed to send delete fingerprint command");
-                                prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                            }
-                        }
-                        else if (g_ready_delete_all_fingerprint == true && g_ready_delete_fingerprint == false)
-                        {
-                            zw111.state = 0x03; // Set state to delete fingerprint state
-                            // Send delete all fingerprints command
-                            if (empty() != ESP_OK)
-                            {
-                                ESP_LOGE(TAG, "Failed to send delete all fingerprints command");
-                                prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                            }
-                        }
-                        else
-                        {
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                }
-                else if (zw111.state == 0X04 && event.size == 17) // Verify fingerprint state
-                {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    if (dtmp[10] == 0x00 && dtmp[9] == 0x00)
-                    {
-                        ESP_LOGI(TAG, "Verify fingerprint - Command executed successfully, waiting for image capture");
-                    }
-                    else if (dtmp[10] == 0x01)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Verify fingerprint - Image capture succeeded");
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            ESP_LOGW(TAG, "Verify fingerprint - Image capture timeout");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x05)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            uint8_t message = 0x01;
-                            xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
-                            uint16_t fingerID = (dtmp[11] << 8) | dtmp[12]; // Fingerprint ID
-                            uint16_t score = (dtmp[13] << 8) | dtmp[14];    // Matching score
-                            ESP_LOGI(TAG, "Verify fingerprint - Fingerprint found, ID: %u, Score: %u", fingerID, score);
-                        }
-                        else if (dtmp[9] == 0x09)
-                        {
-                            ESP_LOGI(TAG, "Verify fingerprint - No fingerprint found");
-                            uint8_t message = 0x00;
-                            xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
-                        }
-                        else if (dtmp[9] == 0x24)
-                        {
-                            ESP_LOGW(TAG, "Verify fingerprint - Fingerprint library is empty");
-                            uint8_t message = 0x00;
-                            xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
-                        }
-                    }
-                    else if (dtmp[10] == 0x02 && dtmp[9] == 0x09)
-                    {
-                        ESP_LOGW(TAG, "Verify fingerprint - No finger on sensor");
-                        uint8_t message = 0x00;
-                        xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
-                    }
-                    else
-                    {
-                        ESP_LOGE(TAG, "Verify fingerprint - Unknown data, discarded");
-                        prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                    }
-                }
-                else if (zw111.state == 0X01 && event.size == 44) // Read index table state
-                {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    ESP_LOGI(TAG, "Received index table data, length: %u", event.size);
-                    fingerprint_parse_frame(dtmp, event.size); // Parse fingerprint index table data
-                    prepare_turn_off_fingerprint();            // Prepare to turn off fingerprint module
-                }
-                else if (zw111.state == 0X02 && event.size == 14) // Enroll fingerprint state
+        memcpy(bound_ids, armed_ids, armed_count * sizeof(uint16_t));
+        bound_count = armed_count;
+    }
+    armed_count = 0; // One verification per card presentation
+    taskEXIT_CRITICAL(&arm_lock);
+    uint16_t id = 0xFFFF;
+    if (bound_count == 1)
+    {
+        id = bound_ids[0];
+        ESP_LOGI(TAG, "Two-factor verification, 1:1 against ID %u", id);
+    }
+    else if (bound_count > 1)
+    {
+        ESP_LOGI(TAG, "Two-factor verification against %u bound fingerprints", bound_count);
+    }
+    identify_time = esp_timer_get_time();
+    awaiting_first_response = true;
+    // Send verify fingerprint command
+    if (auto_identify(NULL, id, 2, false, false, false) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to send verify fingerprint command");
+        awaiting_first_response = false;
+        prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
+    }
+}
+
+/**
+ * @brief Record the identification result latency and report the timings of this verification
+ * @return void
+ */
+static void fingerprint_record_identify_result()
+{
+    timing.resultCount++;
+    timing.identifyMs = (uint32_t)((esp_timer_get_time() - touch_time) / 1000);
+    ESP_LOGI(TAG, "Verification timing (%s): power-on %" PRIu32 " ms, first response %" PRIu32 " ms, identify %" PRIu32 " ms (warm %" PRIu32 ", cold %" PRIu32 ")",
+             timing.warm ? "warm" : "cold", timing.powerOnMs, timing.firstResponseMs, timing.identifyMs,
+             timing.warmCount, timing.coldCount);
+}
+
+/**
+ * @brief Called once the result of a verification has been presented to the user
+ * @note Keeps the module warm for the next user instead of powering it off, unless the module has meanwhile been
+ *       handed to another operation
+ * @return void
+ */
+void fingerprint_verification_done()
+{
+    if (zw111.power == true && zw111.state == 0x04)
+    {
+        fingerprint_enter_idle();
+    }
+}
+
+/**
+ * @brief Set the keep-warm window and save it to NVS
+ * @param seconds Seconds the module stays powered after the last operation, 0 = power off immediately
+ * @return esp_err_t ESP_OK = saved, others = NVS write failed (window is applied anyway)
+ */
+esp_err_t fingerprint_set_keep_warm_time(uint8_t seconds)
+{
+    g_fingerprint_keep_warm_time = seconds;
+    ESP_LOGI(TAG, "Keep-warm window set to %u s", seconds);
+    return nvs_custom_set_u8(NULL, "fingerprint", "keep_warm", seconds);
+}
+
+/**
+ * @brief Get the latency measurements of the last verification
+ * @param out Output, copy of the measurements
+ * @return void
+ */
+void fingerprint_get_timing(struct fingerprint_timing *out)
+{
+    *out = timing;
+}
+
+/**
+ * Fingerprint operation queue
+ * Operations submitted from other tasks wait here until the module is free. Only one operation is in flight at a
+ * time; when it completes the next one is dispatched directly, without powering the module off in between.
+ */
+static struct fingerprint_operation op_queue[FP_OP_QUEUE_LEN];
+static uint8_t op_head = 0;                    // Index of the oldest queued operation
+static uint8_t op_count = 0;                   // Number of queued operations
+static struct fingerprint_operation current_op; // Operation currently executed by the module
+static bool op_in_flight = false;              // Whether current_op is valid
+static fingerprint_op_handle_t op_next_handle = 1;
+static portMUX_TYPE op_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Append an operation to the queue
+ * @note op_lock must be held
+ * @param op Operation to append
+ * @param front true = insert at the head (reissue), false = append at the tail
+ * @return bool true = queued, false = queue full
+ */
+static bool fingerprint_enqueue_operation(const struct fingerprint_operation *op, bool front)
+{
+    if (op_count >= FP_OP_QUEUE_LEN)
+    {
+        return false;
+    }
+    if (front)
+    {
+        op_head = (op_head + FP_OP_QUEUE_LEN - 1) % FP_OP_QUEUE_LEN;
+        op_queue[op_head] = *op;
+    }
+    else
+    {
+        op_queue[(op_head + op_count) % FP_OP_QUEUE_LEN] = *op;
+    }
+    op_count++;
+    return true;
+}
+
+/**
+ * @brief Append an operation to the queue
+ * @param op Operation to append
+ * @param front true = insert at the head (reissue), false = append at the tail
+ * @return bool true = queued, false = queue full
+ */
+static bool fingerprint_push_operation(const struct fingerprint_operation *op, bool front)
+{
+    taskENTER_CRITICAL(&op_lock);
+    bool queued = fingerprint_enqueue_operation(op, front);
+    taskEXIT_CRITICAL(&op_lock);
+    return queued;
+}
+
+/**
+ * @brief Remove the oldest operation from the queue and mark it as in flight
+ * @return bool true = an operation was moved to current_op, false = queue empty
+ */
+static bool fingerprint_pop_operation()
+{
+    bool popped = false;
+    taskENTER_CRITICAL(&op_lock);
+    if (op_count > 0)
+    {
+        current_op = op_queue[op_head];
+        op_head = (op_head + 1) % FP_OP_QUEUE_LEN;
+        op_count--;
+        op_in_flight = true;
+        popped = true;
+    }
+    taskEXIT_CRITICAL(&op_lock);
+    return popped;
+}
+
+/**
+ * @brief Take ownership of the in-flight operation, so that it is completed exactly once
+ * @param op Output, copy of the in-flight operation
+ * @return bool true = an operation was in flight, false = nothing to complete
+ */
+static bool fingerprint_take_current_operation(struct fingerprint_operation *op)
+{
+    bool taken = false;
+    taskENTER_CRITICAL(&op_lock);
+    if (op_in_flight)
+    {
+        *op = current_op;
+        op_in_flight = false;
+        taken = true;
+    }
+    taskEXIT_CRITICAL(&op_lock);
+    return taken;
+}
+
+/**
+ * @brief Report the result of an operation to its submitter
+ * @param op Completed operation
+ * @param result Final result
+ * @return void
+ */
+static void fingerprint_notify_operation(const struct fingerprint_operation *op, enum fingerprint_op_result result)
+{
+    ESP_LOGI(TAG, "Operation %u (type %u, ID %u) finished, result %u", op->handle, op->type, op->id, result);
+    if (op->callback != NULL)
+    {
+        op->callback(op->handle, op->type, op->id, result, op->arg);
+    }
+}
+
+/**
+ * @brief Complete the in-flight operation with the given result
+ * @param result Final result
+ * @return void
+ */
+static void fingerprint_complete_operation(enum fingerprint_op_result result)
+{
+    struct fingerprint_operation op;
+    if (fingerprint_take_current_operation(&op))
+    {
+        if (op.type == FP_OP_BACKUP)
+        {
+            // Backups only read the module, the index is unchanged whatever the result
+        }
+        else if (result == FP_OP_SUCCESS || result == FP_OP_FAILED)
+        {
+            // The module answered, so this operation's effect is known; an earlier doubt still stands
+            index_in_doubt = index_doubt_before;
+            if (result == FP_OP_SUCCESS)
+            {
+                fingerprint_save_index_cache(); // Index changed, persist it
+            }
+            else if (!index_in_doubt)
+            {
+                fingerprint_set_index_pending(false); // Module rejected the operation, index unchanged
+            }
+        }
+        // Timed out or cancelled operations leave the index in doubt, the module is re-read at the next boot
+        fingerprint_notify_operation(&op, result);
+    }
+}
+
+/**
+ * @brief Dispatch queued operations until one is accepted by the UART driver
+ * @return bool true = an operation is now in flight, false = queue empty
+ */
+static bool fingerprint_start_next_operation()
+{
+    while (fingerprint_pop_operation())
+    {
+        esp_err_t ret = ESP_FAIL;
+        if (current_op.type != FP_OP_BACKUP)
+        {
+            fingerprint_set_index_pending(true); // All other operations may change the module's index
+            index_doubt_before = index_in_doubt;
+            index_in_doubt = true; // Until the module answers
+        }
+        current_op.deadline = esp_timer_get_time() + (int64_t)current_op.timeoutMs * 1000;
+        switch (current_op.type)
+        {
+        case FP_OP_ENROLL:
+            zw111.state = 0x02; // Switch to enroll fingerprint state
+            current_op.id = get_mini_unused_id();
+            ESP_LOGI(TAG, "Starting operation %u: enroll fingerprint, ID:%u", current_op.handle, current_op.id);
+            ret = auto_enroll(NULL, current_op.id, 5, false, false, false, false, true, false);
+            break;
+        case FP_OP_DELETE:
+            zw111.state = 0x03; // Switch to delete fingerprint state
+            ESP_LOGI(TAG, "Starting operation %u: delete fingerprint, ID:%u", current_op.handle, current_op.id);
+            ret = delete_char(NULL, current_op.id, 1);
+            break;
+        case FP_OP_EMPTY:
+            zw111.state = 0x03; // Switch to delete fingerprint state
+            ESP_LOGI(TAG, "Starting operation %u: clear all fingerprints", current_op.handle);
+            ret = empty(NULL);
+            break;
+        case FP_OP_BACKUP:
+            zw111.state = 0x07; // Switch to template backup state
+            transfer_step = TRANSFER_LOAD;
+            transfer_bytes = 0;
+            ESP_LOGI(TAG, "Starting operation %u: back up template, ID:%u", current_op.handle, current_op.id);
+            ret = load_char(NULL, FINGERPRINT_TEMPLATE_BUFFER, current_op.id);
+            break;
+        case FP_OP_RESTORE:
+            zw111.state = 0x08; // Switch to template restore state
+            transfer_step = TRANSFER_DOWNLOAD;
+            transfer_bytes = 0;
+            ESP_LOGI(TAG, "Starting operation %u: restore template, ID:%u", current_op.handle, current_op.id);
+            ret = down_char(NULL, FINGERPRINT_TEMPLATE_BUFFER);
+            break;
+        }
+        if (ret == ESP_OK)
+        {
+            return true;
+        }
+        ESP_LOGE(TAG, "Failed to send command of operation %u", current_op.handle);
+        fingerprint_complete_operation(FP_OP_FAILED);
+    }
+    return false;
+}
+
+/**
+ * @brief Dispatch the next queued operation, or let the module go idle when there is nothing left to do
+ * @return void
+ */
+static void fingerprint_next_or_turn_off()
+{
+    if (!fingerprint_start_next_operation())
+    {
+        fingerprint_enter_idle(); // Keep warm or turn off fingerprint module
+    }
+}
+
+/**
+ * @brief Complete the in-flight operation and continue with the queue
+ * @param result Final result
+ * @return void
+ */
+static void fingerprint_finish_operation(enum fingerprint_op_result result)
+{
+    fingerprint_complete_operation(result);
+    fingerprint_next_or_turn_off();
+}
+
+/**
+ * @brief Check the deadline of the in-flight operation, reissue or fail it once expired
+ * @note Called periodically from the UART task
+ * @return void
+ */
+static void fingerprint_check_deadline()
+{
+    struct fingerprint_operation op;
+    taskENTER_CRITICAL(&op_lock);
+    bool expired = op_in_flight && esp_timer_get_time() >= current_op.deadline;
+    taskEXIT_CRITICAL(&op_lock);
+    if (!expired || !fingerprint_take_current_operation(&op))
+    {
+        return;
+    }
+    if (op.retries > 0)
+    {
+        op.retries--;
+        ESP_LOGW(TAG, "Operation %u timed out, reissuing (%u retries left)", op.handle, op.retries);
+        if (!fingerprint_push_operation(&op, true))
+        {
+            fingerprint_notify_operation(&op, FP_OP_TIMEOUT);
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Operation %u timed out", op.handle);
+        fingerprint_notify_operation(&op, FP_OP_TIMEOUT);
+    }
+    // Abort whatever the module is still doing, the cancel acknowledgement dispatches the next operation
+    cancel_current_operation_and_execute_command();
+}
+
+/**
+ * @brief Assign a handle to an operation, queue it and wake the module if it is the only one
+ * @note The busy check and the push happen in one critical section, so of two concurrent submitters exactly one sees
+ *       an empty queue and wakes the module
+ * @param op Operation to queue (handle is filled in)
+ * @return fingerprint_op_handle_t Operation handle, 0 = queue full
+ */
+static fingerprint_op_handle_t fingerprint_queue_operation(struct fingerprint_operation *op)
+{
+    taskENTER_CRITICAL(&op_lock);
+    op->handle = op_next_handle++;
+    if (op_next_handle == 0)
+    {
+        op_next_handle = 1; // 0 is reserved for invalid handles
+    }
+    bool busy = op_in_flight || op_count > 0;
+    bool queued = fingerprint_enqueue_operation(op, false);
+    taskEXIT_CRITICAL(&op_lock);
+
+    if (!queued)
+    {
+        ESP_LOGE(TAG, "Operation queue full, operation type %u rejected", op->type);
+        return 0;
+    }
+    ESP_LOGI(TAG, "Operation %u (type %u) queued, current module state: %u", op->handle, op->type, zw111.state);
+    if (busy)
+    {
+        return op->handle; // Dispatched when the operations ahead of it complete
+    }
+    if (turn_on_fingerprint(0x0A))
+    {
+        // Powered on, queued operations are dispatched once the module reports power-on
+    }
+    else if (fingerprint_leave_idle(0x0A) ||
+             (zw111.state != 0x0A && zw111.state != 0x0B && zw111.state != 0x00 && zw111.state != 0x01 && zw111.state != 0x06))
+    {
+        // Abort verification, the cancel acknowledgement dispatches the queue
+        cancel_current_operation_and_execute_command();
+    }
+    // Otherwise the pending cancel, power-off or start-up sequence dispatches the queue when it finishes
+    return op->handle;
+}
+
+/**
+ * @brief Queue an operation on the fingerprint module
+ * @param type Operation type (FP_OP_ENROLL, FP_OP_DELETE or FP_OP_EMPTY)
+ * @param id Target fingerprint ID (only used by FP_OP_DELETE)
+ * @param timeoutMs Time allowed from dispatch to completion (ms)
+ * @param retries Number of times the operation is reissued after its deadline expires
+ * @param callback Completion callback, may be NULL
+ * @param arg Argument passed to the callback
+ * @return fingerprint_op_handle_t Operation handle, 0 = queue full
+ */
+fingerprint_op_handle_t fingerprint_submit_operation(enum fingerprint_op_type type, uint16_t id, uint32_t timeoutMs, uint8_t retries,
+                                                     fingerprint_op_callback_t callback, void *arg)
+{
+    if (type == FP_OP_BACKUP || type == FP_OP_RESTORE)
+    {
+        ESP_LOGE(TAG, "Template transfers need a stream, use fingerprint_submit_backup/restore");
+        return 0;
+    }
+    struct fingerprint_operation op = {
+        .type = type,
+        .id = id,
+        .timeoutMs = timeoutMs,
+        .retries = retries,
+        .callback = callback,
+        .arg = arg,
+    };
+    return fingerprint_queue_operation(&op);
+}
+
+/**
+ * @brief Queue the upload of an enrolled template to the host
+ * @note Transfers are not reissued after a timeout, the sink has already consumed part of the template
+ * @param id Fingerprint ID to back up (must be enrolled)
+ * @param sink Receives the template packet by packet
+ * @param streamArg Argument passed to the sink
+ * @param callback Completion callback, may be NULL
+ * @param arg Argument passed to the callback
+ * @return fingerprint_op_handle_t Operation handle, 0 = invalid parameters or queue full
+ */
+fingerprint_op_handle_t fingerprint_submit_backup(uint16_t id, fingerprint_template_sink_t sink, void *streamArg,
+                                                  fingerprint_op_callback_t callback, void *arg)
+{
+    if (sink == NULL || !fingerprint_id_exists(id))
+    {
+        ESP_LOGE(TAG, "Backup rejected: ID %u not enrolled or no sink", id);
+        return 0;
+    }
+    struct fingerprint_operation op = {
+        .type = FP_OP_BACKUP,
+        .id = id,
+        .timeoutMs = FP_OP_TRANSFER_TIMEOUT_MS,
+        .retries = 0,
+        .callback = callback,
+        .arg = arg,
+        .sink = sink,
+        .streamArg = streamArg,
+    };
+    return fingerprint_queue_operation(&op);
+}
+
+/**
+ * @brief Queue the download of a template from the host and store it at a fingerprint ID (overwriting it)
+ * @note Transfers are not reissued after a timeout, the source cannot be rewound
+ * @param id Fingerprint ID to store the template at (0 to capacity-1)
+ * @param source Delivers the template, called until it returns 0
+ * @param streamArg Argument passed to the source
+ * @param callback Completion callback, may be NULL
+ * @param arg Argument passed to the callback
+ * @return fingerprint_op_handle_t Operation handle, 0 = invalid parameters or queue full
+ */
+fingerprint_op_handle_t fingerprint_submit_restore(uint16_t id, fingerprint_template_source_t source, void *streamArg,
+                                                   fingerprint_op_callback_t callback, void *arg)
+{
+    if (source == NULL || id >= zw111.capacity)
+    {
+        ESP_LOGE(TAG, "Restore rejected: ID %u out of range or no source", id);
+        return 0;
+    }
+    struct fingerprint_operation op = {
+        .type = FP_OP_RESTORE,
+        .id = id,
+        .timeoutMs = FP_OP_TRANSFER_TIMEOUT_MS,
+        .retries = 0,
+        .callback = callback,
+        .arg = arg,
+        .source = source,
+        .streamArg = streamArg,
+    };
+    return fingerprint_queue_operation(&op);
+}
+
+/**
+ * @brief Cancel all queued and in-flight operations of the given type
+ * @param type Operation type to cancel
+ * @return uint8_t Number of operations cancelled
+ */
+uint8_t fingerprint_cancel_operations(enum fingerprint_op_type type)
+{
+    struct fingerprint_operation cancelled[FP_OP_QUEUE_LEN];
+    uint8_t cancelledCount = 0;
+    taskENTER_CRITICAL(&op_lock);
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < op_count; i++)
+    {
+        struct fingerprint_operation *op = &op_queue[(op_head + i) % FP_OP_QUEUE_LEN];
+        if (op->type == type)
+        {
+            cancelled[cancelledCount++] = *op;
+        }
+        else
+        {
+            op_queue[(op_head + kept) % FP_OP_QUEUE_LEN] = *op;
+            kept++;
+        }
+    }
+    op_count = kept;
+    taskEXIT_CRITICAL(&op_lock);
+
+    for (uint8_t i = 0; i < cancelledCount; i++)
+    {
+        fingerprint_notify_operation(&cancelled[i], FP_OP_CANCELLED);
+    }
+
+    struct fingerprint_operation op;
+    taskENTER_CRITICAL(&op_lock);
+    bool current = op_in_flight && current_op.type == type;
+    taskEXIT_CRITICAL(&op_lock);
+    if (current && fingerprint_take_current_operation(&op))
+    {
+        fingerprint_notify_operation(&op, FP_OP_CANCELLED);
+        cancelledCount++;
+        // The cancel acknowledgement dispatches the next operation or turns the module off
+        cancel_current_operation_and_execute_command();
+    }
+    return cancelledCount;
+}
+
+/**
+ * @brief Touch interrupt service routine
+ * @param arg Interrupt parameter (GPIO number passed in)
+ * @return void
+ */
+static void IRAM_ATTR gpio_isr_handler(void *arg)
+{
+    ESP_EARLY_LOGI(TAG, "Fingerprint touch detected");
+    gpio_set_intr_type(FINGERPRINT_INT_PIN, GPIO_INTR_POSEDGE);
+    gpio_intr_enable(FINGERPRINT_INT_PIN);
+    uint32_t gpio_num = (uint32_t)arg;
+    if (gpio_num == FINGERPRINT_INT_PIN)
+    {
+        xSemaphoreGiveFromISR(fingerprint_semaphore, NULL);
+    }
+}
+
+/**
+ * @brief Initialize fingerprint module
+ * @return esp_err_t ESP_OK = initialization succeeded, ESP_FAIL = invalid data or initialization failed
+ */
+esp_err_t fingerprint_initialization()
+{
+    fingerprint_semaphore = xSemaphoreCreateBinary(); // Only used to activate the module after touch detection
+    if (g_gpio_isr_service_installed == false)
+    {
+        gpio_install_isr_service(0);
+        g_gpio_isr_service_installed = true;
+    }
+
+    // Load keep-warm window, fall back to the default when not configured
+    if (nvs_custom_get_u8(NULL, "fingerprint", "keep_warm", &g_fingerprint_keep_warm_time) != ESP_OK)
+    {
+        g_fingerprint_keep_warm_time = DEFAULT_FINGERPRINT_KEEP_WARM_TIME;
+    }
+    ESP_LOGI(TAG, "Keep-warm window: %u s", g_fingerprint_keep_warm_time);
+
+    const esp_timer_create_args_t keep_warm_timer_args = {
+        .callback = keep_warm_timer_callback,
+        .name = "fp_keep_warm"};
+    if (esp_timer_create(&keep_warm_timer_args, &keep_warm_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Keep-warm timer creation failed, module will be powered off after every operation");
+    }
+
+    // Allocate the ID bitmap for the default capacity, resized once the module reports its capacity
+    if (fingerprint_resize_index(FINGERPRINT_DEFAULT_CAPACITY) != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    uint16_t packetSize = 0;
+    if (nvs_custom_get_u16(NULL, "fingerprint", "packet_size", &packetSize) == ESP_OK && packetSize >= 32 &&
+        packetSize <= FINGERPRINT_MAX_PACKET_SIZE)
+    {
+        zw111.packetSize = packetSize;
+    }
+    else
+    {
+        zw111.packetSize = FINGERPRINT_DEFAULT_PACKET_SIZE;
+    }
+    // Serve the enrolled list from the cache when it is trusted, the module only has to be read otherwise
+    bool index_cached = fingerprint_load_index_cache() == ESP_OK;
+
+    // Initialize UART communication
+    if (!index_cached && fingerprint_initialization_uart() != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    // Initialize fingerprint module data structure
+    zw111.deviceAddress[0] = 0xFF;
+    zw111.deviceAddress[1] = 0xFF;
+    zw111.deviceAddress[2] = 0xFF;
+    zw111.deviceAddress[3] = 0xFF;
+
+    gpio_config_t zw111_int_gpio_config = {
+        .pin_bit_mask = (1ULL << FINGERPRINT_INT_PIN),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_POSEDGE};
+    gpio_config(&zw111_int_gpio_config);
+
+    gpio_config_t fingerprint_ctl_gpio_config = {
+        .pin_bit_mask = (1ULL << FINGERPRINT_CTL_PIN),
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE};
+    gpio_config(&fingerprint_ctl_gpio_config);
+
+    gpio_set_level(FINGERPRINT_CTL_PIN, index_cached ? 1 : 0); // Power on only to read the index
+    zw111.power = !index_cached; // A touch or operation during the index read must not power it on again
+    awaiting_power_on = !index_cached;
+
+    gpio_isr_handler_add(FINGERPRINT_INT_PIN, gpio_isr_handler, (void *)FINGERPRINT_INT_PIN);
+    ESP_LOGI(TAG, "zw111 interrupt gpio configured");
+
+    if (!index_cached)
+    {
+        // Create a task to handle UART event from ISR
+        xTaskCreate(uart_task, "uart_task", 8192, NULL, 10, NULL);
+        ESP_LOGI(TAG, "uart task created");
+    }
+
+    // Create a task to handle fingerprint processing after touch detection
+    xTaskCreate(fingerprint_task, "fingerprint_task", 8192, NULL, 10, NULL);
+    ESP_LOGI(TAG, "fingerprint task created");
+
+#if FINGERPRINT_SIMULATOR && FINGERPRINT_SIMULATOR_BENCHMARK_RUNS > 0
+    xTaskCreate(zw111_sim_benchmark_task, "zw111_sim_bench", 4096, (void *)FINGERPRINT_SIMULATOR_BENCHMARK_RUNS, 5, NULL);
+#endif
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Fingerprint task
+ * @param pvParameters Task parameters (unused)
+ * @return void
+ */
+void fingerprint_task(void *pvParameters)
+{
+    while (1)
+    {
+        // Wait for semaphore to be released
+        if (xSemaphoreTake(fingerprint_semaphore, portMAX_DELAY) == pdTRUE)
+        {
+            notify_user_activity();
+            // Semaphore released, indicating fingerprint module is ready
+            ESP_LOGI(TAG, "Fingerprint module is ready, start processing tasks");
+            // Print current module state
+            ESP_LOGI(TAG, "Fingerprint module power state: %s", zw111.power ? "Powered on" : "Powered off");
+            ESP_LOGI(TAG, "Fingerprint module state: %s",
+                     zw111.state == 0x00   ? "Initial state"
+                     : zw111.state == 0x01 ? "Read index table state"
+                     : zw111.state == 0x02 ? "Enroll fingerprint state"
+                     : zw111.state == 0x03 ? "Delete fingerprint state"
+                     : zw111.state == 0x04 ? "Verify fingerprint state"
+                     : zw111.state == 0x05 ? "Idle state"
+                     : zw111.state == 0x06 ? "Read system parameters state"
+                     : zw111.state == 0x07 ? "Template backup state"
+                     : zw111.state == 0x08 ? "Template restore state"
+                     : zw111.state == 0x0A ? "Cancel state"
+                     : zw111.state == 0x0B ? "Sleep state"
+                                           : "Unknown state");
+            ESP_LOGI(TAG, "Fingerprint module device address: %02X:%02X:%02X:%02X",
+                     zw111.deviceAddress[0], zw111.deviceAddress[1],
+                     zw111.deviceAddress[2], zw111.deviceAddress[3]);
+            ESP_LOGI(TAG, "Number of enrolled fingerprints in module: %u", zw111.fingerNumber);
+            ESP_LOGI(TAG, "Enrolled fingerprint IDs in module: ");
+            for (uint16_t id = fingerprint_id_next(0); id != FINGERPRINT_ID_NONE; id = fingerprint_id_next(id + 1))
+            {
+                ESP_LOGI(TAG, "%u ", id);
+            }
+            touch_time = esp_timer_get_time();
+            // Start fingerprint verification
+            if (turn_on_fingerprint(0x04)) // Power off state, verify fingerprint once the module reports power-on
+            {
+                ESP_LOGI(TAG, "Current state was power off, verifying fingerprint after power-on");
+                timing.warm = false;
+                timing.coldCount++;
+            }
+            else if (fingerprint_leave_idle(0x04)) // Idle state, module still powered within the keep-warm window
+            {
+                ESP_LOGI(TAG, "Module is warm, verifying fingerprint directly");
+                esp_timer_stop(keep_warm_timer);
+                timing.warm = true;
+                timing.warmCount++;
+                timing.powerOnMs = 0;
+                fingerprint_start_identify();
+            }
+            else if (zw111.state == 0x0B) // The keep-warm window ended just before the touch
+            {
+                ESP_LOGW(TAG, "Module is going to sleep, touch ignored");
+            }
+            else if (zw111.state == 0x00 || zw111.state == 0x01 || zw111.state == 0x06 || zw111.state == 0x0A)
+            {
+                ESP_LOGW(TAG, "Module is starting up or busy with queued operations, touch ignored");
+            }
+            // Handle abnormal module state
+            else if (zw111.power == true) // Power on state
+            {
+                ESP_LOGE(TAG, "Current state is abnormal, preparing to turn off fingerprint module");
+                cancel_and_turn_off_fingerprint(); // Cancel current operation and turn off fingerprint module
+            }
+        }
+    }
+}
+
+/**
+ * @brief Start reading the index table from page 0, the remaining pages are requested as each response arrives
+ * @return void
+ */
+static void fingerprint_start_index_read()
+{
+    zw111.state = 0X01; // Switch to read index table state
+    index_page = 0;
+    memset(zw111.fingerIDBitmap, 0, zw111.bitmapBytes);
+    zw111.fingerNumber = 0;
+    if (read_index_table(NULL, 0) != ESP_OK)
+    {
+        fingerprint_next_or_turn_off(); // Dispatch queued operations or turn off fingerprint module
+    }
+}
+
+/**
+ * @brief Fill one data packet from the source of the in-flight restore operation
+ * @param buf Packet buffer
+ * @param size Packet size
+ * @return int Number of bytes filled (less than size only at the end of the template), negative = source aborted
+ */
+static int fingerprint_fill_packet(uint8_t *buf, uint16_t size)
+{
+    uint16_t filled = 0;
+    while (filled < size)
+    {
+        int n = current_op.source(current_op.id, buf + filled, size - filled, current_op.streamArg);
+        if (n < 0)
+        {
+            return n;
+        }
+        if (n == 0)
+        {
+            break; // End of template
+        }
+        filled += n;
+    }
+    return filled;
+}
+
+/**
+ * @brief Stream the template of the in-flight restore operation to the module, packet by packet
+ * @note One packet is read ahead so the final packet can be flagged PACKET_DATA_LAST; packets go out back to back,
+ *       the UART driver blocks once its TX buffer is full, which throttles the source to the line rate
+ * @return esp_err_t ESP_OK = template sent, ESP_FAIL = empty template, source aborted or write failed
+ */
+static esp_err_t fingerprint_send_template()
+{
+    static uint8_t packets[2][FINGERPRINT_MAX_PACKET_SIZE];
+    uint16_t size = zw111.packetSize;
+    uint8_t current = 0;
+    int filled = fingerprint_fill_packet(packets[current], size);
+    if (filled <= 0)
+    {
+        ESP_LOGE(TAG, "Template restore - No template data from source");
+        return ESP_FAIL;
+    }
+    while (1)
+    {
+        int next = filled == size ? fingerprint_fill_packet(packets[current ^ 1], size) : 0;
+        if (next < 0)
+        {
+            ESP_LOGE(TAG, "Template restore - Source aborted after %" PRIu32 " bytes", transfer_bytes);
+            return ESP_FAIL;
+        }
+        if (send_data_packet(next == 0 ? PACKET_DATA_LAST : PACKET_DATA_MORE, packets[current], filled) != ESP_OK)
+        {
+            return ESP_FAIL;
+        }
+        transfer_bytes += filled;
+        if (next == 0)
+        {
+            return ESP_OK;
+        }
+        current ^= 1;
+        filled = next;
+    }
+}
+
+/**
+ * @brief Abort the in-flight template transfer, the cancel acknowledgement dispatches the next operation
+ * @return void
+ */
+static void fingerprint_abort_transfer()
+{
+    fingerprint_complete_operation(FP_OP_FAILED);
+    cancel_current_operation_and_execute_command();
+}
+
+/**
+ * @brief Handle a data packet uploaded by the module during a template backup
+ * @param receive_data Frame buffer (starts with the frame header)
+ * @param length Total frame length in bytes
+ * @return void
+ */
+static void fingerprint_handle_template_packet(const uint8_t *receive_data, uint16_t length)
+{
+    bool last = receive_data[6] == PACKET_DATA_LAST;
+    uint16_t len = length - FRAME_HEADER_LEN - CHECKSUM_LEN;
+    if (current_op.sink(current_op.id, receive_data + FRAME_HEADER_LEN, len, last, current_op.streamArg) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Template backup - Aborted by sink after %" PRIu32 " bytes", transfer_bytes);
+        fingerprint_abort_transfer();
+        return;
+    }
+    transfer_bytes += len;
+    if (last)
+    {
+        ESP_LOGI(TAG, "Template backup - ID %u uploaded, %" PRIu32 " bytes", current_op.id, transfer_bytes);
+        fingerprint_finish_operation(FP_OP_SUCCESS);
+    }
+}
+
+/**
+ * @brief Handle the acknowledgement of a template transfer command and issue the next step
+ * @param code Confirmation code
+ * @return void
+ */
+static void fingerprint_handle_transfer_ack(uint8_t code)
+{
+    if (code != 0x00)
+    {
+        ESP_LOGE(TAG, "Template transfer - Step %u failed, confirmation code: 0x%02X", transfer_step, code);
+        fingerprint_finish_operation(FP_OP_FAILED);
+        return;
+    }
+    switch (transfer_step)
+    {
+    case TRANSFER_LOAD:
+        transfer_step = TRANSFER_UPLOAD;
+        if (up_char(NULL, FINGERPRINT_TEMPLATE_BUFFER) != ESP_OK)
+        {
+            fingerprint_finish_operation(FP_OP_FAILED);
+        }
+        break;
+    case TRANSFER_UPLOAD:
+        ESP_LOGI(TAG, "Template backup - Upload accepted, receiving data packets");
+        break;
+    case TRANSFER_DOWNLOAD:
+        if (fingerprint_send_template() != ESP_OK)
+        {
+            fingerprint_abort_transfer();
+            break;
+        }
+        ESP_LOGI(TAG, "Template restore - %" PRIu32 " bytes sent, storing at ID %u", transfer_bytes, current_op.id);
+        transfer_step = TRANSFER_STORE;
+        if (store_char(NULL, FINGERPRINT_TEMPLATE_BUFFER, current_op.id) != ESP_OK)
+        {
+            fingerprint_finish_operation(FP_OP_FAILED);
+        }
+        break;
+    case TRANSFER_STORE:
+        ESP_LOGI(TAG, "Template restore - ID %u stored", current_op.id);
+        insert_fingerprint_id(current_op.id);
+        fingerprint_finish_operation(FP_OP_SUCCESS);
+        break;
+    }
+}
+
+/**
+ * @brief Handle a complete, checksum-verified frame emitted by the reassembler
+ * @param receive_data Frame buffer (starts with the frame header)
+ * @param length Total frame length in bytes
+ * @return void
+ */
+static void fingerprint_handle_frame(const uint8_t *receive_data, uint16_t length)
+{
+    // Data packets only arrive while a template is being uploaded
+    if ((receive_data[6] == PACKET_DATA_MORE || receive_data[6] == PACKET_DATA_LAST) &&
+        zw111.state == 0X07 && transfer_step == TRANSFER_UPLOAD && op_in_flight)
+    {
+        fingerprint_handle_template_packet(receive_data, length);
+        return;
+    }
+    // Otherwise only response packets are expected from the module
+    if (receive_data[6] != PACKET_RESPONSE)
+    {
+        ESP_LOGE(TAG, "Incorrect packet identifier (expected response packet %02X, actual %02X), discarded", PACKET_RESPONSE, receive_data[6]);
+        return;
+    }
+    if (zw111.state == 0X0B && length == 12) // Sleep state
+    {
+        if (receive_data[9] == 0x00) // Confirm code = 00H means sleep setting succeeded
+        {
+            fingerprint_deinitialization_uart();    // Delete UART driver
+            zw111.power = false;                    // Set power state to false
+            awaiting_power_on = false;
+            zw111.state = 0X00;                     // Switch to initial state
+            gpio_set_level(FINGERPRINT_CTL_PIN, 1); // Power off fingerprint module
+            ESP_LOGI(TAG, "Fingerprint module powered off, state reset to initial state");
+            // gpio_intr_enable(FINGERPRINT_INT_PIN);
+            fingerprint_complete_operation(FP_OP_CANCELLED); // An operation interrupted by power-off is not resumed
+            if (op_count > 0)
+            {
+                // Operations were queued while the module was shutting down, power it on again to run them
+                vTaskDelay(pdMS_TO_TICKS(100));
+                turn_on_fingerprint(0x0A); // No-op if a submitter already powered it on
+            }
+            vTaskDelete(NULL); // Delete current task
+        }
+    }
+    else if (zw111.state == 0X0A && length == 12) // Cancel state
+    {
+        if (receive_data[9] == 0x00) // Confirm code = 00H means cancel operation succeeded
+        {
+            ESP_LOGI(TAG, "Cancel operation succeeded, preparing to execute other commands");
+            fingerprint_next_or_turn_off(); // Dispatch queued operations or turn off fingerprint module
+        }
+    }
+    else if (zw111.state == 0X04 && length == 17) // Verify fingerprint state
+    {
+        if (awaiting_first_response)
+        {
+            timing.firstResponseMs = (uint32_t)((esp_timer_get_time() - identify_time) / 1000);
+            awaiting_first_response = false;
+        }
+        if (receive_data[10] == 0x00 && receive_data[9] == 0x00)
+        {
+            ESP_LOGI(TAG, "Verify fingerprint - Command executed successfully, waiting for image capture");
+        }
+        else if (receive_data[10] == 0x01)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Verify fingerprint - Image capture succeeded");
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGW(TAG, "Verify fingerprint - Image capture timeout");
+                fingerprint_enter_idle(); // Keep warm or turn off fingerprint module
+            }
+        }
+        else if (receive_data[10] == 0x05)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                fingerprint_record_identify_result();
+                uint16_t fingerID = (receive_data[11] << 8) | receive_data[12]; // Fingerprint ID
+                uint16_t score = (receive_data[13] << 8) | receive_data[14];    // Matching score
+                ESP_LOGI(TAG, "Verify fingerprint - Fingerprint found, ID: %u, Score: %u", fingerID, score);
+                uint8_t message = 0x01;
+                if (!fingerprint_match_allowed(fingerID))
                 {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    if (dtmp[10] == 0x00 && dtmp[11] == 0x00)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - Command executed successfully, waiting for image capture");
-                        }
-                        else if (dtmp[9] == 0x22)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGE(TAG, "Enroll fingerprint - Current ID is already in use, please select another ID");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGE(TAG, "Enroll fingerprint - Unknown data, discarded");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x01)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture succeeded", dtmp[11]);
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture timeout", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture failed", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x02)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth feature generation succeeded", dtmp[11]);
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth feature generation timeout", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture failed", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x03)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment succeeded", dtmp[11]);
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment timeout", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment failed", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x04 && dtmp[11] == 0xF0)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template merging succeeded", dtmp[11]);
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template merging timeout", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template merging failed", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x05 && dtmp[11] == 0xF1)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection passed");
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection timeout");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection failed", dtmp[11]);
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
-                    else if (dtmp[10] == 0x06 && dtmp[11] == 0xF2)
-                    {
-                        if (dtmp[9] == 0x00)
-                        {
-                            send_operation_result("fingerprint_added", true);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template storage succeeded, ID: %u", get_mini_unused_id());
-                            insert_fingerprint_id(get_mini_unused_id());
-                            send_fingerprint_list();
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else if (dtmp[9] == 0x26)
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template storage timeout");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                        else
-                        {
-                            send_operation_result("fingerprint_added", false);
-                            ESP_LOGI(TAG, "Enroll fingerprint - Template storage failed");
-                            prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                        }
-                    }
+                    ESP_LOGW(TAG, "Verify fingerprint - ID %u requires its card, refused", fingerID);
+                    message = 0x00;
                 }
-                else if (zw111.state == 0X03 && event.size == 12) // Delete fingerprint state
+                xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
+            }
+            else if (receive_data[9] == 0x09)
+            {
+                ESP_LOGI(TAG, "Verify fingerprint - No fingerprint found");
+                fingerprint_record_identify_result();
+                uint8_t message = 0x00;
+                xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
+            }
+            else if (receive_data[9] == 0x24)
+            {
+                ESP_LOGW(TAG, "Verify fingerprint - Fingerprint library is empty");
+                fingerprint_record_identify_result();
+                uint8_t message = 0x00;
+                xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
+            }
+        }
+        else if (receive_data[10] == 0x02 && receive_data[9] == 0x09)
+        {
+            ESP_LOGW(TAG, "Verify fingerprint - No finger on sensor");
+            fingerprint_record_identify_result();
+            uint8_t message = 0x00;
+            xQueueSend(fingerprint_queue, &message, portMAX_DELAY);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Verify fingerprint - Unknown data, discarded");
+            fingerprint_enter_idle(); // Keep warm or turn off fingerprint module
+        }
+    }
+    else if (zw111.state == 0X06 && length == 28) // Read system parameters state
+    {
+        if (receive_data[9] == 0x00)
+        {
+            uint16_t capacity = (receive_data[14] << 8) | receive_data[15]; // Fingerprint library size
+            ESP_LOGI(TAG, "System parameters - Sensor type: %u, template capacity: %u",
+                     (receive_data[12] << 8) | receive_data[13], capacity);
+            if (capacity > FINGERPRINT_MAX_CAPACITY)
+            {
+                ESP_LOGW(TAG, "System parameters - Capacity %u capped at %u", capacity, FINGERPRINT_MAX_CAPACITY);
+                capacity = FINGERPRINT_MAX_CAPACITY; // IDs above the cap are not used
+            }
+            if (capacity != zw111.capacity)
+            {
+                fingerprint_resize_index(capacity); // Keeps the current capacity on failure
+            }
+            uint16_t sizeCode = (receive_data[22] << 8) | receive_data[23]; // Data packet size: 0=32, 1=64, 2=128, 3=256 bytes
+            if (sizeCode <= 3 && (32 << sizeCode) != zw111.packetSize)
+            {
+                zw111.packetSize = 32 << sizeCode;
+                nvs_custom_set_u16(NULL, "fingerprint", "packet_size", zw111.packetSize); // Known without a power-on next boot
+                ESP_LOGI(TAG, "System parameters - Data packet size: %u bytes", zw111.packetSize);
+            }
+        }
+        else
+        {
+            ESP_LOGW(TAG, "System parameters - Read failed (0x%02X), keeping capacity %u", receive_data[9], zw111.capacity);
+        }
+        fingerprint_start_index_read();
+    }
+    else if (zw111.state == 0X01 && length == 44) // Read index table state
+    {
+        ESP_LOGI(TAG, "Received index table page %u, length: %u", index_page, length);
+        fingerprint_parse_frame(receive_data, length, index_page); // Parse fingerprint index table data
+        index_page++;
+        if (index_page * FINGERPRINT_INDEX_PAGE_IDS < zw111.capacity && read_index_table(NULL, index_page) == ESP_OK)
+        {
+            return; // Wait for the next page
+        }
+        fingerprint_log_index();
+        index_in_doubt = false; // Read from the module, whatever earlier operations did is now known
+        fingerprint_save_index_cache();
+        fingerprint_next_or_turn_off(); // Dispatch queued operations or turn off fingerprint module
+    }
+    else if (zw111.state == 0X02 && length == 14) // Enroll fingerprint state
+    {
+        if (receive_data[10] == 0x00 && receive_data[11] == 0x00)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Command executed successfully, waiting for image capture");
+            }
+            else if (receive_data[9] == 0x22)
+            {
+                ESP_LOGE(TAG, "Enroll fingerprint - Current ID is already in use, please select another ID");
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Enroll fingerprint - Unknown data, discarded");
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x01)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture succeeded", receive_data[11]);
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture timeout", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture failed", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x02)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth feature generation succeeded", receive_data[11]);
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth feature generation timeout", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - %uth image capture failed", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x03)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment succeeded", receive_data[11]);
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment timeout", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Finger removed %uth time, enrollment failed", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x04 && receive_data[11] == 0xF0)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template merging succeeded", receive_data[11]);
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template merging timeout", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template merging failed", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x05 && receive_data[11] == 0xF1)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection passed");
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection timeout");
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Enrollment detection failed", receive_data[11]);
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+        else if (receive_data[10] == 0x06 && receive_data[11] == 0xF2)
+        {
+            if (receive_data[9] == 0x00)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template storage succeeded, ID: %u", current_op.id);
+                insert_fingerprint_id(current_op.id);
+                fingerprint_finish_operation(FP_OP_SUCCESS);
+            }
+            else if (receive_data[9] == 0x26)
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template storage timeout");
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Enroll fingerprint - Template storage failed");
+                fingerprint_finish_operation(FP_OP_FAILED);
+            }
+        }
+    }
+    else if ((zw111.state == 0X07 || zw111.state == 0X08) && length == 12 && op_in_flight) // Template backup/restore state
+    {
+        fingerprint_handle_transfer_ack(receive_data[9]);
+    }
+    else if (zw111.state == 0X03 && length == 12) // Delete fingerprint state
+    {
+        if (receive_data[9] != 0x00)
+        {
+            ESP_LOGE(TAG, "Delete fingerprint - Failed, confirmation code: 0x%02X", receive_data[9]);
+            fingerprint_finish_operation(FP_OP_FAILED);
+        }
+        // Handle clear all fingerprints
+        else if (op_in_flight && current_op.type == FP_OP_EMPTY)
+        {
+            memset(zw111.fingerIDBitmap, 0, zw111.bitmapBytes); // Clear fingerprint IDs
+            zw111.fingerNumber = 0;                             // Clear fingerprint count
+            ESP_LOGI(TAG, "Delete fingerprint - Clear all fingerprints succeeded");
+            fingerprint_finish_operation(FP_OP_SUCCESS);
+        }
+        // Handle delete single fingerprint
+        else if (op_in_flight && current_op.type == FP_OP_DELETE)
+        {
+            remove_fingerprint_id(current_op.id);
+            ESP_LOGI(TAG, "Delete fingerprint - Delete ID:%u succeeded", current_op.id);
+            fingerprint_finish_operation(FP_OP_SUCCESS);
+        }
+        else
+        {
+            fingerprint_next_or_turn_off(); // Dispatch queued operations or turn off fingerprint module
+        }
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Unexpected frame in state 0x%02X (length %u), discarded", zw111.state, length);
+    }
+}
+
+/**
+ * @brief UART event handling task
+ * @param pvParameters Task parameters (unused)
+ * @return void
+ */
+void uart_task(void *pvParameters)
+{
+    uart_event_t event;
+    static uint8_t dtmp[1024];
+    while (1)
+    {
+        // Wake up periodically even without UART events so operation deadlines are enforced
+        if (xQueueReceive(uart2_queue, (void *)&event, pdMS_TO_TICKS(FP_OP_POLL_MS)) == pdTRUE)
+        {
+            size_t buffered_size;
+            int received;
+            switch (event.type)
+            {
+            case UART_DATA:
+                // Hand whatever the driver delivered to the reassembler, frames may be split or coalesced
+                received = fingerprint_uart_read(dtmp, event.size < sizeof(dtmp) ? event.size : sizeof(dtmp), portMAX_DELAY);
+                if (received > 0)
                 {
-                    // Receive data first
-                    uart_read_bytes(EX_UART_NUM, dtmp, event.size, portMAX_DELAY);
-                    // Verify if received data is valid
-                    if (verify_received_data(dtmp, event.size) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "Received invalid data, discarded");
-                        break; // Discard invalid data
-                    }
-                    // Handle clear all fingerprints
-                    if (g_ready_delete_fingerprint == false && g_ready_delete_all_fingerprint == true)
-                    {
-                        for (size_t i = 0; i <= zw111.fingerNumber; i++)
-                        {
-                            zw111.fingerIDArray[i] = 0xFF; // Clear fingerprint IDs
-                        }
-                        send_operation_result("fingerprint_cleared", true);
-                        zw111.fingerNumber = 0;                 // Clear fingerprint count
-                        g_ready_delete_all_fingerprint = false; // Reset delete all fingerprints flag
-                        ESP_LOGI(TAG, "Delete fingerprint - Clear all fingerprints succeeded");
-                    }
-                    // Handle delete single fingerprint
-                    else if (g_ready_delete_fingerprint == true && g_ready_delete_all_fingerprint == false)
-                    {
-                        // Find position of target ID
-                        size_t i;
-                        for (i = 0; i < zw111.fingerNumber; i++)
-                        {
-                            if (zw111.fingerIDArray[i] == g_deleteFingerprintID)
-                            {
-                                break; // Target found, exit loop to prepare deletion
-                            }
-                        }
-                        // Shift elements forward to fill the gap
-                        for (size_t j = i; j < zw111.fingerNumber - 1; j++)
-                        {
-                            zw111.fingerIDArray[j] = zw111.fingerIDArray[j + 1];
-                        }
-                        zw111.fingerIDArray[zw111.fingerNumber - 1] = 0xFF; // Reset last position to 0xFF
-                        zw111.fingerNumber--;                               // Decrease fingerprint count
-                        send_operation_result("fingerprint_deleted", true);
-                        send_fingerprint_list();
-                        g_ready_delete_fingerprint = false; // Reset delete single fingerprint flag
-                        ESP_LOGI(TAG, "Delete fingerprint - Delete ID:%u succeeded", g_deleteFingerprintID);
-                    }
-                    prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
+                    fingerprint_feed_bytes(dtmp, received);
                 }
                 break;
             case UART_PATTERN_DET:
-                uart_get_buffered_data_len(EX_UART_NUM, &buffered_size);
-                int pos = uart_pattern_pop_pos(EX_UART_NUM);
+                fingerprint_uart_buffered_len(&buffered_size);
+                int pos = fingerprint_uart_pattern_pop_pos();
                 ESP_LOGI(TAG, "[UART PATTERN DETECTED] pos: %d, buffered size: %u", pos, buffered_size);
                 if (pos == -1)
                 {
                     // There used to be a UART_PATTERN_DET event, but the pattern position queue is full so that it can not
                     // record the position. We should set a larger queue size.
                     // As an example, we directly flush the rx buffer here.
-                    uart_flush_input(EX_UART_NUM);
+                    fingerprint_uart_flush_input();
                 }
                 else
                 {
-                    uart_read_bytes(EX_UART_NUM, dtmp, pos, pdMS_TO_TICKS(100));
+                    // Bytes ahead of the pattern belong to the frame stream
+                    received = fingerprint_uart_read(dtmp, pos, pdMS_TO_TICKS(100));
+                    if (received > 0)
+                    {
+                        fingerprint_feed_bytes(dtmp, received);
+                    }
                     uint8_t pat[2];
                     memset(pat, 0, sizeof(pat));
-                    uart_read_bytes(EX_UART_NUM, pat, 1, pdMS_TO_TICKS(100));
-                    if (pat[0] == 0X55)
+                    received = fingerprint_uart_read(pat, 1, pdMS_TO_TICKS(100));
+                    if (pat[0] != 0X55 || !awaiting_power_on || rx_frame.length > 0)
+                    {
+                        // A frame byte that happens to be 0x55 before line idle, not the power-on handshake
+                        if (received > 0)
+                        {
+                            fingerprint_feed_bytes(pat, received);
+                        }
+                    }
+                    else
                     {
+                        awaiting_power_on = false;
                         ESP_LOGI(TAG, "Fingerprint module just powered on, state: %s",
                                  zw111.state == 0x00   ? "Initial state"
                                  : zw111.state == 0x01 ? "Read index table state"
                                  : zw111.state == 0x02 ? "Enroll fingerprint state"
                                  : zw111.state == 0x03 ? "Delete fingerprint state"
                                  : zw111.state == 0x04 ? "Verify fingerprint state"
+                                 : zw111.state == 0x05 ? "Idle state"
+                                 : zw111.state == 0x06 ? "Read system parameters state"
+                                 : zw111.state == 0x07 ? "Template backup state"
+                                 : zw111.state == 0x08 ? "Template restore state"
                                  : zw111.state == 0x0A ? "Cancel state"
                                  : zw111.state == 0x0B ? "Sleep state"
                                                        : "Unknown state");
                         if (zw111.state == 0X04) // Verify fingerprint state
                         {
-                            // Send verify fingerprint command
-                            if (auto_identify(0xFFFF, 2, false, false, false) != ESP_OK)
-                            {
-                                ESP_LOGE(TAG, "Failed to send verify fingerprint command");
-                                prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                            }
+                            timing.powerOnMs = (uint32_t)((esp_timer_get_time() - power_on_time) / 1000);
+                            fingerprint_start_identify();
                         }
                         else if (zw111.state == 0X00) // Just powered on state
                         {
-                            zw111.state = 0X01; // Switch to read index table state
-                            read_index_table(0);
-                        }
-                        else if (zw111.state == 0X02) // Enroll fingerprint state
-                        {
-                            ESP_LOGI(TAG, "Fingerprint module in enrollment state, preparing to enroll fingerprint, ID:%u", get_mini_unused_id());
-                            // Send enroll fingerprint command
-                            if (auto_enroll(get_mini_unused_id(), 5, false, false, false, false, true, false) != ESP_OK)
+                            zw111.state = 0X06; // Switch to read system parameters state
+                            if (read_sys_para(NULL) != ESP_OK)
                             {
-                                ESP_LOGE(TAG, "Failed to send enroll fingerprint command");
-                                prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
+                                fingerprint_start_index_read(); // Keep the current capacity
                             }
                         }
-                        else if (zw111.state == 0X03) // Delete fingerprint state
+                        else if (zw111.state == 0X0A) // Powered on to run queued operations
                         {
-                            if (g_ready_delete_fingerprint == true && g_ready_delete_all_fingerprint == false)
-                            {
-                                // Delete single fingerprint
-                                if (delete_char(g_deleteFingerprintID, 1) != ESP_OK)
-                                {
-                                    ESP_LOGE(TAG, "Failed to send delete fingerprint command");
-                                    prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                                }
-                            }
-                            else if (g_ready_delete_fingerprint == false && g_ready_delete_all_fingerprint == true)
-                            {
-                                // Delete all fingerprints
-                                if (empty() != ESP_OK)
-                                {
-                                    ESP_LOGE(TAG, "Failed to send delete all fingerprints command");
-                                    prepare_turn_off_fingerprint(); // Prepare to turn off fingerprint module
-                                }
-                            }
+                            fingerprint_next_or_turn_off(); // Dispatch queued operations
                         }
                     }
                 }
@@ -1382,5 +2637,6 @@ void uart_task(void *pvParameters)
                 break;
             }
         }
+        fingerprint_check_deadline();
     }
 }
@@ -1,15 +1,41 @@
 #ifndef ZW111_H
 #define ZW111_H
 
+#include <stdlib.h>
 #include <driver/uart.h>
 #include <driver/gpio.h>
+#include <esp_timer.h>
 #include "app_config.h"
+#include "nvs_custom.h"
 #include "buzzer.h"
 
 #define EX_UART_NUM UART_NUM_2 // UART port used by fingerprint module
 
 #define CHECKSUM_LEN 2         // Checksum length (bytes, fixed to 2)
 #define CHECKSUM_START_INDEX 6 // Checksum calculation start index (packet identifier position)
+#define FRAME_HEADER_LEN 9     // Header (2) + device address (4) + packet identifier (1) + length field (2)
+#define FRAME_MAX_LEN 512      // Largest frame accepted by the reassembler (bytes)
+#define CMD_MAX_PARAM_LEN 5    // Longest parameter list of any command sent by the host (bytes)
+#define CMD_FRAME_MAX_LEN (FRAME_HEADER_LEN + 1 + CMD_MAX_PARAM_LEN + CHECKSUM_LEN) // Longest command frame (bytes)
+#define CMD_BATCH_MAX 2        // Maximum number of commands sent in one UART write
+
+#define FP_OP_QUEUE_LEN 8               // Maximum number of queued fingerprint operations
+#define FP_OP_POLL_MS 100               // Interval at which operation deadlines are checked (ms)
+#define FP_OP_DEFAULT_TIMEOUT_MS 5000   // Deadline of delete/clear operations, counted from dispatch (ms)
+#define FP_OP_ENROLL_TIMEOUT_MS 60000   // Deadline of enroll operations, counted from dispatch (ms)
+#define FP_OP_DEFAULT_RETRIES 1         // Number of times an operation is reissued after its deadline expires
+#define FP_OP_TRANSFER_TIMEOUT_MS 10000 // Deadline of template backup/restore operations, counted from dispatch (ms)
+
+#define FINGERPRINT_DEFAULT_CAPACITY 100 // Template capacity assumed until the system parameters have been read
+#define FINGERPRINT_MAX_CAPACITY 1280    // Largest capacity accepted from the module (5 index table pages)
+#define FINGERPRINT_INDEX_PAGE_BYTES 32  // Bytes of ID bitmap per index table page
+#define FINGERPRINT_INDEX_PAGE_IDS (FINGERPRINT_INDEX_PAGE_BYTES * 8) // IDs covered by one index table page
+#define FINGERPRINT_CARD_REQUIRED_BYTES (FINGERPRINT_MAX_CAPACITY / 8) // Size of the card-required bitmap
+#define FINGERPRINT_ID_NONE 0xFFFF       // Returned when no (further) ID is available
+
+#define FINGERPRINT_DEFAULT_PACKET_SIZE 128 // Data packet size assumed until the system parameters have been read (bytes)
+#define FINGERPRINT_MAX_PACKET_SIZE 256     // Largest data packet size the module can be configured to (bytes)
+#define FINGERPRINT_TEMPLATE_BUFFER 1       // Module character buffer used for template transfers
 
 #define PACKET_CMD 0x01       // Command packet (host sends instruction)
 #define PACKET_DATA_MORE 0x02 // Data packet (with subsequent packets)
@@ -24,6 +50,11 @@
 #define CMD_CANCEL 0x30           // Cancel current operation command
 #define CMD_READ_INDEX_TABLE 0x1F // Read fingerprint index table command
 #define CMD_SLEEP 0x33            // Module sleep command
+#define CMD_READ_SYS_PARA 0x0F    // Read system parameters command
+#define CMD_STORE_CHAR 0x06       // Store character buffer as template command
+#define CMD_LOAD_CHAR 0x07        // Load template into character buffer command
+#define CMD_UP_CHAR 0x08          // Upload character buffer to host command
+#define CMD_DOWN_CHAR 0x09        // Download character buffer from host command
 
 #define BLN_BREATH 1   // Normal breathing light mode
 #define BLN_FLASH 2    // Flashing light mode
@@ -52,6 +83,10 @@ struct fingerprint_device
      * 0X02 Enroll fingerprint state
      * 0X03 Delete fingerprint state
      * 0X04 Verify fingerprint state
+     * 0X05 Idle state (powered, waiting for the next operation within the keep-warm window)
+     * 0X06 Read system parameters state
+     * 0X07 Template backup state (load + upload template)
+     * 0X08 Template restore state (download + store template)
      * 0X0A Cancel command state
      * 0X0B Prepare to power off state
      */
@@ -66,29 +101,122 @@ struct fingerprint_device
     // Device address (4 bytes), default address 0xFFFFFFFF, modifiable
     uint8_t deviceAddress[4];
 
-    // Enrolled fingerprint ID array, maximum 100 entries (0-99), unused positions are 0xFF
-    uint8_t fingerIDArray[100];
+    // Template capacity reported by the module (valid IDs are 0 to capacity-1)
+    uint16_t capacity;
+
+    // Enrolled fingerprint IDs, kept in the module's index table layout (bit n of byte k = ID k*8+n)
+    uint8_t *fingerIDBitmap;
+
+    // Size of fingerIDBitmap in bytes ((capacity + 7) / 8)
+    uint16_t bitmapBytes;
 
     // Current number of valid fingerprints
-    uint8_t fingerNumber;
+    uint16_t fingerNumber;
+
+    // Data packet size used for template transfers (bytes)
+    uint16_t packetSize;
+};
+
+// Operations that can be queued on the fingerprint module
+enum fingerprint_op_type
+{
+    FP_OP_ENROLL,  // Enroll a fingerprint at the smallest unused ID
+    FP_OP_DELETE,  // Delete a single fingerprint
+    FP_OP_EMPTY,   // Clear all fingerprints
+    FP_OP_BACKUP,  // Upload a template to the host
+    FP_OP_RESTORE, // Download a template from the host and store it
+};
+
+// Final result reported to the completion callback of an operation
+enum fingerprint_op_result
+{
+    FP_OP_SUCCESS,   // Module confirmed the operation
+    FP_OP_FAILED,    // Module rejected the operation or the command could not be sent
+    FP_OP_TIMEOUT,   // Deadline expired and all retries were used up
+    FP_OP_CANCELLED, // Operation was cancelled before it completed
 };
 
-extern bool g_ready_add_fingerprint;                                  // Flag for preparing to add fingerprint
-extern bool g_cancel_add_fingerprint;                                 // Flag for canceling fingerprint addition
-extern bool g_ready_delete_fingerprint;                               // Flag for preparing to delete fingerprint
-extern bool g_ready_delete_all_fingerprint;                           // Flag for preparing to delete all fingerprints
-extern uint8_t g_deleteFingerprintID;                                 // Fingerprint ID to be deleted
-extern void send_fingerprint_list();                                  // Send current fingerprint list to front-end
-extern void send_operation_result(const char *message, bool success); // Send operation result to front-end
-extern bool g_gpio_isr_service_installed;                             // Whether GPIO interrupt service is installed
-extern QueueHandle_t fingerprint_queue;                               // Message queue from fingerprint module to buzzer
+typedef uint16_t fingerprint_op_handle_t; // Operation handle, 0 = invalid
+
+/**
+ * Completion callback of an operation, called from the UART task (or from the task cancelling the operation)
+ * id is the fingerprint ID the operation worked on (enrolled ID for FP_OP_ENROLL)
+ */
+typedef void (*fingerprint_op_callback_t)(fingerprint_op_handle_t handle, enum fingerprint_op_type type, uint16_t id,
+                                          enum fingerprint_op_result result, void *arg);
+
+/**
+ * Template sink of a backup operation, called from the UART task for every data packet uploaded by the module
+ * last is true for the final packet of the template. Must not block for long, the module does not wait for the host.
+ * Return ESP_OK to continue, anything else aborts the operation.
+ */
+typedef esp_err_t (*fingerprint_template_sink_t)(uint16_t id, const uint8_t *data, uint16_t len, bool last, void *arg);
+
+/**
+ * Template source of a restore operation, called from the UART task to fill the next data packet
+ * Return the number of bytes written to buf (at most len), 0 = end of template, negative = abort the operation.
+ * May block, packets are only sent as fast as the source delivers them.
+ */
+typedef int (*fingerprint_template_source_t)(uint16_t id, uint8_t *buf, uint16_t len, void *arg);
+
+// Latency measurements of the last verification, used to tune the keep-warm window against battery draw
+struct fingerprint_timing
+{
+    bool warm;                // Whether the module was already powered when the finger touched the sensor
+    uint32_t powerOnMs;       // Power control pin switched on -> module reported power-on (0 when warm)
+    uint32_t firstResponseMs; // Identify command sent -> first response from the module
+    uint32_t identifyMs;      // Touch detected -> identification result
+    uint32_t warmCount;       // Number of verifications served by a powered module
+    uint32_t coldCount;       // Number of verifications that needed a power-on
+    uint32_t resultCount;     // Number of identification results received
+    uint32_t droppedFrames;   // Frames discarded by the reassembler (checksum or length errors)
+};
+
+struct fingerprint_operation
+{
+    fingerprint_op_handle_t handle;       // Handle returned to the submitter
+    enum fingerprint_op_type type;        // Operation type
+    uint16_t id;                          // Fingerprint ID (delete: target ID, enroll: assigned at dispatch)
+    uint32_t timeoutMs;                   // Time allowed from dispatch to completion
+    int64_t deadline;                     // Absolute deadline (esp_timer time in us), valid once dispatched
+    uint8_t retries;                      // Remaining reissues after a deadline expiry
+    fingerprint_op_callback_t callback;   // Completion callback, may be NULL
+    void *arg;                            // Argument passed to the callback
+    fingerprint_template_sink_t sink;     // Template sink (FP_OP_BACKUP only)
+    fingerprint_template_source_t source; // Template source (FP_OP_RESTORE only)
+    void *streamArg;                      // Argument passed to the sink or source
+};
+
+extern uint8_t g_fingerprint_keep_warm_time; // Keep-warm window in seconds, 0 = power off immediately
+extern bool g_gpio_isr_service_installed;    // Whether GPIO interrupt service is installed
+extern QueueHandle_t fingerprint_queue;      // Message queue from fingerprint module to buzzer
 extern void notify_user_activity(void);
 
 void fingerprint_task(void *pvParameters);
 void uart_task(void *pvParameters);
 esp_err_t fingerprint_initialization();
-void turn_on_fingerprint();
+bool turn_on_fingerprint(uint8_t state);
 void prepare_turn_off_fingerprint();
+void cancel_and_turn_off_fingerprint();
+void fingerprint_verification_done();
+esp_err_t fingerprint_set_keep_warm_time(uint8_t seconds);
+void fingerprint_get_timing(struct fingerprint_timing *timing);
+bool fingerprint_id_exists(uint16_t id);
+uint16_t fingerprint_id_next(uint16_t id);
+uint16_t get_mini_unused_id();
 void cancel_current_operation_and_execute_command();
+fingerprint_op_handle_t fingerprint_submit_operation(enum fingerprint_op_type type, uint16_t id, uint32_t timeoutMs, uint8_t retries,
+                                                     fingerprint_op_callback_t callback, void *arg);
+uint8_t fingerprint_cancel_operations(enum fingerprint_op_type type);
+fingerprint_op_handle_t fingerprint_submit_backup(uint16_t id, fingerprint_template_sink_t sink, void *streamArg,
+                                                  fingerprint_op_callback_t callback, void *arg);
+fingerprint_op_handle_t fingerprint_submit_restore(uint16_t id, fingerprint_template_source_t source, void *streamArg,
+                                                   fingerprint_op_callback_t callback, void *arg);
+void fingerprint_arm_verification(const uint16_t *ids, uint8_t count, uint32_t windowMs);
+void fingerprint_set_card_requirements(const uint8_t *required);
+
+#if FINGERPRINT_SIMULATOR
+#include "zw111_sim.h"
+#endif
 
 #endif
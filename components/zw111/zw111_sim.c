@@ -0,0 +1,603 @@
+#include "zw111.h"
+
+#if FINGERPRINT_SIMULATOR
+
+extern const uint8_t FRAME_HEADER[2];           // Fixed frame header value for fingerprint module
+extern struct fingerprint_device zw111;         // Fingerprint module structure instance
+extern SemaphoreHandle_t fingerprint_semaphore; // Semaphore used to signal a touch
+
+static const char *TAG = "zw111_sim";
+
+// A response frame waiting to be delivered to the driver
+struct sim_response
+{
+    uint32_t delayMs;  // Delay before delivery, counted from the previous response
+    uint32_t epoch;    // Cancel epoch the response belongs to, responses of older epochs are dropped
+    bool pattern;      // true = power-on handshake byte (0x55) instead of a frame
+    int32_t storeID;   // ID marked as enrolled on delivery, -1 = none
+    uint16_t length;   // Frame length
+    uint8_t frame[FRAME_HEADER_LEN + SIM_PACKET_SIZE + CHECKSUM_LEN]; // Response or data packet
+};
+
+static struct zw111_sim_config sim_config = {
+    .capacity = 300,
+    .matchDelayMs = 200,
+    .enrollStepDelayMs = 100,
+    .matchFound = true,
+    .matchID = 0,
+    .matchScore = 100,
+    .checksumErrorEvery = 0,
+};
+
+static QueueHandle_t response_queue = NULL; // Scheduled responses, consumed by sim_task
+static QueueHandle_t driver_queue = NULL;   // UART event queue read by uart_task
+static uint8_t rx_buffer[SIM_RX_BUFFER_SIZE];
+static uint16_t rx_head = 0;  // Index of the oldest unread byte
+static uint16_t rx_count = 0; // Number of unread bytes
+static int pattern_pos = -1;  // Position of the pending 0x55 handshake byte, -1 = none
+static uint32_t sim_epoch = 0;
+static uint32_t frame_counter = 0;
+static uint8_t sim_bitmap[(FINGERPRINT_MAX_CAPACITY + 7) / 8]; // Enrolled templates, kept across power cycles
+static int32_t sim_buffer_id = -1;     // ID whose template is held in the character buffer, -1 = empty
+static bool sim_downloading = false;   // Whether a template download is in progress
+static uint32_t sim_download_len = 0;  // Bytes received by the template download
+static portMUX_TYPE sim_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Build a packet and queue it for delivery
+ * @param pid Packet identifier
+ * @param delayMs Delay before delivery (ms)
+ * @param data Data field
+ * @param length Data field length
+ * @param storeID ID marked as enrolled on delivery, -1 = none
+ * @return void
+ */
+static void sim_schedule_packet(uint8_t pid, uint32_t delayMs, const uint8_t *data, uint16_t length, int32_t storeID)
+{
+    struct sim_response response = {
+        .delayMs = delayMs,
+        .epoch = sim_epoch,
+        .pattern = false,
+        .storeID = storeID,
+    };
+    uint16_t dataLen = length + CHECKSUM_LEN;
+    uint16_t pos = 0;
+    response.frame[pos++] = FRAME_HEADER[0];
+    response.frame[pos++] = FRAME_HEADER[1];
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        response.frame[pos++] = zw111.deviceAddress[i];
+    }
+    uint16_t checksum = pid + (dataLen >> 8) + (dataLen & 0xFF);
+    response.frame[pos++] = pid;
+    response.frame[pos++] = (uint8_t)(dataLen >> 8);
+    response.frame[pos++] = (uint8_t)dataLen;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        response.frame[pos++] = data[i];
+        checksum += data[i];
+    }
+    frame_counter++;
+    if (sim_config.checksumErrorEvery != 0 && frame_counter % sim_config.checksumErrorEvery == 0)
+    {
+        checksum ^= 0x0001; // Injected transmission error
+    }
+    response.frame[pos++] = (uint8_t)(checksum >> 8);
+    response.frame[pos++] = (uint8_t)checksum;
+    response.length = pos;
+    if (xQueueSend(response_queue, &response, 0) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Response queue full, response dropped");
+    }
+}
+
+/**
+ * @brief Build a response frame and queue it for delivery
+ * @param delayMs Delay before delivery (ms)
+ * @param data Data field (confirmation code and parameters)
+ * @param length Data field length
+ * @param storeID ID marked as enrolled on delivery, -1 = none
+ * @return void
+ */
+static void sim_schedule(uint32_t delayMs, const uint8_t *data, uint16_t length, int32_t storeID)
+{
+    sim_schedule_packet(PACKET_RESPONSE, delayMs, data, length, storeID);
+}
+
+/**
+ * @brief Queue a response carrying only a confirmation code
+ * @param delayMs Delay before delivery (ms)
+ * @param code Confirmation code
+ * @return void
+ */
+static void sim_schedule_ack(uint32_t delayMs, uint8_t code)
+{
+    sim_schedule(delayMs, &code, 1, -1);
+}
+
+/**
+ * @brief Check whether a template is enrolled in the simulated library
+ */
+static bool sim_id_exists(uint16_t id)
+{
+    return id < sim_config.capacity && ((sim_bitmap[id >> 3] >> (id & 0x07)) & 0x01);
+}
+
+/**
+ * @brief Check whether the simulated library is empty
+ */
+static bool sim_library_empty()
+{
+    for (uint16_t i = 0; i < sizeof(sim_bitmap); i++)
+    {
+        if (sim_bitmap[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Produce the responses of one command received from the driver
+ * @param code Command code
+ * @param param Command parameters
+ * @return void
+ */
+static void sim_handle_command(uint8_t code, const uint8_t *param)
+{
+    switch (code)
+    {
+    case CMD_READ_SYS_PARA:
+    {
+        uint8_t data[17] = {0x00,
+                            0x00, 0x00,                                                    // Status register
+                            0x00, 0x00,                                                    // Sensor type
+                            (uint8_t)(sim_config.capacity >> 8), (uint8_t)sim_config.capacity, // Fingerprint library size
+                            0x00, 0x03,                                                    // Security level
+                            zw111.deviceAddress[0], zw111.deviceAddress[1], zw111.deviceAddress[2], zw111.deviceAddress[3],
+                            0x00, SIM_PACKET_SIZE_CODE, // Data packet size
+                            0x00, 0x0C}; // Baud rate multiplier
+        sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1);
+        break;
+    }
+    case CMD_READ_INDEX_TABLE:
+    {
+        uint8_t data[1 + FINGERPRINT_INDEX_PAGE_BYTES] = {0x00};
+        uint16_t offset = param[0] * FINGERPRINT_INDEX_PAGE_BYTES;
+        for (uint16_t i = 0; i < FINGERPRINT_INDEX_PAGE_BYTES && offset + i < sizeof(sim_bitmap); i++)
+        {
+            data[1 + i] = sim_bitmap[offset + i];
+        }
+        sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1);
+        break;
+    }
+    case CMD_AUTO_ENROLL:
+    {
+        uint16_t id = (param[0] << 8) | param[1];
+        uint8_t times = param[2];
+        bool allowOverwrite = param[4] & (1 << 3);
+        if (id >= sim_config.capacity || (sim_id_exists(id) && !allowOverwrite))
+        {
+            uint8_t data[3] = {0x22, 0x00, 0x00}; // ID already in use
+            sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1);
+            break;
+        }
+        uint8_t data[3] = {0x00, 0x00, 0x00};
+        sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1); // Command accepted
+        for (uint8_t i = 1; i <= times; i++)
+        {
+            for (uint8_t step = 0x01; step <= 0x03; step++) // Image capture, feature generation, finger removed
+            {
+                data[1] = step;
+                data[2] = i;
+                sim_schedule(sim_config.enrollStepDelayMs, data, sizeof(data), -1);
+            }
+        }
+        const uint8_t finalSteps[3][2] = {{0x04, 0xF0}, {0x05, 0xF1}, {0x06, 0xF2}}; // Merge, detection, storage
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            data[1] = finalSteps[i][0];
+            data[2] = finalSteps[i][1];
+            sim_schedule(sim_config.enrollStepDelayMs, data, sizeof(data), i == 2 ? id : -1);
+        }
+        break;
+    }
+    case CMD_AUTO_IDENTIFY:
+    {
+        uint8_t data[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+        sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1); // Command accepted
+        data[1] = 0x01;
+        sim_schedule(sim_config.matchDelayMs, data, sizeof(data), -1); // Image capture succeeded
+        data[1] = 0x05;
+        if (sim_library_empty())
+        {
+            data[0] = 0x24; // Fingerprint library is empty
+        }
+        else if (sim_config.matchFound && sim_id_exists(sim_config.matchID))
+        {
+            data[2] = (uint8_t)(sim_config.matchID >> 8);
+            data[3] = (uint8_t)sim_config.matchID;
+            data[4] = (uint8_t)(sim_config.matchScore >> 8);
+            data[5] = (uint8_t)sim_config.matchScore;
+        }
+        else
+        {
+            data[0] = 0x09; // No fingerprint found
+        }
+        sim_schedule(SIM_RESPONSE_DELAY_MS, data, sizeof(data), -1);
+        break;
+    }
+    case CMD_CANCEL:
+        sim_epoch++; // Drop the responses of the cancelled operation
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        break;
+    case CMD_DELET_CHAR:
+    {
+        uint16_t id = (param[0] << 8) | param[1];
+        uint16_t count = (param[2] << 8) | param[3];
+        for (uint16_t i = id; i < id + count && i < sim_config.capacity; i++)
+        {
+            sim_bitmap[i >> 3] &= ~(1 << (i & 0x07));
+        }
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        break;
+    }
+    case CMD_EMPTY:
+        memset(sim_bitmap, 0, sizeof(sim_bitmap));
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        break;
+    case CMD_LOAD_CHAR:
+    {
+        uint16_t id = (param[1] << 8) | param[2];
+        sim_buffer_id = sim_id_exists(id) ? id : -1;
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, sim_buffer_id >= 0 ? 0x00 : 0x0C); // 0x0C = template read error
+        break;
+    }
+    case CMD_UP_CHAR:
+    {
+        if (sim_buffer_id < 0)
+        {
+            sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x0D); // 0x0D = upload failed
+            break;
+        }
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        // Deterministic template content derived from the ID, so restored templates can be recognised
+        uint8_t packet[SIM_PACKET_SIZE];
+        for (uint16_t offset = 0; offset < SIM_TEMPLATE_LEN; offset += SIM_PACKET_SIZE)
+        {
+            for (uint16_t i = 0; i < SIM_PACKET_SIZE; i++)
+            {
+                packet[i] = (uint8_t)(sim_buffer_id * 7 + offset + i);
+            }
+            bool last = offset + SIM_PACKET_SIZE >= SIM_TEMPLATE_LEN;
+            sim_schedule_packet(last ? PACKET_DATA_LAST : PACKET_DATA_MORE, 0, packet, SIM_PACKET_SIZE, -1);
+        }
+        break;
+    }
+    case CMD_DOWN_CHAR:
+        sim_downloading = true;
+        sim_download_len = 0;
+        sim_buffer_id = -1;
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        break;
+    case CMD_STORE_CHAR:
+    {
+        uint16_t id = (param[1] << 8) | param[2];
+        bool stored = sim_buffer_id >= 0 && id < sim_config.capacity;
+        sim_schedule(SIM_RESPONSE_DELAY_MS, (const uint8_t[]){stored ? 0x00 : 0x01}, 1, stored ? id : -1);
+        break;
+    }
+    case CMD_SLEEP:
+    case CMD_CONTROL_BLN:
+        sim_schedule_ack(SIM_RESPONSE_DELAY_MS, 0x00);
+        break;
+    default:
+        ESP_LOGW(TAG, "Unsupported command 0x%02X, no response", code);
+        break;
+    }
+}
+
+/**
+ * @brief Deliver scheduled responses to the driver as UART events
+ * @param pvParameters Task parameters (unused)
+ * @return void
+ */
+static void sim_task(void *pvParameters)
+{
+    struct sim_response response;
+    while (1)
+    {
+        if (xQueueReceive(response_queue, &response, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+        vTaskDelay(pdMS_TO_TICKS(response.delayMs));
+        uart_event_t event = {.type = response.pattern ? UART_PATTERN_DET : UART_DATA, .size = response.length};
+        bool deliver = false;
+        taskENTER_CRITICAL(&sim_lock);
+        if (response.epoch == sim_epoch && driver_queue != NULL && rx_count + response.length <= SIM_RX_BUFFER_SIZE)
+        {
+            if (response.pattern)
+            {
+                pattern_pos = rx_count;
+            }
+            for (uint16_t i = 0; i < response.length; i++)
+            {
+                rx_buffer[(rx_head + rx_count++) % SIM_RX_BUFFER_SIZE] = response.frame[i];
+            }
+            if (response.storeID >= 0)
+            {
+                sim_bitmap[response.storeID >> 3] |= 1 << (response.storeID & 0x07);
+            }
+            deliver = true;
+        }
+        taskEXIT_CRITICAL(&sim_lock);
+        if (deliver)
+        {
+            xQueueSend(driver_queue, &event, 0);
+        }
+    }
+}
+
+/**
+ * @brief Power on the simulated module, replaces the UART driver installation
+ * @param event_queue Output, UART event queue to be read by uart_task
+ * @return esp_err_t ESP_OK = simulator started, ESP_FAIL = queue or task creation failed
+ */
+esp_err_t zw111_sim_start(QueueHandle_t *event_queue)
+{
+    if (response_queue == NULL)
+    {
+        response_queue = xQueueCreate(SIM_RESPONSE_QUEUE_LEN, sizeof(struct sim_response));
+        if (response_queue == NULL || xTaskCreate(sim_task, "zw111_sim", 4096, NULL, 11, NULL) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Simulator creation failed");
+            return ESP_FAIL;
+        }
+    }
+    if (driver_queue == NULL)
+    {
+        driver_queue = xQueueCreate(20, sizeof(uart_event_t));
+        if (driver_queue == NULL)
+        {
+            return ESP_FAIL;
+        }
+    }
+    taskENTER_CRITICAL(&sim_lock);
+    rx_head = 0;
+    rx_count = 0;
+    pattern_pos = -1;
+    sim_epoch++;
+    taskEXIT_CRITICAL(&sim_lock);
+    *event_queue = driver_queue;
+
+    // Module reports power-on with a single 0x55 byte
+    struct sim_response response = {
+        .delayMs = SIM_POWER_ON_DELAY_MS,
+        .epoch = sim_epoch,
+        .pattern = true,
+        .storeID = -1,
+        .length = 1,
+        .frame = {0x55},
+    };
+    xQueueSend(response_queue, &response, 0);
+    ESP_LOGI(TAG, "Simulated module powered on (capacity %u)", sim_config.capacity);
+    return ESP_OK;
+}
+
+/**
+ * @brief Power off the simulated module, replaces the UART driver removal
+ * @return void
+ */
+void zw111_sim_stop()
+{
+    QueueHandle_t queue;
+    taskENTER_CRITICAL(&sim_lock);
+    sim_epoch++; // Drop everything still scheduled
+    rx_count = 0;
+    pattern_pos = -1;
+    queue = driver_queue;
+    driver_queue = NULL;
+    taskEXIT_CRITICAL(&sim_lock);
+    if (queue != NULL)
+    {
+        vQueueDelete(queue);
+    }
+    ESP_LOGI(TAG, "Simulated module powered off");
+}
+
+/**
+ * @brief Receive command frames from the driver, replaces uart_write_bytes()
+ * @param data Encoded command frames (one or more)
+ * @param len Number of bytes
+ * @return int Number of bytes accepted (always len)
+ */
+int zw111_sim_write(const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+    while (len - pos >= FRAME_HEADER_LEN + 1 + CHECKSUM_LEN)
+    {
+        const uint8_t *frame = data + pos;
+        uint16_t dataLen = (frame[7] << 8) | frame[8];
+        size_t frameLen = FRAME_HEADER_LEN + dataLen;
+        bool dataPacket = frame[6] == PACKET_DATA_MORE || frame[6] == PACKET_DATA_LAST;
+        if (frame[0] != FRAME_HEADER[0] || frame[1] != FRAME_HEADER[1] || (frame[6] != PACKET_CMD && !dataPacket) ||
+            dataLen < 1 + CHECKSUM_LEN || frameLen > len - pos)
+        {
+            ESP_LOGE(TAG, "Malformed command frame, discarded");
+            break;
+        }
+        uint16_t checksum = 0;
+        for (size_t i = CHECKSUM_START_INDEX; i < frameLen - CHECKSUM_LEN; i++)
+        {
+            checksum += frame[i];
+        }
+        if (checksum != ((frame[frameLen - 2] << 8) | frame[frameLen - 1]))
+        {
+            ESP_LOGE(TAG, "Command checksum mismatch, discarded");
+        }
+        else if (dataPacket)
+        {
+            // Template download, data packets are not acknowledged
+            if (sim_downloading)
+            {
+                sim_download_len += dataLen - CHECKSUM_LEN;
+                if (frame[6] == PACKET_DATA_LAST)
+                {
+                    sim_downloading = false;
+                    sim_buffer_id = FINGERPRINT_ID_NONE; // Buffer holds a downloaded template
+                    ESP_LOGI(TAG, "Template downloaded, %" PRIu32 " bytes", sim_download_len);
+                }
+            }
+        }
+        else
+        {
+            sim_handle_command(frame[FRAME_HEADER_LEN], &frame[FRAME_HEADER_LEN + 1]);
+        }
+        pos += frameLen;
+    }
+    return len;
+}
+
+/**
+ * @brief Read bytes delivered by the simulator, replaces uart_read_bytes()
+ * @param buf Output buffer
+ * @param len Maximum number of bytes to read
+ * @param ticks Unused, delivered bytes are available before their event is posted
+ * @return int Number of bytes read
+ */
+int zw111_sim_read(uint8_t *buf, uint32_t len, TickType_t ticks)
+{
+    uint32_t n = 0;
+    taskENTER_CRITICAL(&sim_lock);
+    while (n < len && rx_count > 0)
+    {
+        buf[n++] = rx_buffer[rx_head];
+        rx_head = (rx_head + 1) % SIM_RX_BUFFER_SIZE;
+        rx_count--;
+        if (pattern_pos > 0)
+        {
+            pattern_pos--;
+        }
+    }
+    taskEXIT_CRITICAL(&sim_lock);
+    return n;
+}
+
+/**
+ * @brief Number of bytes waiting to be read, replaces uart_get_buffered_data_len()
+ */
+esp_err_t zw111_sim_buffered_len(size_t *size)
+{
+    *size = rx_count;
+    return ESP_OK;
+}
+
+/**
+ * @brief Discard all bytes waiting to be read, replaces uart_flush_input()
+ * @return esp_err_t Always ESP_OK
+ */
+esp_err_t zw111_sim_flush_input()
+{
+    taskENTER_CRITICAL(&sim_lock);
+    rx_head = (rx_head + rx_count) % SIM_RX_BUFFER_SIZE;
+    rx_count = 0;
+    pattern_pos = -1;
+    taskEXIT_CRITICAL(&sim_lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Position of the power-on handshake byte, replaces uart_pattern_pop_pos()
+ * @return int Offset of the 0x55 byte from the read position, -1 = none pending
+ */
+int zw111_sim_pattern_pop_pos()
+{
+    taskENTER_CRITICAL(&sim_lock);
+    int pos = pattern_pos;
+    pattern_pos = -1;
+    taskEXIT_CRITICAL(&sim_lock);
+    return pos;
+}
+
+/**
+ * @brief Change the behaviour of the simulated module
+ * @param config New behaviour, applied to commands received from now on
+ * @return void
+ */
+void zw111_sim_configure(const struct zw111_sim_config *config)
+{
+    taskENTER_CRITICAL(&sim_lock);
+    sim_config = *config;
+    if (sim_config.capacity == 0 || sim_config.capacity > FINGERPRINT_MAX_CAPACITY)
+    {
+        sim_config.capacity = FINGERPRINT_MAX_CAPACITY;
+    }
+    taskEXIT_CRITICAL(&sim_lock);
+}
+
+/**
+ * @brief Drive back-to-back identifications through the real driver and report latency, drops and throughput
+ * @param pvParameters Number of identifications to run (cast to uint32_t)
+ * @return void
+ */
+void zw111_sim_benchmark_task(void *pvParameters)
+{
+    uint32_t runs = (uint32_t)pvParameters;
+    struct latency_stats latency;
+    if (latency_stats_init(&latency, runs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Benchmark aborted: out of memory");
+        vTaskDelete(NULL);
+        return;
+    }
+    vTaskDelay(pdMS_TO_TICKS(3000)); // Let the start-up index read finish
+
+    // Make sure the template that is going to match exists
+    taskENTER_CRITICAL(&sim_lock);
+    sim_bitmap[sim_config.matchID >> 3] |= 1 << (sim_config.matchID & 0x07);
+    taskEXIT_CRITICAL(&sim_lock);
+
+    struct fingerprint_timing before, now;
+    fingerprint_get_timing(&before);
+    uint32_t lost = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        // Wait until the previous verification has been released (module idle or off)
+        for (uint32_t waited = 0; zw111.power && zw111.state != 0x05 && waited < SIM_BENCHMARK_TIMEOUT_MS; waited += 10)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        fingerprint_get_timing(&now);
+        uint32_t results = now.resultCount;
+        xSemaphoreGive(fingerprint_semaphore); // Simulated touch
+        uint32_t waited = 0;
+        do
+        {
+            vTaskDelay(1);
+            waited += portTICK_PERIOD_MS;
+            fingerprint_get_timing(&now);
+        } while (now.resultCount == results && waited < SIM_BENCHMARK_TIMEOUT_MS);
+        if (now.resultCount != results)
+        {
+            latency_stats_add(&latency, now.identifyMs);
+        }
+        else
+        {
+            lost++;
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    fingerprint_get_timing(&now);
+
+    latency_stats_report(&latency, TAG, "identifications", "latency");
+    ESP_LOGI(TAG, "Benchmark: %" PRIu32 " lost, %" PRIu32 " dropped frames, %" PRIu32 " warm / %" PRIu32 " cold, %.2f identifications/s",
+             lost, now.droppedFrames - before.droppedFrames, now.warmCount - before.warmCount, now.coldCount - before.coldCount,
+             elapsed > 0 ? latency.count * 1000000.0 / elapsed : 0.0);
+    latency_stats_free(&latency);
+    vTaskDelete(NULL);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ZW111_SIM_H
+#define ZW111_SIM_H
+
+#include "zw111.h"
+#include "latency_stats.h"
+
+#define SIM_RESPONSE_QUEUE_LEN 32 // Maximum number of scheduled simulator responses
+#define SIM_RX_BUFFER_SIZE 1024   // Bytes buffered between simulator and driver
+#define SIM_POWER_ON_DELAY_MS 50  // Delay between power-on and the 0x55 handshake byte
+#define SIM_RESPONSE_DELAY_MS 5   // Delay of plain command acknowledgements
+#define SIM_BENCHMARK_TIMEOUT_MS 5000 // Time a benchmark run waits for an identification result
+#define SIM_TEMPLATE_LEN 1024     // Size of a simulated template (bytes)
+#define SIM_PACKET_SIZE_CODE 2    // Data packet size code reported by ReadSysPara (0=32, 1=64, 2=128, 3=256 bytes)
+#define SIM_PACKET_SIZE (32 << SIM_PACKET_SIZE_CODE) // Data packet size used by the simulated module (bytes)
+
+// Behaviour of the simulated module, adjustable at run time with zw111_sim_configure()
+struct zw111_sim_config
+{
+    uint16_t capacity;           // Template capacity reported by ReadSysPara
+    uint32_t matchDelayMs;       // Delay between identify command and image capture
+    uint32_t enrollStepDelayMs;  // Delay between the steps of an enrollment
+    bool matchFound;             // Whether identification finds a match
+    uint16_t matchID;            // Reported matching ID
+    uint16_t matchScore;         // Reported matching score
+    uint16_t checksumErrorEvery; // Corrupt the checksum of every Nth response frame, 0 = never
+};
+
+esp_err_t zw111_sim_start(QueueHandle_t *event_queue);
+void zw111_sim_stop();
+int zw111_sim_write(const uint8_t *data, size_t len);
+int zw111_sim_read(uint8_t *buf, uint32_t len, TickType_t ticks);
+esp_err_t zw111_sim_buffered_len(size_t *size);
+esp_err_t zw111_sim_flush_input();
+int zw111_sim_pattern_pop_pos();
+void zw111_sim_configure(const struct zw111_sim_config *config);
+void zw111_sim_benchmark_task(void *pvParameters);
+
+#endif
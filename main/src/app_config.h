@@ -24,9 +24,13 @@
 #define PN7160_RST_PIN 48         /*!< GPIO for PN7160 reset */
 #define PN7160_INT_PIN 36         /*!< GPIO for PN7160 interrupt */
 #define I2C_MASTER_NUM I2C_NUM_0  /*!< I2C port number */
-#define I2C_MASTER_FREQ_HZ 100000 /*!< I2C master clock frequency */
 #define PN7160_I2C_ADDRESS ((uint8_t)0x28)
+#define PN7160_I2C_FREQ_HZ 400000           /*!< PN7160 SCL frequency (fast mode) */
+#define PN7160_ACTIVE_POLL_PERIOD_MS 100    /*!< RF discovery period while the MCU is awake (ms) */
+#define PN7160_LOW_POWER_POLL_PERIOD_MS 300 /*!< Low-power card detection period while the MCU sleeps (ms) */
 #define OLED_I2C_ADDRESS ((uint8_t)0x3C)
+#define OLED_I2C_FREQ_HZ 400000             /*!< SSD1306 SCL frequency (fast mode) */
+#define OLED_FRAME_INTERVAL_MS 50           /*!< Shortest time between two display frames (ms), refresh requests in between are merged */
 
 #define LOCK_CTL_PIN 35
 #define BUZZER_CTL_PIN 20
@@ -38,11 +42,24 @@
 
 #define BATTERY_PIN 1
 
-#define MAX_CARDS 20
+#define CARD_STORE_MAX 4096           // Cards the credential store holds
+#define CARD_STORE_PARTITION "cards"  // NVS partition of the credential store (partitions.csv)
+#define CARD_BINDINGS_MAX 64          // Cards that can have a two-factor policy or bound fingerprints
+#define CARD_BOUND_FINGERS_MAX 4      // Fingerprint templates that can be bound to one card
+#define CARD_FINGER_WINDOW_MS 10000   // Time after a two-factor card in which the bound finger must be verified (ms)
+#define CARD_DEBOUNCE_WINDOW_MS 1500  // A card seen again within this time of its last sighting is not handled again (ms)
+#define CARD_POLICY_CARD_ONLY 0       // Card alone unlocks
+#define CARD_POLICY_CARD_AND_FINGER 1 // Card arms a 1:1 verification of the bound fingerprints, finger alone is refused
 
 #define TOUCH_PASSWORD_LEN 6
 #define DEFAULT_PASSWORD "123456"
 #define DEFAULT_SLEEP_TIME 60
+#define FINGERPRINT_SIMULATOR 0                // 1 = replace the ZW111 on UART2 with the in-process simulator
+#define FINGERPRINT_SIMULATOR_BENCHMARK_RUNS 0 // Identifications driven by the simulator benchmark at start-up, 0 = off
+#define NFC_SIMULATOR 0                        // 1 = replace the PN7160 (and OLED) on the I2C bus with the in-process emulator
+#define NFC_SIMULATOR_BENCHMARK_RUNS 0         // Taps driven by the emulator benchmark at start-up, 0 = off
+#define OLED_BENCHMARK_RUNS 0                  // Passes of the OLED text render benchmark at start-up, 0 = off
+#define DEFAULT_FINGERPRINT_KEEP_WARM_TIME 10 // Seconds the fingerprint module stays powered after the last operation, 0 = power off immediately
 
 #define true 1
 #define false 0
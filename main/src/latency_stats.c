@@ -0,0 +1,73 @@
+#include "latency_stats.h"
+
+/**
+ * @brief Allocate room for the samples of a benchmark
+ * @param stats Statistics to initialise
+ * @param capacity Number of samples
+ * @return esp_err_t ESP_OK = ready, ESP_ERR_NO_MEM = allocation failed
+ */
+esp_err_t latency_stats_init(struct latency_stats *stats, uint32_t capacity)
+{
+    stats->samples = malloc(capacity * sizeof(uint32_t));
+    stats->count = 0;
+    stats->capacity = stats->samples != NULL ? capacity : 0;
+    return stats->samples != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/**
+ * @brief Record one latency sample, samples beyond the capacity are dropped
+ * @param stats Statistics
+ * @param ms Latency (ms)
+ * @return void
+ */
+void latency_stats_add(struct latency_stats *stats, uint32_t ms)
+{
+    if (stats->count < stats->capacity)
+    {
+        stats->samples[stats->count++] = ms;
+    }
+}
+
+/**
+ * @brief Sort helper for latency samples
+ */
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Sort the samples and log their p50, p90, p99 and maximum
+ * @param stats Statistics, the samples are left sorted
+ * @param tag Log tag of the benchmark
+ * @param unit What one sample is, e.g. "taps"
+ * @param label What the latency measures, e.g. "tap-to-verdict"
+ * @return void
+ */
+void latency_stats_report(struct latency_stats *stats, const char *tag, const char *unit, const char *label)
+{
+    uint32_t n = stats->count;
+    if (n == 0)
+    {
+        return;
+    }
+    qsort(stats->samples, n, sizeof(uint32_t), compare_u32);
+    ESP_LOGI(tag, "Benchmark: %" PRIu32 " %s, %s p50 %" PRIu32 " ms, p90 %" PRIu32 " ms, p99 %" PRIu32 " ms, max %" PRIu32 " ms",
+             n, unit, label, stats->samples[(n - 1) * 50 / 100], stats->samples[(n - 1) * 90 / 100],
+             stats->samples[(n - 1) * 99 / 100], stats->samples[n - 1]);
+}
+
+/**
+ * @brief Release the samples
+ * @param stats Statistics
+ * @return void
+ */
+void latency_stats_free(struct latency_stats *stats)
+{
+    free(stats->samples);
+    stats->samples = NULL;
+    stats->count = 0;
+    stats->capacity = 0;
+}
@@ -0,0 +1,21 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "app_config.h"
+
+// Latency samples collected by a simulator benchmark
+struct latency_stats
+{
+    uint32_t *samples; // Collected latencies (ms)
+    uint32_t count;    // Number of collected samples
+    uint32_t capacity; // Size of samples
+};
+
+esp_err_t latency_stats_init(struct latency_stats *stats, uint32_t capacity);
+void latency_stats_add(struct latency_stats *stats, uint32_t ms);
+void latency_stats_report(struct latency_stats *stats, const char *tag, const char *unit, const char *label);
+void latency_stats_free(struct latency_stats *stats);
+
+#endif
@@ -0,0 +1,384 @@
+#include "template_backup.h"
+
+static const char *TAG = "template_backup";
+
+static StreamBufferHandle_t template_stream = NULL; // Packet data between the UART task and the backup/restore task
+static SemaphoreHandle_t template_done = NULL;      // Given by the completion callback of the current transfer
+static volatile enum fingerprint_op_result template_result;
+static volatile bool template_stream_end = false; // Restore: no further data follows for the current template
+static volatile bool template_abort = false;      // Restore: reader failed, the source aborts the transfer
+static bool template_busy = false;                // A backup or restore is running
+static portMUX_TYPE template_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Claim the transfer bridge and allocate its stream buffer and completion semaphore
+ * @return esp_err_t ESP_OK = claimed, ESP_ERR_INVALID_STATE = another transfer is running, ESP_ERR_NO_MEM = allocation failed
+ */
+static esp_err_t template_bridge_open()
+{
+    taskENTER_CRITICAL(&template_lock);
+    bool busy = template_busy;
+    template_busy = true;
+    taskEXIT_CRITICAL(&template_lock);
+    if (busy)
+    {
+        ESP_LOGW(TAG, "Template transfer already running");
+        return ESP_ERR_INVALID_STATE;
+    }
+    template_stream = xStreamBufferCreate(TEMPLATE_STREAM_BUFFER_SIZE, 1);
+    template_done = xSemaphoreCreateBinary();
+    if (template_stream == NULL || template_done == NULL)
+    {
+        ESP_LOGE(TAG, "Template bridge allocation failed");
+        if (template_stream != NULL)
+        {
+            vStreamBufferDelete(template_stream);
+            template_stream = NULL;
+        }
+        if (template_done != NULL)
+        {
+            vSemaphoreDelete(template_done);
+            template_done = NULL;
+        }
+        template_busy = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Release the transfer bridge, every submitted operation must have completed
+ */
+static void template_bridge_close()
+{
+    vStreamBufferDelete(template_stream);
+    vSemaphoreDelete(template_done);
+    template_stream = NULL;
+    template_done = NULL;
+    template_busy = false;
+}
+
+/**
+ * @brief Completion callback of backup and restore operations
+ */
+static void template_operation_done(fingerprint_op_handle_t handle, enum fingerprint_op_type type, uint16_t id,
+                                    enum fingerprint_op_result result, void *arg)
+{
+    template_result = result;
+    xSemaphoreGive(template_done);
+}
+
+/**
+ * @brief Backup sink, frames an uploaded packet as a record and queues it for the writer
+ * @note Runs in the UART task and never blocks; the stream buffer holds a whole template, so running out of space
+ *       means the writer has stalled and the transfer is aborted
+ */
+static esp_err_t template_backup_sink(uint16_t id, const uint8_t *data, uint16_t len, bool last, void *arg)
+{
+    if (xStreamBufferSpacesAvailable(template_stream) < TEMPLATE_RECORD_HEADER_LEN + len)
+    {
+        ESP_LOGE(TAG, "Backup stream full at ID %u", id);
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t header[TEMPLATE_RECORD_HEADER_LEN] = {id >> 8, id & 0xFF, last ? TEMPLATE_RECORD_LAST : 0, len >> 8, len & 0xFF};
+    xStreamBufferSend(template_stream, header, sizeof(header), 0);
+    xStreamBufferSend(template_stream, data, len, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief Restore source, hands the data queued by the restore task to the UART task
+ * @note Blocks until data arrives, so the module is fed no faster than the reader delivers
+ */
+static int template_restore_source(uint16_t id, uint8_t *buf, uint16_t len, void *arg)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)TEMPLATE_STREAM_TIMEOUT_MS * 1000;
+    while (1)
+    {
+        size_t received = xStreamBufferReceive(template_stream, buf, len, pdMS_TO_TICKS(10));
+        if (received > 0)
+        {
+            return received;
+        }
+        if (template_abort)
+        {
+            return -1;
+        }
+        if (template_stream_end && xStreamBufferIsEmpty(template_stream))
+        {
+            return 0;
+        }
+        if (esp_timer_get_time() > deadline)
+        {
+            ESP_LOGE(TAG, "Restore stream stalled at ID %u", id);
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Back up every enrolled template
+ * @note Templates are uploaded one at a time; the next upload only starts once the writer has drained the previous
+ *       template, which is the only flow control available since the module streams without waiting for the host
+ * @param writer Receives the backup stream
+ * @param ctx Argument passed to the writer
+ * @param count Number of templates backed up, may be NULL
+ * @return esp_err_t ESP_OK = all templates backed up, otherwise the writer's error or ESP_FAIL
+ */
+esp_err_t template_backup_run(template_writer_t writer, void *ctx, uint16_t *count)
+{
+    if (count != NULL)
+    {
+        *count = 0;
+    }
+    esp_err_t ret = template_bridge_open();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    uint8_t chunk[FINGERPRINT_MAX_PACKET_SIZE];
+    for (uint16_t id = fingerprint_id_next(0); id != FINGERPRINT_ID_NONE; id = fingerprint_id_next(id + 1))
+    {
+        xStreamBufferReset(template_stream);
+        if (fingerprint_submit_backup(id, template_backup_sink, NULL, template_operation_done, NULL) == 0)
+        {
+            ret = ESP_FAIL;
+            break;
+        }
+        bool done = false;
+        while (!done || !xStreamBufferIsEmpty(template_stream))
+        {
+            size_t received = xStreamBufferReceive(template_stream, chunk, sizeof(chunk), pdMS_TO_TICKS(50));
+            if (received > 0 && ret == ESP_OK)
+            {
+                ret = writer(ctx, chunk, received);
+                if (ret != ESP_OK)
+                {
+                    ESP_LOGE(TAG, "Backup writer failed at ID %u (%s)", id, esp_err_to_name(ret));
+                    fingerprint_cancel_operations(FP_OP_BACKUP);
+                }
+            }
+            if (!done)
+            {
+                done = xSemaphoreTake(template_done, 0) == pdTRUE;
+            }
+        }
+        if (ret != ESP_OK)
+        {
+            break;
+        }
+        if (template_result != FP_OP_SUCCESS)
+        {
+            ESP_LOGE(TAG, "Backup of ID %u failed (%d)", id, template_result);
+            ret = ESP_FAIL;
+            break;
+        }
+        if (count != NULL)
+        {
+            (*count)++;
+        }
+    }
+    template_bridge_close();
+    return ret;
+}
+
+/**
+ * @brief Read exactly len bytes from a reader
+ * @return int 1 = read, 0 = end of stream before the first byte, -1 = error or truncated stream
+ */
+static int template_read_exact(template_reader_t reader, void *ctx, uint8_t *buf, size_t len)
+{
+    size_t filled = 0;
+    while (filled < len)
+    {
+        int n = reader(ctx, buf + filled, len - filled);
+        if (n < 0)
+        {
+            return -1;
+        }
+        if (n == 0)
+        {
+            return filled == 0 ? 0 : -1;
+        }
+        filled += n;
+    }
+    return 1;
+}
+
+/**
+ * @brief Queue restore data for the UART task, waiting while the stream buffer is full
+ * @return bool true = queued, false = the operation completed early or the UART task stopped consuming
+ */
+static bool template_restore_push(const uint8_t *data, size_t len, bool *done)
+{
+    int64_t deadline = esp_timer_get_time() + (int64_t)TEMPLATE_STREAM_TIMEOUT_MS * 1000;
+    size_t sent = 0;
+    while (sent < len)
+    {
+        sent += xStreamBufferSend(template_stream, data + sent, len - sent, pdMS_TO_TICKS(50));
+        if (!*done)
+        {
+            *done = xSemaphoreTake(template_done, 0) == pdTRUE;
+        }
+        if (*done || esp_timer_get_time() > deadline)
+        {
+            return sent == len && !*done;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Restore templates from a backup stream, each template overwrites the ID it was backed up from
+ * @param reader Delivers the backup stream
+ * @param ctx Argument passed to the reader
+ * @param count Number of templates restored, may be NULL
+ * @return esp_err_t ESP_OK = all templates restored, ESP_ERR_INVALID_SIZE = malformed stream, ESP_FAIL = transfer failed
+ */
+esp_err_t template_restore_run(template_reader_t reader, void *ctx, uint16_t *count)
+{
+    if (count != NULL)
+    {
+        *count = 0;
+    }
+    esp_err_t ret = template_bridge_open();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    uint8_t header[TEMPLATE_RECORD_HEADER_LEN];
+    uint8_t payload[FINGERPRINT_MAX_PACKET_SIZE];
+    bool inTemplate = false;
+    bool done = false;
+    uint16_t currentID = 0;
+    while (1)
+    {
+        int r = template_read_exact(reader, ctx, header, sizeof(header));
+        if (r <= 0)
+        {
+            if (r < 0 || inTemplate)
+            {
+                ESP_LOGE(TAG, "Restore stream truncated");
+                ret = ESP_ERR_INVALID_SIZE;
+            }
+            break;
+        }
+        uint16_t id = (header[0] << 8) | header[1];
+        uint16_t len = (header[3] << 8) | header[4];
+        if (len == 0 || len > sizeof(payload) || (inTemplate && id != currentID))
+        {
+            ESP_LOGE(TAG, "Malformed restore record (ID %u, length %u)", id, len);
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        if (template_read_exact(reader, ctx, payload, len) != 1)
+        {
+            ESP_LOGE(TAG, "Restore stream truncated at ID %u", id);
+            ret = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        if (!inTemplate)
+        {
+            xStreamBufferReset(template_stream);
+            template_stream_end = false;
+            template_abort = false;
+            done = false;
+            if (fingerprint_submit_restore(id, template_restore_source, NULL, template_operation_done, NULL) == 0)
+            {
+                ret = ESP_FAIL;
+                break;
+            }
+            inTemplate = true;
+            currentID = id;
+        }
+        if (!template_restore_push(payload, len, &done))
+        {
+            ESP_LOGE(TAG, "Restore of ID %u stalled or failed", id);
+            ret = ESP_FAIL;
+            break;
+        }
+        if (header[2] & TEMPLATE_RECORD_LAST)
+        {
+            template_stream_end = true;
+            inTemplate = false;
+            if (!done)
+            {
+                xSemaphoreTake(template_done, portMAX_DELAY); // The operation deadline bounds the wait
+                done = true;
+            }
+            if (template_result != FP_OP_SUCCESS)
+            {
+                ESP_LOGE(TAG, "Restore of ID %u failed (%d)", id, template_result);
+                ret = ESP_FAIL;
+                break;
+            }
+            if (count != NULL)
+            {
+                (*count)++;
+            }
+        }
+    }
+    if (inTemplate && !done)
+    {
+        // Let the source abort the transfer, or drop the operation if it has not been dispatched yet
+        template_abort = true;
+        fingerprint_cancel_operations(FP_OP_RESTORE);
+        xSemaphoreTake(template_done, portMAX_DELAY);
+    }
+    template_bridge_close();
+    return ret;
+}
+
+static esp_err_t template_file_writer(void *ctx, const uint8_t *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *)ctx) == len ? ESP_OK : ESP_FAIL;
+}
+
+static int template_file_reader(void *ctx, uint8_t *buf, size_t len)
+{
+    size_t n = fread(buf, 1, len, (FILE *)ctx);
+    return (n == 0 && ferror((FILE *)ctx)) ? -1 : (int)n;
+}
+
+/**
+ * @brief Back up every enrolled template to a file
+ * @param path File to (over)write
+ * @param count Number of templates backed up, may be NULL
+ * @return esp_err_t ESP_OK = success
+ */
+esp_err_t template_backup_to_file(const char *path, uint16_t *count)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = template_backup_run(template_file_writer, fp, count);
+    if (fclose(fp) != 0 && ret == ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Backup to %s: %s", path, esp_err_to_name(ret));
+    return ret;
+}
+
+/**
+ * @brief Restore templates from a backup file
+ * @param path File written by template_backup_to_file or downloaded from the web interface
+ * @param count Number of templates restored, may be NULL
+ * @return esp_err_t ESP_OK = success
+ */
+esp_err_t template_restore_from_file(const char *path, uint16_t *count)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = template_restore_run(template_file_reader, fp, count);
+    fclose(fp);
+    ESP_LOGI(TAG, "Restore from %s: %s", path, esp_err_to_name(ret));
+    return ret;
+}
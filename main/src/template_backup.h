@@ -0,0 +1,34 @@
+#ifndef TEMPLATE_BACKUP_H
+#define TEMPLATE_BACKUP_H
+
+#include <stdio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+#include "app_config.h"
+#include "zw111.h"
+
+#define TEMPLATE_BACKUP_PATH "/spiffs/templates.bin" // Backup file on SPIFFS
+#define TEMPLATE_STREAM_BUFFER_SIZE 4096             // Bridge between UART task and writer/reader, holds at least one template
+#define TEMPLATE_STREAM_TIMEOUT_MS 5000              // Longest wait for the other side of the bridge (ms)
+#define TEMPLATE_RECORD_HEADER_LEN 5                 // Record header: fingerprint ID (2) + flags (1) + payload length (2)
+#define TEMPLATE_RECORD_LAST 0x01                    // Record flag: payload is the final packet of a template
+
+/**
+ * Backup stream format: a sequence of records, one per data packet uploaded by the module
+ * [ID high][ID low][flags][length high][length low][payload...], records of one template are contiguous and the
+ * last one carries TEMPLATE_RECORD_LAST. The same format is accepted by the restore functions.
+ */
+
+// Consumes backup data, returns ESP_OK to continue
+typedef esp_err_t (*template_writer_t)(void *ctx, const uint8_t *data, size_t len);
+
+// Produces restore data, returns the number of bytes read (at most len), 0 = end of stream, negative = error
+typedef int (*template_reader_t)(void *ctx, uint8_t *buf, size_t len);
+
+esp_err_t template_backup_run(template_writer_t writer, void *ctx, uint16_t *count);
+esp_err_t template_restore_run(template_reader_t reader, void *ctx, uint16_t *count);
+esp_err_t template_backup_to_file(const char *path, uint16_t *count);
+esp_err_t template_restore_from_file(const char *path, uint16_t *count);
+
+#endif
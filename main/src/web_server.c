@@ -6,16 +6,14 @@ static esp_err_t root_handler(httpd_req_t *req);
 static esp_err_t css_handler(httpd_req_t *req);
 static esp_err_t ws_handler(httpd_req_t *req);
 static esp_err_t favicon_handler(httpd_req_t *req);
+static esp_err_t backup_handler(httpd_req_t *req);
+static esp_err_t restore_handler(httpd_req_t *req);
+static void send_card_page(uint32_t offset, int fd);
 
 // Flag bits
-bool g_ready_add_fingerprint = false;
-bool g_cancel_add_fingerprint = false;
-bool g_ready_delete_fingerprint = false;
-bool g_ready_delete_all_fingerprint = false;
 bool g_ready_add_card = false;
 bool g_ready_delete_card = false;
-uint64_t g_delete_card_number = 0;
-uint8_t g_deleteFingerprintID = 0;
+struct card_uid g_delete_card_number = {0};
 
 httpd_handle_t server = NULL;
 
@@ -73,6 +71,18 @@ httpd_handle_t web_server_start(void)
         .handler = favicon_handler,
         .user_ctx = NULL};
 
+    static const httpd_uri_t backup_uri = {
+        .uri = "/fingerprints/backup",
+        .method = HTTP_GET,
+        .handler = backup_handler,
+        .user_ctx = NULL};
+
+    static const httpd_uri_t restore_uri = {
+        .uri = "/fingerprints/restore",
+        .method = HTTP_POST,
+        .handler = restore_handler,
+        .user_ctx = NULL};
+
     // -------------------------------
     // Start server
     // -------------------------------
@@ -87,6 +97,8 @@ httpd_handle_t web_server_start(void)
     httpd_register_uri_handler(server, &css_uri);
     httpd_register_uri_handler(server, &ws_uri);
     httpd_register_uri_handler(server, &favicon_uri);
+    httpd_register_uri_handler(server, &backup_uri);
+    httpd_register_uri_handler(server, &restore_uri);
 
     ESP_LOGI(TAG, "Web server started successfully");
     return server;
@@ -189,6 +201,167 @@ static esp_err_t favicon_handler(httpd_req_t *req)
     return httpd_resp_send_chunk(req, NULL, 0);
 }
 
+static esp_err_t backup_chunk_writer(void *ctx, const uint8_t *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len);
+}
+
+/**
+ * @brief Stream every enrolled template to the client as it is uploaded by the module
+ * @param req Request detached from the server task by httpd_req_async_handler_begin()
+ */
+static void backup_send(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"templates.bin\"");
+    uint16_t count = 0;
+    esp_err_t res = template_backup_run(backup_chunk_writer, req, &count);
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Fingerprint backup failed after %u templates (%s)", count, esp_err_to_name(res));
+        return; // The connection is closed without the final chunk, the client sees a truncated download
+    }
+    ESP_LOGI(TAG, "Fingerprint backup sent (%u templates)", count);
+    httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static int restore_body_reader(void *ctx, uint8_t *buf, size_t len)
+{
+    httpd_req_t *req = (httpd_req_t *)ctx;
+    for (uint8_t timeouts = 0; timeouts < RESTORE_RECV_MAX_TIMEOUTS; timeouts++)
+    {
+        int n = httpd_req_recv(req, (char *)buf, len);
+        if (n != HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            return n;
+        }
+    }
+    ESP_LOGE(TAG, "Restore upload stalled, giving up");
+    return -1;
+}
+
+/**
+ * @brief Restore the templates of a file produced by the backup download
+ * @param req Request detached from the server task by httpd_req_async_handler_begin()
+ */
+static void restore_receive(httpd_req_t *req)
+{
+    uint16_t count = 0;
+    esp_err_t res = template_restore_run(restore_body_reader, req, &count);
+    send_fingerprint_list();
+    if (res != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Fingerprint restore failed after %u templates (%s)", count, esp_err_to_name(res));
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(res));
+        return;
+    }
+    char response[32];
+    snprintf(response, sizeof(response), "%u", count);
+    httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief Run a backup download or restore upload, the transfer runs at the UART rate and would hold up the server
+ *        task (and with it the WebSocket UI) for its whole duration
+ * @param pvParameters Detached request
+ */
+static void template_http_task(void *pvParameters)
+{
+    httpd_req_t *req = (httpd_req_t *)pvParameters;
+    if (req->method == HTTP_POST)
+    {
+        restore_receive(req);
+    }
+    else
+    {
+        backup_send(req);
+    }
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Detach a template transfer request from the server task and hand it to template_http_task
+ * @param req Request
+ * @return esp_err_t ESP_OK = handed over, others = failed (500 sent)
+ */
+static esp_err_t template_http_start(httpd_req_t *req)
+{
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK)
+    {
+        return httpd_resp_send_500(req);
+    }
+    if (xTaskCreate(template_http_task, "template_http", TEMPLATE_HTTP_TASK_STACK, async_req, 5, NULL) != pdPASS)
+    {
+        httpd_req_async_handler_complete(async_req);
+        return httpd_resp_send_500(req);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Fingerprint template backup download handler, streams every enrolled template as it is uploaded by the module
+ */
+static esp_err_t backup_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received fingerprint backup request");
+    return template_http_start(req);
+}
+
+/**
+ * Fingerprint template restore upload handler, the body is a file produced by the backup handler
+ */
+static esp_err_t restore_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received fingerprint restore request (%d bytes)", (int)req->content_len);
+    return template_http_start(req);
+}
+
+/**
+ * @brief Back up or restore all templates on SPIFFS, run as a task so the WebSocket handler returns immediately
+ * @param pvParameters true = restore, false = backup
+ */
+static void template_file_task(void *pvParameters)
+{
+    bool restore = (bool)(uintptr_t)pvParameters;
+    uint16_t count = 0;
+    esp_err_t res = restore ? template_restore_from_file(TEMPLATE_BACKUP_PATH, &count)
+                            : template_backup_to_file(TEMPLATE_BACKUP_PATH, &count);
+    ESP_LOGI(TAG, "Template %s finished: %u templates (%s)", restore ? "restore" : "backup", count, esp_err_to_name(res));
+    send_operation_result(restore ? "fingerprints_restored" : "fingerprints_backed_up", res == ESP_OK);
+    if (restore)
+    {
+        send_fingerprint_list();
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief Completion callback of fingerprint operations submitted from the front-end
+ * @note Called from the fingerprint UART task, reports the result and refreshes the list on success
+ */
+static void fingerprint_operation_done(fingerprint_op_handle_t handle, enum fingerprint_op_type type, uint16_t id,
+                                       enum fingerprint_op_result result, void *arg)
+{
+    const char *message = type == FP_OP_ENROLL   ? "fingerprint_added"
+                          : type == FP_OP_DELETE ? "fingerprint_deleted"
+                                                 : "fingerprint_cleared";
+    if (result == FP_OP_CANCELLED)
+    {
+        return; // Cancelled by the user, nothing to report
+    }
+    if (result == FP_OP_SUCCESS && type != FP_OP_ENROLL)
+    {
+        card_binding_forget_fingerprint(type == FP_OP_EMPTY ? FINGERPRINT_ID_NONE : id); // Unbind removed templates
+    }
+    send_operation_result(message, result == FP_OP_SUCCESS);
+    if (result == FP_OP_SUCCESS && type != FP_OP_EMPTY)
+    {
+        send_fingerprint_list();
+    }
+}
+
 /**
  * WebSocket request handler - Process button commands and print prompts
  */
@@ -279,7 +452,7 @@ static esp_err_t ws_handler(httpd_req_t *req)
     {
         ESP_LOGI(TAG, "Processing add card command");
         // Check if there is remaining space
-        if (g_card_count < MAX_CARDS)
+        if (card_store_count() < CARD_STORE_MAX)
         {
             g_ready_add_card = true;
         }
@@ -296,43 +469,33 @@ static esp_err_t ws_handler(httpd_req_t *req)
     else if (strncmp(recv_buf, "delete_card:", 12) == 0)
     {
         char *prefix = "delete_card:";
-        g_delete_card_number = strtoull(recv_buf + strlen(prefix), NULL, 10);
-        ESP_LOGI(TAG, "Processing delete specified card command, card number: %llx", g_delete_card_number);
+        bool valid = card_uid_from_hex(recv_buf + strlen(prefix), &g_delete_card_number, NULL);
+        ESP_LOGI(TAG, "Processing delete specified card command, card number: %s", recv_buf + strlen(prefix));
 
         g_ready_delete_card = true;
-        for (uint8_t i = 0; i < g_card_count; i++)
+        if (valid && card_store_remove(&g_delete_card_number) == ESP_OK) // Writes a single journal record
         {
-            if (g_card_id_value[i] == g_delete_card_number)
-            {
-                // Find matching item, delete card
-                for (uint8_t j = i; j < g_card_count - 1; j++)
-                {
-                    g_card_id_value[j] = g_card_id_value[j + 1];
-                }
-                g_card_count--;
-                nvs_custom_set_u8(NULL, "card", "count", g_card_count);
-                send_operation_result("card_deleted", true); // Send operation result
-                send_card_list();                            // Send updated card list
-                ESP_LOGI(TAG, "Card %llx deleted successfully", g_delete_card_number);
-                break;
-            }
+            card_binding_remove(&g_delete_card_number);
+            send_operation_result("card_deleted", true); // Send operation result
+            send_card_list();                            // Send updated card list
+            ESP_LOGI(TAG, "Card %s deleted successfully", recv_buf + strlen(prefix));
+        }
+        else
+        {
+            send_operation_result("card_deleted", false);
+            ESP_LOGW(TAG, "Card %s not deleted", recv_buf + strlen(prefix));
         }
     }
     else if (strcmp(recv_buf, "add_fingerprint") == 0)
     {
         ESP_LOGI(TAG, "Processing add fingerprint command, current module state: %u", zw111.state);
         // Check if there is remaining space
-        if (zw111.fingerNumber < 100)
+        if (zw111.fingerNumber < zw111.capacity)
         {
-            if (zw111.power == true)
+            if (fingerprint_submit_operation(FP_OP_ENROLL, 0, FP_OP_ENROLL_TIMEOUT_MS, FP_OP_DEFAULT_RETRIES,
+                                             fingerprint_operation_done, NULL) == 0)
             {
-                cancel_current_operation_and_execute_command();
-                g_ready_add_fingerprint = true;
-            }
-            else
-            {
-                zw111.state = 0x02;    // Set state to enroll fingerprint state
-                turn_on_fingerprint(); // Power on
+                send_operation_result("fingerprint_added", false);
             }
         }
         else
@@ -343,34 +506,72 @@ static esp_err_t ws_handler(httpd_req_t *req)
     else if (strcmp(recv_buf, "cancel_add_fingerprint") == 0)
     {
         ESP_LOGI(TAG, "Processing cancel add fingerprint command");
-        g_cancel_add_fingerprint = true;
-        cancel_current_operation_and_execute_command();
+        fingerprint_cancel_operations(FP_OP_ENROLL);
     }
     else if (strcmp(recv_buf, "clear_cards") == 0)
     {
         ESP_LOGI(TAG, "Processing clear all cards command");
-        g_card_count = 0;
-        nvs_custom_set_u8(NULL, "card", "count", g_card_count);
-        send_operation_result("card_cleared", true); // Send operation result
+        bool success = card_store_clear() == ESP_OK;
+        card_binding_clear();
+        send_operation_result("card_cleared", success); // Send operation result
+    }
+    else if (strncmp(recv_buf, "bind_card:", 10) == 0)
+    {
+        // Format: bind_card:<card UID in hex>:<policy>:<fingerprint ID>,<fingerprint ID>,...
+        char *cursor = recv_buf + strlen("bind_card:");
+        struct card_uid card_number;
+        bool valid = card_uid_from_hex(cursor, &card_number, &cursor) && *cursor == ':';
+        uint8_t policy = CARD_POLICY_CARD_ONLY;
+        uint16_t finger_ids[CARD_BOUND_FINGERS_MAX];
+        uint8_t finger_count = 0;
+        if (valid)
+        {
+            policy = (uint8_t)strtoul(cursor + 1, &cursor, 10);
+        }
+        while (valid && (*cursor == ':' || *cursor == ',') && cursor[1] != '\0')
+        {
+            char *end;
+            unsigned long id = strtoul(cursor + 1, &end, 10);
+            valid = end != cursor + 1 && finger_count < CARD_BOUND_FINGERS_MAX && fingerprint_id_exists((uint16_t)id);
+            if (valid)
+            {
+                finger_ids[finger_count++] = (uint16_t)id;
+            }
+            cursor = end;
+        }
+        ESP_LOGI(TAG, "Processing bind card command, card number: %.*s, policy: %u, fingerprints: %u",
+                 card_number.len * 2, recv_buf + strlen("bind_card:"), policy, finger_count);
+        bool success = valid && card_binding_set(&card_number, policy, finger_ids, finger_count) == ESP_OK;
+        send_operation_result("card_bound", success);
+        if (success)
+        {
+            send_card_list();
+        }
     }
     else if (strcmp(recv_buf, "clear_fingerprints") == 0)
     {
         ESP_LOGI(TAG, "Processing clear all fingerprints command, current module state: %u", zw111.state);
-        g_ready_delete_all_fingerprint = true;
-        if (zw111.power == true)
+        if (fingerprint_submit_operation(FP_OP_EMPTY, 0, FP_OP_DEFAULT_TIMEOUT_MS, FP_OP_DEFAULT_RETRIES,
+                                         fingerprint_operation_done, NULL) == 0)
         {
-            cancel_current_operation_and_execute_command();
+            send_operation_result("fingerprint_cleared", false);
         }
-        else
+    }
+    else if (strcmp(recv_buf, "backup_fingerprints") == 0 || strcmp(recv_buf, "restore_fingerprints") == 0)
+    {
+        bool restore = recv_buf[0] == 'r';
+        ESP_LOGI(TAG, "Processing %s fingerprints command", restore ? "restore" : "backup");
+        if (xTaskCreate(template_file_task, "template_file", 4096, (void *)(uintptr_t)restore, 5, NULL) != pdPASS)
         {
-            zw111.state = 0x03;    // Set state to delete fingerprint state
-            turn_on_fingerprint(); // Power on
+            send_operation_result(restore ? "fingerprints_restored" : "fingerprints_backed_up", false);
         }
     }
-    else if (strcmp(recv_buf, "refresh_cards") == 0)
+    else if (strcmp(recv_buf, "refresh_cards") == 0 || strncmp(recv_buf, "refresh_cards:", 14) == 0)
     {
-        ESP_LOGI(TAG, "Processing refresh card list command");
-        send_card_list();
+        // Format: refresh_cards[:<offset>], the page goes to the requesting client only
+        uint32_t offset = recv_buf[13] == ':' ? strtoul(recv_buf + 14, NULL, 10) : 0;
+        ESP_LOGI(TAG, "Processing refresh card list command, offset: %lu", (unsigned long)offset);
+        send_card_page(offset, httpd_req_to_sockfd(req));
     }
     else if (strcmp(recv_buf, "refresh_fingerprints") == 0)
     {
@@ -380,17 +581,12 @@ static esp_err_t ws_handler(httpd_req_t *req)
     else if (strncmp(recv_buf, "delete_fingerprint:", 19) == 0)
     {
         char *prefix = "delete_fingerprint:";
-        g_deleteFingerprintID = atoi(recv_buf + strlen(prefix));
-        ESP_LOGI(TAG, "Processing delete specified fingerprint command, ID: %u, current module state: %u", g_deleteFingerprintID, zw111.state);
-        g_ready_delete_fingerprint = true;
-        if (zw111.power == true)
+        uint16_t fingerprintID = atoi(recv_buf + strlen(prefix));
+        ESP_LOGI(TAG, "Processing delete specified fingerprint command, ID: %u, current module state: %u", fingerprintID, zw111.state);
+        if (fingerprint_submit_operation(FP_OP_DELETE, fingerprintID, FP_OP_DEFAULT_TIMEOUT_MS, FP_OP_DEFAULT_RETRIES,
+                                         fingerprint_operation_done, NULL) == 0)
         {
-            cancel_current_operation_and_execute_command();
-        }
-        else
-        {
-            zw111.state = 0x03;    // Set state to delete fingerprint state
-            turn_on_fingerprint(); // Power on
+            send_operation_result("fingerprint_deleted", false);
         }
     }
     else if (strncmp(recv_buf, "save_settings:", 14) == 0)
@@ -433,9 +629,9 @@ static esp_err_t ws_handler(httpd_req_t *req)
 }
 
 /**
- * WebSocket broadcast JSON data
+ * WebSocket send JSON data to one client, or to every client when fd < 0
  */
-static esp_err_t ws_broadcast_json(cJSON *json)
+static esp_err_t ws_send_json(cJSON *json, int fd)
 {
     if (!json)
         return ESP_FAIL;
@@ -446,9 +642,13 @@ static esp_err_t ws_broadcast_json(cJSON *json)
         .type = HTTPD_WS_TYPE_TEXT,
         .payload = (uint8_t *)json_str,
         .len = strlen(json_str)};
-    ESP_LOGI(TAG, "Broadcasting message: %s", json_str);
+    ESP_LOGD(TAG, "Sending %u bytes to fd=%d", (unsigned)ws_pkt.len, fd);
     for (int i = 0; i < ws_client_count; i++)
     {
+        if (fd >= 0 && ws_clients[i] != fd)
+        {
+            continue;
+        }
         if (httpd_ws_send_frame_async(server, ws_clients[i], &ws_pkt) != ESP_OK)
         {
             ESP_LOGW(TAG, "Failed to send to client fd=%d, removing, current client count:%d", ws_clients[i], ws_client_count);
@@ -461,24 +661,69 @@ static esp_err_t ws_broadcast_json(cJSON *json)
 }
 
 /**
- * Send card list
+ * WebSocket broadcast JSON data
  */
-void send_card_list()
+static esp_err_t ws_broadcast_json(cJSON *json)
+{
+    return ws_send_json(json, -1);
+}
+
+/**
+ * Create a card list item, with the card's unlock policy and bound fingerprints
+ */
+static cJSON *create_card_item(const struct card_uid *card_number)
+{
+    uint8_t policy;
+    uint16_t finger_ids[CARD_BOUND_FINGERS_MAX];
+    uint8_t finger_count = 0;
+    char hex[CARD_UID_HEX_LEN];
+    card_binding_get(card_number, &policy, finger_ids, &finger_count);
+    card_uid_to_hex(card_number, hex);
+    cJSON *item = cJSON_CreateObject();
+    cJSON *fingers = cJSON_CreateArray();
+    for (uint8_t i = 0; i < finger_count; i++)
+    {
+        cJSON_AddItemToArray(fingers, cJSON_CreateNumber(finger_ids[i]));
+    }
+    cJSON_AddStringToObject(item, "cardNumber", hex); // UID in hex, 7- and 10-byte UIDs do not fit a JSON number
+    cJSON_AddNumberToObject(item, "policy", policy);
+    cJSON_AddItemToObject(item, "fingerIds", fingers);
+    return item;
+}
+
+/**
+ * Send one page of the card list
+ * @note At most CARD_LIST_PAGE_SIZE cards per frame, so the JSON tree stays small however many cards are stored;
+ *       the page carries the total and the client asks for the next offset until it has them all
+ * @param offset Index of the first card on the page
+ * @param fd Client to send to, < 0 = every client
+ */
+static void send_card_page(uint32_t offset, int fd)
 {
     cJSON *root = cJSON_CreateObject();
     cJSON *data_array = cJSON_CreateArray();
-    for (int i = 0; i < g_card_count; i++)
+    struct card_uid card_number;
+    for (uint32_t i = offset; i < offset + CARD_LIST_PAGE_SIZE && card_store_get(i, &card_number); i++)
     {
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "cardNumber", g_card_id_value[i]);
-        cJSON_AddItemToArray(data_array, item);
+        cJSON_AddItemToArray(data_array, create_card_item(&card_number));
     }
     cJSON_AddStringToObject(root, "type", "card_list");
+    cJSON_AddNumberToObject(root, "offset", offset);
+    cJSON_AddNumberToObject(root, "total", card_store_count());
     cJSON_AddItemToObject(root, "data", data_array);
-    ws_broadcast_json(root);
+    ws_send_json(root, fd);
     cJSON_Delete(root);
 }
 
+/**
+ * Send card list
+ * @note Broadcasts the first page, clients fetch the rest with refresh_cards:<offset>
+ */
+void send_card_list()
+{
+    send_card_page(0, -1);
+}
+
 /**
  * Send fingerprint list
  */
@@ -486,10 +731,10 @@ void send_fingerprint_list()
 {
     cJSON *root = cJSON_CreateObject();
     cJSON *data_array = cJSON_CreateArray();
-    for (int i = 0; i < zw111.fingerNumber; i++)
+    for (uint16_t id = fingerprint_id_next(0); id != FINGERPRINT_ID_NONE; id = fingerprint_id_next(id + 1))
     {
         cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "templateId", (int)zw111.fingerIDArray[i]);
+        cJSON_AddNumberToObject(item, "templateId", id);
         cJSON_AddItemToArray(data_array, item);
     }
     cJSON_AddStringToObject(root, "type", "fingerprint_list");
@@ -516,21 +761,12 @@ void send_status_msg(const char *message)
 void send_init_data()
 {
     cJSON *root = cJSON_CreateObject();
-    cJSON *cards_array = cJSON_CreateArray();
     cJSON *fingers_array = cJSON_CreateArray();
-    // Add card data
-    for (int i = 0; i < g_card_count; i++)
-    {
-        cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "cardNumber", g_card_id_value[i]);
-        cJSON_AddItemToArray(cards_array, item);
-    }
-
     // Add fingerprint data
-    for (int i = 0; i < zw111.fingerNumber; i++)
+    for (uint16_t id = fingerprint_id_next(0); id != FINGERPRINT_ID_NONE; id = fingerprint_id_next(id + 1))
     {
         cJSON *item = cJSON_CreateObject();
-        cJSON_AddNumberToObject(item, "templateId", zw111.fingerIDArray[i]);
+        cJSON_AddNumberToObject(item, "templateId", id);
         cJSON_AddItemToArray(fingers_array, item);
     }
 
@@ -540,9 +776,10 @@ void send_init_data()
     cJSON_AddStringToObject(root, "version", CONFIG_APP_PROJECT_VER);
     cJSON_AddStringToObject(root, "password", g_touch_password);
     cJSON_AddItemToObject(root, "fingers", fingers_array);
-    cJSON_AddItemToObject(root, "cards", cards_array);
     ws_broadcast_json(root);
     cJSON_Delete(root);
+
+    send_card_list(); // Cards follow page by page
 }
 
 /**
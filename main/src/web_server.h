@@ -7,18 +7,26 @@
 #include <cJSON.h>
 #include "zw111.h"
 #include "nvs_custom.h"
+#include "template_backup.h"
+#include "card_store.h"
 
 #define CSS_PATH "/spiffs/style.css"
 #define FAVICON_PATH "/spiffs/favicon.ico"
 #define WS_RECV_BUFFER_SIZE 128
 #define MAX_WS_CLIENTS 5
+#define CARD_LIST_PAGE_SIZE 16 // Cards per card_list frame, bounds the JSON tree built for one frame
+#define RESTORE_RECV_MAX_TIMEOUTS 3 // Receive timeouts in a row (recv_wait_timeout each) before a stalled restore upload is dropped
+#define TEMPLATE_HTTP_TASK_STACK 4096 // Stack of the task running a backup download or restore upload
 
 extern char g_ap_ssid[32];
 extern char g_ap_pass[64];
 extern struct fingerprint_device zw111; // Fingerprint device instance
 extern char g_touch_password[TOUCH_PASSWORD_LEN + 1];             // Current password
-extern uint64_t g_card_id_value[MAX_CARDS];
-extern int g_card_count;
+extern bool card_binding_get(const struct card_uid *uid, uint8_t *policy, uint16_t *finger_ids, uint8_t *finger_count);
+extern esp_err_t card_binding_set(const struct card_uid *uid, uint8_t policy, const uint16_t *finger_ids, uint8_t finger_count);
+extern esp_err_t card_binding_remove(const struct card_uid *uid);
+extern esp_err_t card_binding_clear();
+extern esp_err_t card_binding_forget_fingerprint(uint16_t id);
 
 httpd_handle_t web_server_start(void);
 